@@ -0,0 +1,128 @@
+/*
+ * Microbenchmark for the job table with many jobs
+ * Adds, looks up (by job ID and by process ID) and removes 10k to 100k jobs, in
+ * an order that leaves holes in the table, and reports the time per operation
+ * as JSON, one object per table size. Exits with status 1 if a lookup finds
+ * the wrong job or a job's ID changes while other jobs are removed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../job_list.h"
+
+#define PID_BASE 1000
+#define STAGES 3  // processes per job, as in a three-stage pipeline
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static pid_t pid_of(unsigned job, unsigned stage) {
+    return PID_BASE + job * STAGES + stage;
+}
+
+static int add_job(job_list_t *list, unsigned n) {
+    job_t job;
+    if ((job.pids = malloc(STAGES * sizeof(pid_t))) == NULL) {
+        return -1;
+    }
+    for (unsigned s = 0; s < STAGES; s++) {
+        job.pids[s] = pid_of(n, s);
+    }
+    snprintf(job.name, NAME_LEN, "job%u", n);
+    job.status = JOB_BACKGROUND;
+    job.pid = job.pids[0];
+    job.num_pids = STAGES;
+    job.last_pid = job.pids[STAGES - 1];
+    job.exit_status = 0;
+    int id = job_list_add_job(list, &job);
+    if (id == -1) {
+        free(job.pids);
+    }
+    return id;
+}
+
+// Returns the number of wrong results, or -1 on error
+static int run(unsigned num_jobs) {
+    job_list_t list;
+    job_list_init(&list);
+    int *ids = malloc(num_jobs * sizeof(int));
+    if (ids == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    int errors = 0;
+
+    double start = now();
+    for (unsigned n = 0; n < num_jobs; n++) {
+        if ((ids[n] = add_job(&list, n)) == -1) {
+            perror("job_list_add_job");
+            job_list_free(&list);
+            free(ids);
+            return -1;
+        }
+    }
+    double add_ns = (now() - start) * 1e9 / num_jobs;
+
+    // Remove every other job, the way jobs finish out of order
+    start = now();
+    for (unsigned n = 1; n < num_jobs; n += 2) {
+        errors += job_list_remove(&list, ids[n]) != 0;
+    }
+    double remove_ns = (now() - start) * 1e9 / (num_jobs / 2);
+
+    // The survivors keep their IDs and are still found through any process
+    start = now();
+    for (unsigned n = 0; n < num_jobs; n += 2) {
+        for (unsigned s = 0; s < STAGES; s++) {
+            job_t *job = job_list_find_pid(&list, pid_of(n, s));
+            errors += job == NULL || job->id != ids[n];
+        }
+    }
+    double find_pid_ns = (now() - start) * 1e9 / (num_jobs / 2 * STAGES);
+    for (unsigned n = 1; n < num_jobs; n += 2) {
+        errors += job_list_find_pid(&list, pid_of(n, 0)) != NULL;
+    }
+
+    start = now();
+    for (unsigned n = 0; n < num_jobs; n += 2) {
+        job_t *job = job_list_get(&list, ids[n]);
+        errors += job == NULL || job->pid != pid_of(n, 0);
+    }
+    double get_ns = (now() - start) * 1e9 / (num_jobs / 2);
+
+    // Refill the holes: freed IDs are reused instead of growing the table
+    start = now();
+    for (unsigned n = 1; n < num_jobs; n += 2) {
+        if ((ids[n] = add_job(&list, n)) == -1 || ids[n] >= num_jobs) {
+            errors++;
+        }
+    }
+    double readd_ns = (now() - start) * 1e9 / (num_jobs / 2);
+    errors += list.length != num_jobs || list.capacity > 2 * num_jobs;
+
+    job_list_free(&list);
+    printf("{\"benchmark\": \"job_table\", \"jobs\": %u, \"processes_per_job\": %d, "
+           "\"ns_per_add\": %.1f, \"ns_per_remove\": %.1f, \"ns_per_find_pid\": %.1f, "
+           "\"ns_per_get\": %.1f, \"ns_per_readd\": %.1f}\n",
+           num_jobs, STAGES, add_ns, remove_ns, find_pid_ns, get_ns, readd_ns);
+    free(ids);
+    return errors;
+}
+
+int main(void) {
+    static const unsigned sizes[] = {10000, 30000, 100000};
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int errors = run(sizes[i]);
+        if (errors == -1) {
+            return 1;
+        } else if (errors != 0) {
+            fprintf(stderr, "job table returned %d wrong results with %u jobs\n", errors, sizes[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
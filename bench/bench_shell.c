@@ -0,0 +1,185 @@
+/*
+ * Macrobenchmark for running whole scripts through the shell
+ * Generates scripts in a temporary directory and times ./swish running them
+ * with each spawn mode: /bin/true in the foreground, the in-process true and
+ * echo builtins, batches of background jobs collected with wait-all, and
+ * redirection-heavy lines. Reports commands per second as JSON, one object per
+ * script and spawn mode. Exits with status 1 if the shell fails to run a script.
+ *
+ * Usage: bench_shell [path to swish]
+ */
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FG_COMMANDS 2000
+#define BG_BATCHES 20
+#define BG_BATCH_SIZE 50
+#define REDIRECT_ROUNDS 400
+
+static const char *spawn_modes[] = {"spawn", "fork", "server"};
+#define NUM_SPAWN_MODES (sizeof(spawn_modes) / sizeof(spawn_modes[0]))
+
+static const char *redirect_lines[] = {
+    "cat < in.txt > out.txt",
+    "cat out.txt >> log.txt",
+    "cat < in.txt | wc -c > count.txt",
+};
+#define NUM_REDIRECT_LINES (sizeof(redirect_lines) / sizeof(redirect_lines[0]))
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Each write_* function writes a script and returns the number of commands it runs
+static int write_fg_true(FILE *f) {
+    for (int i = 0; i < FG_COMMANDS; i++) {
+        fprintf(f, "/bin/true\n");
+    }
+    return FG_COMMANDS;
+}
+
+static int write_fg_builtin(FILE *f) {
+    for (int i = 0; i < FG_COMMANDS; i++) {
+        if (i % 2 == 0) {
+            fprintf(f, "true\n");
+        } else {
+            fprintf(f, "echo %d > out.txt\n", i);
+        }
+    }
+    return FG_COMMANDS;
+}
+
+static int write_bg_wait_all(FILE *f) {
+    for (int b = 0; b < BG_BATCHES; b++) {
+        for (int i = 0; i < BG_BATCH_SIZE; i++) {
+            fprintf(f, "/bin/true &\n");
+        }
+        fprintf(f, "wait-all\n");
+    }
+    return BG_BATCHES * BG_BATCH_SIZE;
+}
+
+static int write_redirect(FILE *f) {
+    for (int i = 0; i < REDIRECT_ROUNDS; i++) {
+        fprintf(f, "%s\n", redirect_lines[i % NUM_REDIRECT_LINES]);
+    }
+    return REDIRECT_ROUNDS;
+}
+
+static const struct {
+    const char *name;
+    int (*write)(FILE *f);
+} scripts[] = {
+    {"fg_true", write_fg_true},
+    {"fg_builtin", write_fg_builtin},
+    {"bg_wait_all", write_bg_wait_all},
+    {"redirect", write_redirect},
+};
+#define NUM_SCRIPTS (sizeof(scripts) / sizeof(scripts[0]))
+
+// Run 'script' with the shell inside 'dir', returns the shell's exit status or -1
+static int run_shell(const char *shell, const char *dir, const char *script, const char *mode) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    } else if (pid == 0) {
+        int null_fd = open("/dev/null", O_RDWR);
+        if (null_fd == -1 || chdir(dir) == -1 || setenv("SWISH_SPAWN", mode, 1) == -1) {
+            perror("bench_shell");
+            exit(1);
+        }
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+        execl(shell, shell, script, NULL);
+        perror("exec");
+        exit(1);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) == -1) {
+        perror("waitpid");
+        return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int write_file(const char *dir, const char *name, const char *contents) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    fputs(contents, f);
+    return fclose(f);
+}
+
+static void remove_dir(const char *dir) {
+    static const char *files[] = {"fg_true", "fg_builtin", "bg_wait_all", "redirect", "in.txt",
+                                  "out.txt", "log.txt", "count.txt"};
+    char path[PATH_MAX];
+    for (unsigned i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+int main(int argc, char **argv) {
+    char shell[PATH_MAX];
+    if (realpath(argc > 1 ? argv[1] : "./swish", shell) == NULL) {
+        perror(argc > 1 ? argv[1] : "./swish");
+        return 1;
+    }
+    char dir[] = "/tmp/swish_bench.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    int ret = 0;
+    if (write_file(dir, "in.txt", "The quick brown fox jumps over the lazy dog\n") != 0) {
+        ret = 1;
+    }
+
+    for (unsigned s = 0; s < NUM_SCRIPTS && ret == 0; s++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir, scripts[s].name);
+        FILE *f = fopen(path, "w");
+        if (f == NULL) {
+            perror(path);
+            ret = 1;
+            break;
+        }
+        int commands = scripts[s].write(f);
+        fclose(f);
+
+        for (unsigned m = 0; m < NUM_SPAWN_MODES; m++) {
+            double start = now();
+            int status = run_shell(shell, dir, scripts[s].name, spawn_modes[m]);
+            double seconds = now() - start;
+            if (status != 0) {
+                fprintf(stderr, "%s failed running %s with SWISH_SPAWN=%s\n",
+                        shell, scripts[s].name, spawn_modes[m]);
+                ret = 1;
+                break;
+            }
+            printf("{\"benchmark\": \"shell_%s\", \"spawn\": \"%s\", \"commands\": %d, "
+                   "\"seconds\": %.3f, \"commands_per_sec\": %.0f}\n",
+                   scripts[s].name, spawn_modes[m], commands, seconds, commands / seconds);
+            fflush(stdout);
+        }
+    }
+
+    remove_dir(dir);
+    return ret;
+}
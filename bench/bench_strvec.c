@@ -0,0 +1,70 @@
+/*
+ * Microbenchmark for string vector churn in the shell's read/tokenize/clear loop
+ * Runs the same lines through a heap-mode and an arena-mode vector and reports
+ * the time and allocations per line as JSON. Exits with status 1 if the arena
+ * vector still allocates once it has warmed up.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../job_list.h"
+#include "../string_vector.h"
+#include "../swish_funcs.h"
+
+#define WARMUP_ROUNDS 16
+#define ROUNDS 200000
+
+static const char *lines[] = {
+    "ls",
+    "cat test_cases/resources/gatsby.txt | tr a-z A-Z | wc -l > out.txt",
+    "./slow_write 5 0 out.txt &",
+    "echo 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20",
+};
+#define NUM_LINES (sizeof(lines) / sizeof(lines[0]))
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Returns the number of allocations made during the timed rounds
+static unsigned long churn(strvec_t *vec, int use_arena, double *ns_per_line) {
+    char buf[256];
+    for (int r = 0; r < WARMUP_ROUNDS + ROUNDS; r++) {
+        if (r == WARMUP_ROUNDS) {
+            strvec_alloc_count = 0;
+            *ns_per_line = now();
+        }
+        strcpy(buf, lines[r % NUM_LINES]);
+        if (!use_arena && vec->capacity == 0) {
+            strvec_init(vec);
+        }
+        tokenize(buf, vec);
+        strvec_clear(vec);
+    }
+    *ns_per_line = (now() - *ns_per_line) * 1e9 / ROUNDS;
+    return strvec_alloc_count;
+}
+
+int main(void) {
+    strvec_t heap, arena;
+    double heap_ns, arena_ns;
+    strvec_init(&heap);
+    unsigned long heap_allocs = churn(&heap, 0, &heap_ns);
+    strvec_free(&heap);
+    strvec_init_arena(&arena);
+    unsigned long arena_allocs = churn(&arena, 1, &arena_ns);
+    strvec_free(&arena);
+
+    printf("{\"benchmark\": \"strvec_churn\", \"lines\": %d, "
+           "\"heap\": {\"ns_per_line\": %.1f, \"allocs_per_line\": %.2f}, "
+           "\"arena\": {\"ns_per_line\": %.1f, \"allocs_per_line\": %.2f}}\n",
+           ROUNDS, heap_ns, (double) heap_allocs / ROUNDS, arena_ns, (double) arena_allocs / ROUNDS);
+    if (arena_allocs != 0) {
+        fprintf(stderr, "arena-mode vector made %lu allocations after warming up\n", arena_allocs);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * Microbenchmark for tokenize() on short and long command lines
+ * Each line is copied and split into an arena-mode vector, as the shell's loop
+ * does, and the time per line and per token is reported as JSON, one object
+ * per line length.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../job_list.h"
+#include "../string_vector.h"
+#include "../swish_funcs.h"
+
+#define ROUNDS 200000
+#define LONG_TOKENS 256
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run(const char *name, const char *line, int rounds) {
+    static char buf[8192];
+    strvec_t tokens;
+    if (strvec_init_arena(&tokens) != 0) {
+        perror("strvec_init_arena");
+        return -1;
+    }
+    size_t len = strlen(line) + 1;
+    unsigned num_tokens = 0;
+    double start = now();
+    for (int r = 0; r < rounds; r++) {
+        memcpy(buf, line, len);
+        strvec_clear(&tokens);
+        if (tokenize(buf, &tokens) != 0) {
+            perror("tokenize");
+            strvec_free(&tokens);
+            return -1;
+        }
+        num_tokens = tokens.length;
+    }
+    double ns = (now() - start) * 1e9 / rounds;
+    strvec_free(&tokens);
+    printf("{\"benchmark\": \"tokenize_%s\", \"rounds\": %d, \"bytes\": %zu, \"tokens\": %u, "
+           "\"ns_per_line\": %.1f, \"ns_per_token\": %.2f}\n",
+           name, rounds, len - 1, num_tokens, ns, ns / num_tokens);
+    return 0;
+}
+
+int main(void) {
+    char long_line[LONG_TOKENS * 16];
+    size_t len = 0;
+    for (int i = 0; i < LONG_TOKENS; i++) {
+        len += snprintf(long_line + len, sizeof(long_line) - len, "arg%d -x%d ", i, i % 7);
+    }
+    if (run("short", "ls -l", ROUNDS) != 0 ||
+        run("medium", "cat test_cases/resources/gatsby.txt | tr a-z A-Z | wc -l > out.txt", ROUNDS) != 0 ||
+        run("long", long_line, ROUNDS / 20) != 0) {
+        return 1;
+    }
+    return 0;
+}
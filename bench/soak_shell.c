@@ -0,0 +1,662 @@
+/*
+ * Soak test for the shell under a sustained load of jobs
+ * Runs an interactive ./swish on a pseudo-terminal (with job control, as a
+ * user would) and feeds it rounds of mixed jobs: foreground programs,
+ * builtins, pipelines, redirections and commands that fail to exec; short
+ * background jobs collected with wait-all; jobs that stop themselves and are
+ * resumed with bg; and long background jobs that are killed. Each round ends
+ * at a point where the jobs list should be empty and checks, from /proc, that
+ *   - the jobs the shell lists (jobs -l) are exactly its live children, with
+ *     stopped jobs stopped and background jobs running
+ *   - no child is left a zombie
+ *   - the shell's open descriptors and resident memory stay flat once the
+ *     first rounds have warmed up its tables and buffers
+ *   - every sync marker is printed exactly once (a child that failed to exec
+ *     and went on running the shell's loop would print them twice)
+ * Prints one JSON object per spawn mode with the throughput and the samples
+ * taken, then "soak: PASS" or "soak: FAIL". Exits with status 1 on failure.
+ *
+ * Usage: soak_shell [-j jobs] [-m spawn|fork|server] [path to swish]
+ */
+#define _GNU_SOURCE  // posix_openpt(), ptsname()
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define JOBS_DEFAULT 20000
+#define FG_PER_ROUND 40         // Foreground commands
+#define SHORT_BG_PER_ROUND 40   // Background jobs collected with wait-all
+#define STOPPED_PER_ROUND 5     // Jobs that stop themselves, then resumed with bg
+#define LONG_BG_PER_ROUND 15    // Background jobs killed at the end of the round
+#define JOBS_PER_ROUND (FG_PER_ROUND + SHORT_BG_PER_ROUND + STOPPED_PER_ROUND + LONG_BG_PER_ROUND)
+#define WARMUP_ROUNDS 5         // Rounds before the descriptor and memory baselines are taken
+#define RSS_SLACK_KB 1024       // Allowed growth of the shell's RSS after the warmup
+#define SYNC_TIMEOUT 60         // Seconds to wait for the shell to reach a sync marker
+#define MAX_REPORTED 10         // Failures printed per spawn mode
+#define MAX_CHILDREN 256
+#define PROMPT "@> "
+
+static const char *spawn_modes[] = {"spawn", "fork", "server"};
+#define NUM_SPAWN_MODES (sizeof(spawn_modes) / sizeof(spawn_modes[0]))
+
+static const char *fg_lines[] = {
+    "/bin/true",
+    "true",
+    "false",
+    "echo soak > out.txt",
+    "cat < out.txt > /dev/null",
+    "seq 3 | cat > /dev/null",
+    "/nonexistent/soak-cmd",
+};
+#define NUM_FG_LINES (sizeof(fg_lines) / sizeof(fg_lines[0]))
+
+static const char *short_bg_lines[] = {
+    "/bin/true &",
+    "false &",
+    "sleep 0.01 &",
+    "seq 3 | cat > /dev/null &",
+};
+#define NUM_SHORT_BG_LINES (sizeof(short_bg_lines) / sizeof(short_bg_lines[0]))
+
+// Shell under test, attached to the master side of a pseudo-terminal
+typedef struct {
+    int fd;
+    pid_t pid;
+    char *out;          // Output since the last sync marker was sent
+    size_t out_len;
+    size_t out_cap;
+    unsigned sync;      // Number of the last sync marker
+    pid_t helpers[4];   // Children the shell had before running a job (the fork server)
+    int num_helpers;
+} session_t;
+
+typedef struct {
+    pid_t pid;
+    pid_t pgid;
+    char state;
+    char comm[32];
+} proc_t;
+
+typedef struct {
+    unsigned id;
+    pid_t pgid;
+    int stopped;
+} listed_job_t;
+
+static int failures = 0;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fail(const char *mode, unsigned round, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+static void fail(const char *mode, unsigned round, const char *fmt, ...) {
+    if (++failures > MAX_REPORTED) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "FAIL %s round %u: ", mode, round);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+// Start the shell on a new pseudo-terminal in 'dir', without echo and without
+// the line editor, so its output is only what it prints
+static int session_start(session_t *s, const char *shell, const char *dir, const char *mode) {
+    memset(s, 0, sizeof(*s));
+    s->fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (s->fd == -1 || grantpt(s->fd) == -1 || unlockpt(s->fd) == -1) {
+        perror("posix_openpt");
+        return -1;
+    }
+    // Turn off echo before the shell starts, as input may be written before
+    // the shell gets to run
+    struct termios t;
+    if (tcgetattr(s->fd, &t) == -1) {
+        perror("tcgetattr");
+        return -1;
+    }
+    t.c_lflag &= ~ECHO;
+    if (tcsetattr(s->fd, TCSANOW, &t) == -1) {
+        perror("tcsetattr");
+        return -1;
+    }
+    const char *slave_name = ptsname(s->fd);
+    s->pid = fork();
+    if (s->pid == -1) {
+        perror("fork");
+        return -1;
+    } else if (s->pid == 0) {
+        // A new session whose controlling terminal is the slave side
+        int slave = setsid() == -1 ? -1 : open(slave_name, O_RDWR);
+        if (slave == -1) {
+            perror("soak_shell: pty");
+            _exit(1);
+        }
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        close(slave);
+        if (chdir(dir) == -1 || setenv("SWISH_SPAWN", mode, 1) == -1 || setenv("SWISH_NOTIFY", "1", 1) == -1 ||
+            setenv("SWISH_HISTFILE", "", 1) == -1 || setenv("TERM", "dumb", 1) == -1) {
+            perror("soak_shell");
+            _exit(1);
+        }
+        unsetenv("SWISH_CAPTURE");
+        unsetenv("SWISH_TRACE");
+        execl(shell, "swish", NULL);
+        perror("exec");
+        _exit(127);
+    }
+    if (fcntl(s->fd, F_SETFL, O_NONBLOCK) == -1) {
+        perror("fcntl");
+        return -1;
+    }
+    return 0;
+}
+
+static int out_append(session_t *s, const char *data, size_t len) {
+    if (s->out_len + len + 1 > s->out_cap) {
+        size_t new_cap = s->out_cap == 0 ? 65536 : s->out_cap;
+        while (new_cap < s->out_len + len + 1) {
+            new_cap *= 2;
+        }
+        char *new_out = realloc(s->out, new_cap);
+        if (new_out == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        s->out = new_out;
+        s->out_cap = new_cap;
+    }
+    memcpy(s->out + s->out_len, data, len);
+    s->out_len += len;
+    s->out[s->out_len] = '\0';
+    return 0;
+}
+
+// Send 'input' followed by a sync marker, and collect the output until the
+// marker comes back (s->out then holds it)
+// Returns 0 on success, or -1 if the shell exited, hung or printed the
+// marker more than once
+static int session_run(session_t *s, const char *mode, unsigned round, const char *input) {
+    char marker[64];
+    char line[64];
+    s->sync++;
+    snprintf(marker, sizeof(marker), "soak-sync-%u\r\n", s->sync);
+    snprintf(line, sizeof(line), "echo soak-sync-%u\n", s->sync);
+    size_t input_len = strlen(input);
+    size_t line_len = strlen(line);
+    size_t written = 0;
+    s->out_len = 0;
+    if (out_append(s, "", 0) != 0) {
+        return -1;
+    }
+
+    // Only the newly read text (and the end of the text before it, which may
+    // hold the start of the marker) is searched after each read
+    size_t marker_len = strlen(marker);
+    size_t scanned = 0;
+    double deadline = now() + SYNC_TIMEOUT;
+    while (strstr(s->out + scanned, marker) == NULL) {
+        scanned = s->out_len >= marker_len ? s->out_len - marker_len + 1 : 0;
+        // Keep reading while writing, as the shell blocks once the terminal's
+        // output buffer is full
+        struct pollfd pfd = {s->fd, POLLIN | (written < input_len + line_len ? POLLOUT : 0), 0};
+        int timeout_ms = (int) ((deadline - now()) * 1000);
+        if (timeout_ms <= 0 || poll(&pfd, 1, timeout_ms) == 0) {
+            fail(mode, round, "shell did not reach sync marker %u in %d seconds", s->sync, SYNC_TIMEOUT);
+            return -1;
+        }
+        if (pfd.revents & POLLOUT) {
+            const char *data = written < input_len ? input + written : line + (written - input_len);
+            size_t len = written < input_len ? input_len - written : line_len - (written - input_len);
+            ssize_t n = write(s->fd, data, len);
+            if (n > 0) {
+                written += n;
+            }
+        }
+        if (pfd.revents & (POLLIN | POLLHUP)) {
+            char buf[16384];
+            ssize_t n = read(s->fd, buf, sizeof(buf));
+            if (n > 0) {
+                if (out_append(s, buf, n) != 0) {
+                    return -1;
+                }
+            } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                fail(mode, round, "shell exited before sync marker %u", s->sync);
+                return -1;
+            }
+        }
+    }
+    char *first = strstr(s->out, "soak-sync-");
+    if (strstr(first + 1, "soak-sync-") != NULL) {
+        fail(mode, round, "sync marker %u printed more than once", s->sync);
+        return -1;
+    }
+    return 0;
+}
+
+// Read the live and zombie children of 'parent' from /proc
+// Returns the number of children, or -1 on error
+static int list_children(pid_t parent, proc_t *procs, int max) {
+    DIR *dir = opendir("/proc");
+    if (dir == NULL) {
+        perror("/proc");
+        return -1;
+    }
+    int n = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && n < max) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+            continue;
+        }
+        char path[PATH_MAX];
+        char buf[512];
+        snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            continue;  // the process is gone
+        }
+        ssize_t len = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (len <= 0) {
+            continue;
+        }
+        buf[len] = '\0';
+        // "pid (comm) state ppid pgrp ...", where comm may hold spaces and parentheses
+        char *open_paren = strchr(buf, '(');
+        char *close_paren = strrchr(buf, ')');
+        int ppid, pgid;
+        char state;
+        if (open_paren == NULL || close_paren == NULL ||
+            sscanf(close_paren + 1, " %c %d %d", &state, &ppid, &pgid) != 3 || ppid != parent) {
+            continue;
+        }
+        procs[n].pid = atoi(buf);
+        procs[n].pgid = pgid;
+        procs[n].state = state;
+        size_t comm_len = close_paren - open_paren - 1;
+        if (comm_len >= sizeof(procs[n].comm)) {
+            comm_len = sizeof(procs[n].comm) - 1;
+        }
+        memcpy(procs[n].comm, open_paren + 1, comm_len);
+        procs[n].comm[comm_len] = '\0';
+        n++;
+    }
+    closedir(dir);
+    return n;
+}
+
+// Drop the fork server from a list of children, i.e. the children the shell
+// started before it ran any job (it cannot be told by name, as the children it
+// clones are named "swish" until they exec, nor by group, as it leads its own)
+static int drop_helpers(const session_t *s, proc_t *procs, int n) {
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        int helper = 0;
+        for (int h = 0; h < s->num_helpers; h++) {
+            helper |= procs[i].pid == s->helpers[h];
+        }
+        if (!helper) {
+            procs[kept++] = procs[i];
+        }
+    }
+    return kept;
+}
+
+static int count_fds(pid_t pid) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return -1;
+    }
+    int n = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        n += entry->d_name[0] != '.';
+    }
+    closedir(dir);
+    return n;
+}
+
+static long rss_kb(pid_t pid) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "VmRSS: %ld", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+// Parse the output of "jobs -l": "ID: name (status)\tpgid PGID\t..."
+// The first line follows the prompts of the commands before it
+static int parse_jobs(const char *out, listed_job_t *jobs, int max) {
+    int n = 0;
+    for (const char *line = out; line != NULL && *line != '\0' && n < max;) {
+        while (strncmp(line, PROMPT, strlen(PROMPT)) == 0) {
+            line += strlen(PROMPT);
+        }
+        unsigned id;
+        int pgid;
+        char status[16];
+        const char *paren = strstr(line, " (");
+        const char *end = strchr(line, '\n');
+        if (paren != NULL && (end == NULL || paren < end) && sscanf(line, "%u:", &id) == 1 &&
+            sscanf(paren, " (%15[a-z])\tpgid %d", status, &pgid) == 2) {
+            jobs[n].id = id;
+            jobs[n].pgid = pgid;
+            jobs[n].stopped = strcmp(status, "stopped") == 0;
+            n++;
+        }
+        line = end == NULL ? NULL : end + 1;
+    }
+    return n;
+}
+
+// Check the jobs listed in 'out' against the shell's children in /proc
+static void check_job_table(session_t *s, const char *mode, unsigned round) {
+    listed_job_t jobs[MAX_CHILDREN];
+    proc_t procs[MAX_CHILDREN];
+    int num_jobs = parse_jobs(s->out, jobs, MAX_CHILDREN);
+    int num_procs = list_children(s->pid, procs, MAX_CHILDREN);
+    if (num_procs == -1) {
+        return;
+    }
+    num_procs = drop_helpers(s, procs, num_procs);
+    if (num_jobs != STOPPED_PER_ROUND + LONG_BG_PER_ROUND) {
+        fail(mode, round, "jobs lists %d jobs, expected %d", num_jobs, STOPPED_PER_ROUND + LONG_BG_PER_ROUND);
+    }
+    if (num_procs != num_jobs) {
+        fail(mode, round, "jobs lists %d jobs but the shell has %d children", num_jobs, num_procs);
+    }
+    for (int j = 0; j < num_jobs; j++) {
+        int found = 0;
+        for (int p = 0; p < num_procs; p++) {
+            if (procs[p].pid == jobs[j].pgid) {
+                found = 1;
+                char expected = jobs[j].stopped ? 'T' : 'S';
+                if (procs[p].state != expected && !(procs[p].state == 'R' && !jobs[j].stopped)) {
+                    fail(mode, round, "job %u (pid %d) is listed %s but its state is %c", jobs[j].id,
+                         jobs[j].pgid, jobs[j].stopped ? "stopped" : "running", procs[p].state);
+                }
+                if (procs[p].pgid != jobs[j].pgid) {
+                    fail(mode, round, "job %u (pid %d) is in process group %d", jobs[j].id, jobs[j].pgid,
+                         procs[p].pgid);
+                }
+            }
+        }
+        if (!found) {
+            fail(mode, round, "job %u (pgid %d) is listed but is not a child of the shell", jobs[j].id, jobs[j].pgid);
+        }
+    }
+}
+
+// Check that the shell has no children left but the fork server
+static int check_no_children(session_t *s, const char *mode, unsigned round) {
+    proc_t procs[MAX_CHILDREN];
+    int n = 0;
+    // Allow a moment for anything still being reaped
+    for (int tries = 0; tries < 100; tries++) {
+        if ((n = list_children(s->pid, procs, MAX_CHILDREN)) == -1) {
+            return 0;
+        }
+        if ((n = drop_helpers(s, procs, n)) == 0) {
+            return 0;
+        }
+        usleep(10000);
+    }
+    int zombies = 0;
+    for (int i = 0; i < n; i++) {
+        zombies += procs[i].state == 'Z';
+    }
+    fail(mode, round, "%d children left after the jobs were collected (%d zombies, first %d %s %c)", n, zombies,
+         procs[0].pid, procs[0].comm, procs[0].state);
+    return zombies;
+}
+
+// Write the first half of a round: foreground and short background jobs,
+// then jobs that stop and long background jobs, then "jobs -l"
+static void write_round_start(FILE *f, unsigned round) {
+    for (unsigned i = 0; i < FG_PER_ROUND; i++) {
+        fprintf(f, "%s\n", fg_lines[(round + i) % NUM_FG_LINES]);
+    }
+    for (unsigned i = 0; i < SHORT_BG_PER_ROUND; i++) {
+        fprintf(f, "%s\n", short_bg_lines[(round + i) % NUM_SHORT_BG_LINES]);
+    }
+    fprintf(f, "wait-all\n");
+    for (unsigned i = 0; i < STOPPED_PER_ROUND; i++) {
+        fprintf(f, "sh stop.sh\n");
+    }
+    for (unsigned i = 0; i < LONG_BG_PER_ROUND; i++) {
+        fprintf(f, "sleep 1000 &\n");
+    }
+    fprintf(f, "jobs -l\n");
+}
+
+// Write the commands that collect the jobs listed in 'out': bg for stopped
+// ones, kill for running ones, then wait-all
+static void write_round_end(FILE *f, const char *out) {
+    listed_job_t jobs[MAX_CHILDREN];
+    int n = parse_jobs(out, jobs, MAX_CHILDREN);
+    int killed = 0;
+    for (int j = 0; j < n; j++) {
+        if (jobs[j].stopped) {
+            fprintf(f, "bg %u\n", jobs[j].id);
+        }
+    }
+    for (int j = 0; j < n; j++) {
+        if (!jobs[j].stopped) {
+            fprintf(f, "%s%d", killed++ == 0 ? "kill " : " ", jobs[j].pgid);
+        }
+    }
+    fprintf(f, "%swait-all\njobs\n", killed > 0 ? "\n" : "");
+}
+
+static int run_mode(const char *shell, const char *dir, const char *mode, unsigned rounds) {
+    session_t s;
+    if (session_start(&s, shell, dir, mode) != 0) {
+        return -1;
+    }
+    // Wait for the first prompt, then note the helpers the shell started
+    proc_t procs[MAX_CHILDREN];
+    int num_procs;
+    if (session_run(&s, mode, 0, "") != 0 || (num_procs = list_children(s.pid, procs, MAX_CHILDREN)) == -1) {
+        kill(s.pid, SIGKILL);
+        waitpid(s.pid, NULL, 0);
+        close(s.fd);
+        return -1;
+    }
+    s.num_helpers = 0;
+    for (int i = 0; i < num_procs && s.num_helpers < 4; i++) {
+        s.helpers[s.num_helpers++] = procs[i].pid;
+    }
+    int start_failures = failures;
+    int fds_base = -1, fds_min = -1, fds_max = -1;
+    long rss_base = -1, rss_max = -1, rss_end = -1;
+    double start = now();
+    unsigned round;
+    for (round = 0; round < rounds; round++) {
+        char *input;
+        size_t input_len;
+        FILE *f = open_memstream(&input, &input_len);
+        if (f == NULL) {
+            perror("open_memstream");
+            break;
+        }
+        write_round_start(f, round);
+        fclose(f);
+        int ret = session_run(&s, mode, round, input);
+        free(input);
+        if (ret != 0) {
+            break;
+        }
+        check_job_table(&s, mode, round);
+
+        if ((f = open_memstream(&input, &input_len)) == NULL) {
+            perror("open_memstream");
+            break;
+        }
+        write_round_end(f, s.out);
+        fclose(f);
+        ret = session_run(&s, mode, round, input);
+        free(input);
+        if (ret != 0) {
+            break;
+        }
+        listed_job_t left[MAX_CHILDREN];
+        int num_left = parse_jobs(s.out, left, MAX_CHILDREN);
+        if (num_left > 0) {
+            fail(mode, round, "%d jobs still listed after wait-all", num_left);
+        }
+        check_no_children(&s, mode, round);
+
+        int fds = count_fds(s.pid);
+        rss_end = rss_kb(s.pid);
+        if (round + 1 == WARMUP_ROUNDS || (round + 1 < WARMUP_ROUNDS && round + 1 == rounds)) {
+            fds_base = fds_min = fds_max = fds;
+            rss_base = rss_max = rss_end;
+        } else if (round + 1 > WARMUP_ROUNDS) {
+            fds_min = fds < fds_min ? fds : fds_min;
+            fds_max = fds > fds_max ? fds : fds_max;
+            rss_max = rss_end > rss_max ? rss_end : rss_max;
+            if (fds != fds_base) {
+                fail(mode, round, "the shell has %d descriptors open, %d after the warmup", fds, fds_base);
+            }
+            if (rss_end > rss_base + RSS_SLACK_KB) {
+                fail(mode, round, "the shell's RSS grew from %ld KB after the warmup to %ld KB", rss_base, rss_end);
+                rss_base = rss_end;  // report further growth only
+            }
+        }
+    }
+    double seconds = now() - start;
+
+    if (write(s.fd, "exit 0\n", 7) != 7) {
+        perror("write");
+    }
+    int status = -1;
+    for (int tries = 0; tries < 500 && waitpid(s.pid, &status, WNOHANG) == 0; tries++) {
+        char buf[4096];
+        while (read(s.fd, buf, sizeof(buf)) > 0) {
+        }
+        usleep(10000);
+    }
+    if (status == -1) {
+        fail(mode, round, "the shell did not exit");
+        kill(s.pid, SIGKILL);
+        waitpid(s.pid, &status, 0);
+    } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fail(mode, round, "the shell exited with status %d", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    }
+    close(s.fd);
+    free(s.out);
+
+    unsigned jobs = round * JOBS_PER_ROUND;
+    printf("{\"soak\": \"shell\", \"spawn\": \"%s\", \"rounds\": %u, \"jobs\": %u, \"seconds\": %.3f, "
+           "\"jobs_per_sec\": %.0f, \"fds_min\": %d, \"fds_max\": %d, \"rss_kb_base\": %ld, "
+           "\"rss_kb_max\": %ld, \"rss_kb_end\": %ld, \"failures\": %d, \"result\": \"%s\"}\n",
+           mode, round, jobs, seconds, jobs / seconds, fds_min, fds_max, rss_base, rss_max, rss_end,
+           failures - start_failures, failures == start_failures ? "pass" : "fail");
+    fflush(stdout);
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: soak_shell [-j jobs] [-m spawn|fork|server] [path to swish]\n");
+}
+
+int main(int argc, char **argv) {
+    long jobs = JOBS_DEFAULT;
+    const char *only_mode = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:m:")) != -1) {
+        if (opt == 'j') {
+            char *end;
+            jobs = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || jobs < JOBS_PER_ROUND) {
+                fprintf(stderr, "soak_shell: -j takes a number of jobs, at least %d\n", JOBS_PER_ROUND);
+                return 2;
+            }
+        } else if (opt == 'm') {
+            only_mode = optarg;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (argc - optind > 1) {
+        usage();
+        return 2;
+    }
+    const char *path = optind < argc ? argv[optind] : "./swish";
+    char shell[PATH_MAX];
+    if (realpath(path, shell) == NULL) {
+        perror(path);
+        return 1;
+    }
+    char dir[] = "/tmp/swish_soak.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char script[PATH_MAX];
+    snprintf(script, sizeof(script), "%s/stop.sh", dir);
+    FILE *f = fopen(script, "w");
+    if (f == NULL) {
+        perror(script);
+        rmdir(dir);
+        return 1;
+    }
+    fprintf(f, "kill -STOP $$\n");
+    fclose(f);
+
+    int ran = 0;
+    for (unsigned m = 0; m < NUM_SPAWN_MODES; m++) {
+        if (only_mode != NULL && strcmp(only_mode, spawn_modes[m]) != 0) {
+            continue;
+        }
+        ran = 1;
+        if (run_mode(shell, dir, spawn_modes[m], jobs / JOBS_PER_ROUND) != 0) {
+            failures++;
+        }
+    }
+
+    unlink(script);
+    snprintf(script, sizeof(script), "%s/out.txt", dir);
+    unlink(script);
+    rmdir(dir);
+    if (!ran) {
+        fprintf(stderr, "soak_shell: unknown spawn mode '%s'\n", only_mode);
+        return 2;
+    }
+    if (failures > MAX_REPORTED) {
+        fprintf(stderr, "... %d more failures\n", failures - MAX_REPORTED);
+    }
+    printf("soak: %s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
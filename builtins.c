@@ -0,0 +1,893 @@
+#define _GNU_SOURCE  // memfd_create()
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtins.h"
+#include "heredoc.h"
+#include "history.h"
+#include "job_list.h"
+#include "job_opts.h"
+#include "parallel.h"
+#include "reader.h"
+#include "string_vector.h"
+#include "swish_funcs.h"
+#include "trace.h"
+#include "vars.h"
+
+#define CMD_LEN 512
+#define COPY_LEN 65536
+#define SAVED_FD_MIN 10  // Saved descriptors are kept above those commands use
+
+// In-process version of a program, which runs instead in pipelines and in the background
+#define BUILTIN_PROGRAM 0x1
+// The builtin parses its own redirections (they apply to the commands it runs)
+#define BUILTIN_OWN_REDIRECTS 0x2
+
+struct builtin {
+    const char *name;
+    int (*run)(strvec_t *tokens, shell_t *sh);
+    // Optional for BUILTIN_PROGRAM: returns nonzero if the builtin handles
+    // 'argv' (the first 'argc' tokens, before any redirection), 0 if the
+    // program must run instead
+    int (*supported)(int argc, char **argv);
+    int flags;
+};
+
+/*
+ * Shell builtins
+ */
+
+static int builtin_pwd(strvec_t *tokens, shell_t *sh) {
+    // Print the shell's current working directory
+    // Use the getcwd() system call
+    char buf[CMD_LEN];
+    if (getcwd(buf, CMD_LEN) == NULL) {
+        perror("getcwd");
+        return 1;
+    }
+    printf("%s\n", buf);
+    return 0;
+}
+
+static int builtin_cd(strvec_t *tokens, shell_t *sh) {
+    // Change the shell's current working directory
+    // Use the chdir() system call
+    // If the user supplied an argument (token at index 1), change to that directory
+    // Otherwise, change to the home directory by default
+    // This is available in the HOME variable
+    const char *second_token = strvec_get(tokens, 1);
+    if (second_token == NULL) {  // if there is no second command line argument
+        // get home dir
+        const char *temp;
+        if ((temp = vars_get("HOME")) == NULL) {  // get HOME directory, check for error
+            fprintf(stderr, "cd: HOME not set\n");
+            return 1;
+        }
+        if (chdir(temp) != 0) {  // change directory to HOME, check for error
+            perror("chdir");
+            return 1;
+        }
+    }
+    else if (chdir(second_token) != 0) {  // change directory to second argument, check for error
+        perror("chdir");
+        return 1;
+    }
+    return 0;
+}
+
+static int builtin_exit(strvec_t *tokens, shell_t *sh) {
+    const char *second_token = strvec_get(tokens, 1);
+    sh->exiting = 1;
+    if (second_token != NULL) {  // "exit <status>"
+        return atoi(second_token) & 0xff;
+    }
+    return sh->last_status;
+}
+
+// Set and export variables ("export NAME=value" or "export NAME"), or list
+// the exported ones
+static int builtin_export(strvec_t *tokens, shell_t *sh) {
+    if (tokens->length == 1) {
+        vars_print_exported();
+        return 0;
+    }
+    int status = 0;
+    for (unsigned i = 1; i < tokens->length; i++) {
+        const char *arg = strvec_get(tokens, i);
+        if (vars_is_assignment(arg)) {
+            status |= vars_assign(arg, 1) != 0;
+        } else if (vars_name_len(arg) == strlen(arg)) {
+            vars_export(arg);  // nothing to do if it is not set
+        } else {
+            fprintf(stderr, "export: '%s': not a valid identifier\n", arg);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static int builtin_unset(strvec_t *tokens, shell_t *sh) {
+    int status = 0;
+    for (unsigned i = 1; i < tokens->length; i++) {
+        const char *arg = strvec_get(tokens, i);
+        if (vars_name_len(arg) != strlen(arg)) {
+            fprintf(stderr, "unset: '%s': not a valid identifier\n", arg);
+            status = 1;
+        } else {
+            vars_unset(arg);  // unsetting a variable that is not set is not an error
+        }
+    }
+    return status;
+}
+
+// Print out current list of pending jobs
+// "jobs -l" adds each job's process group, run time and the resources
+// used so far by its processes that have exited
+static int builtin_jobs(strvec_t *tokens, shell_t *sh) {
+    const char *option = strvec_get(tokens, 1);
+    int long_format = option != NULL && strcmp(option, "-l") == 0;
+    for (job_t *job = job_list_next(sh->jobs, NULL); job != NULL; job = job_list_next(sh->jobs, job)) {
+        char *status_desc;
+        if (job->status == JOB_BACKGROUND) {
+            status_desc = "background";
+        } else {
+            status_desc = "stopped";
+        }
+        if (!long_format) {
+            printf("%u: %s (%s)\n", job->id, job->name, status_desc);
+            continue;
+        }
+        const struct rusage *usage = &job->usage;
+        printf("%u: %s (%s)\tpgid %d\treal %.3fs\tuser %.3fs\tsys %.3fs\tmaxrss %ldKB"
+               "\tctxsw %ld/%ld\tfaults %ld/%ld\n",
+               job->id, job->name, status_desc, job->pid, job_elapsed(job),
+               usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6,
+               usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6,
+               usage->ru_maxrss, usage->ru_nvcsw, usage->ru_nivcsw,
+               usage->ru_minflt, usage->ru_majflt);
+    }
+    return 0;
+}
+
+// Move stopped job into foreground
+static int builtin_fg(strvec_t *tokens, shell_t *sh) {
+    if (resume_job(tokens, sh->jobs, 1) == -1) {
+        printf("Failed to resume job in foreground\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Move stopped job into background
+static int builtin_bg(strvec_t *tokens, shell_t *sh) {
+    if (resume_job(tokens, sh->jobs, 0) == -1) {
+        printf("Failed to resume job in background\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Wait for a specific job identified by its job ID
+static int builtin_wait_for(strvec_t *tokens, shell_t *sh) {
+    int status;
+    if ((status = await_background_job(tokens, sh->jobs)) == -1) {
+        printf("Failed to wait for background job\n");
+        return 1;
+    }
+    return status;
+}
+
+// Wait for whichever background job finishes first
+static int builtin_wait_any(strvec_t *tokens, shell_t *sh) {
+    int status;
+    if ((status = await_any_background_job(tokens, sh->jobs)) == -1) {
+        printf("Failed to wait for any background job\n");
+        return 1;
+    }
+    return status;
+}
+
+// Wait for all background jobs
+static int builtin_wait_all(strvec_t *tokens, shell_t *sh) {
+    int status;
+    if ((status = await_all_background_jobs(tokens, sh->jobs)) == -1) {
+        printf("Failed to wait for all background jobs\n");
+        return 1;
+    }
+    return status;
+}
+
+// Run a command once per input line, several at a time
+static int builtin_parallel(strvec_t *tokens, shell_t *sh) {
+    if (!sh->interactive) {  // items may come from the shell's own input
+        reader_sync(sh->input);
+    }
+    int status;
+    if ((status = parallel_command(tokens, sh->jobs)) == -1) {
+        return 1;
+    }
+    return status;
+}
+
+// List the command history ("history [-l] [N]" shows the last N lines, -l
+// adds when each ran, its exit status and its directory), or search it for
+// lines containing TEXT, newest first ("history -s TEXT")
+static int builtin_history(strvec_t *tokens, shell_t *sh) {
+    const char *option = strvec_get(tokens, 1);
+    history_entry_t entry;
+    if (option != NULL && strcmp(option, "-s") == 0) {
+        const char *text = strvec_get(tokens, 2);
+        if (text == NULL) {
+            fprintf(stderr, "history: -s needs the text to search for\n");
+            return 2;
+        }
+        int found = 0;
+        for (long i = history_search(text, history_length()); i != -1; i = history_search(text, i)) {
+            if (history_get(i, &entry) == 0) {
+                printf("%5ld  %.*s\n", i + 1, (int) entry.line_len, entry.line);
+                found = 1;
+            }
+        }
+        return found ? 0 : 1;
+    }
+    int long_format = option != NULL && strcmp(option, "-l") == 0;
+    const char *count = strvec_get(tokens, long_format ? 2 : 1);
+    long length = history_length();
+    long first = 0;
+    if (count != NULL) {
+        char *end;
+        long n = strtol(count, &end, 10);
+        if (*end != '\0' || n < 0) {
+            fprintf(stderr, "history: %s: numeric argument required\n", count);
+            return 2;
+        }
+        first = n < length ? length - n : 0;
+    }
+    for (long i = first; i < length; i++) {
+        if (history_get(i, &entry) != 0) {
+            continue;
+        }
+        if (!long_format) {
+            printf("%5ld  %.*s\n", i + 1, (int) entry.line_len, entry.line);
+            continue;
+        }
+        char when[32];
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&entry.time));
+        printf("%5ld  %s  %3d  %.*s\t%.*s\n", i + 1, when, entry.status,
+               (int) entry.cwd_len, entry.cwd, (int) entry.line_len, entry.line);
+    }
+    return 0;
+}
+
+// Set the CPU affinity, priorities and limits of later jobs ("job-opts
+// OPTIONS"), forget them ("job-opts -x") or print them ("job-opts"); see job_opts.h
+static int builtin_job_opts(strvec_t *tokens, shell_t *sh) {
+    const char *option = strvec_get(tokens, 1);
+    if (option == NULL) {
+        job_opts_print_defaults();
+        return 0;
+    }
+    if (strcmp(option, "-x") == 0 && tokens->length == 2) {
+        job_opts_clear_defaults();
+        return 0;
+    }
+    job_opts_t opts;
+    int next = job_opts_parse(tokens, 1, &opts);
+    if (next == -1) {
+        return 2;
+    } else if (next != tokens->length) {
+        fprintf(stderr, "job-opts: %s: unknown option\n", strvec_get(tokens, next));
+        return 2;
+    }
+    job_opts_set_defaults(&opts);
+    return 0;
+}
+
+// Show the output captured from background jobs
+static int builtin_output(strvec_t *tokens, shell_t *sh) {
+    int status;
+    if ((status = output_command(tokens, sh->jobs)) == -1) {
+        return 1;
+    }
+    return status;
+}
+
+// Inspect or modify the PATH cache
+static int builtin_hash(strvec_t *tokens, shell_t *sh) {
+    return hash_command(tokens) == 0 ? 0 : 1;
+}
+
+/*
+ * In-process versions of programs
+ */
+
+static int builtin_true(strvec_t *tokens, shell_t *sh) {
+    return 0;
+}
+
+static int builtin_false(strvec_t *tokens, shell_t *sh) {
+    return 1;
+}
+
+// Letters of an echo(1) option such as "-n" or "-neE": 'n' if the option is
+// only -n, 'x' if it uses -e or -E, or 0 if 'arg' is an operand
+static char echo_option(const char *arg) {
+    if (arg[0] != '-' || arg[1] == '\0') {
+        return 0;
+    }
+    char kind = 'n';
+    for (const char *c = arg + 1; *c != '\0'; c++) {
+        if (*c == 'e' || *c == 'E') {
+            kind = 'x';
+        } else if (*c != 'n') {
+            return 0;
+        }
+    }
+    return kind;
+}
+
+// Backslash escapes (-e) are left to the program
+static int echo_supported(int argc, char **argv) {
+    char kind;
+    for (int i = 1; i < argc && (kind = echo_option(argv[i])) != 0; i++) {
+        if (kind == 'x') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int builtin_echo(strvec_t *tokens, shell_t *sh) {
+    char **argv = strvec_argv(tokens);
+    int newline = 1;
+    int i = 1;
+    for (; argv[i] != NULL && echo_option(argv[i]) == 'n'; i++) {
+        newline = 0;
+    }
+    for (int first = i; argv[i] != NULL; i++) {
+        if (i > first) {
+            putchar(' ');
+        }
+        fputs(argv[i], stdout);
+    }
+    if (newline) {
+        putchar('\n');
+    }
+    return 0;
+}
+
+// Character for the escape sequence "\c" in a printf(1) format, or -1 if the
+// sequence is left to the program (e.g., octal escapes)
+static int printf_escape(char c) {
+    switch (c) {
+        case '\\': return '\\';
+        case '"': return '"';
+        case 'a': return '\a';
+        case 'b': return '\b';
+        case 'f': return '\f';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 't': return '\t';
+        case 'v': return '\v';
+        default: return -1;
+    }
+}
+
+// Write argv[1] formatted with the remaining arguments to 'out', reusing the
+// format while arguments remain as printf(1) does. Nothing is written if 'out'
+// is NULL, which checks whether the format can be handled.
+// Supports %s, %d, %i, %u, %o, %x and %X with flags, width and precision.
+// Returns 0, or -1 if the format or an argument must be left to the program
+static int format_printf(int argc, char **argv, FILE *out) {
+    if (argc < 2) {
+        return -1;
+    }
+    const char *format = argv[1];
+    int arg = 2;
+    do {
+        int conversions = 0;
+        for (const char *c = format; *c != '\0'; c++) {
+            if (*c == '\\') {
+                int escaped = printf_escape(*++c);
+                if (escaped == -1) {
+                    return -1;
+                }
+                if (out != NULL) {
+                    putc(escaped, out);
+                }
+                continue;
+            } else if (*c != '%') {
+                if (out != NULL) {
+                    putc(*c, out);
+                }
+                continue;
+            } else if (c[1] == '%') {
+                if (out != NULL) {
+                    putc('%', out);
+                }
+                c++;
+                continue;
+            }
+
+            // Copy the conversion specification, leaving room for "ll"
+            char spec[32];
+            size_t len = 0;
+            spec[len++] = *c++;
+            while (*c != '\0' && strchr("-+ #0", *c) != NULL && len < 8) {
+                spec[len++] = *c++;
+            }
+            while (isdigit((unsigned char) *c) && len < 16) {
+                spec[len++] = *c++;
+            }
+            if (*c == '.') {
+                spec[len++] = *c++;
+                while (isdigit((unsigned char) *c) && len < 24) {
+                    spec[len++] = *c++;
+                }
+            }
+            if (*c == '\0' || strchr("sdiuoxX", *c) == NULL || len >= 24) {
+                return -1;
+            }
+            conversions++;
+            const char *value = arg < argc ? argv[arg++] : NULL;
+            if (*c == 's') {
+                spec[len++] = 's';
+                spec[len] = '\0';
+                if (out != NULL) {
+                    fprintf(out, spec, value != NULL ? value : "");
+                }
+                continue;
+            }
+            long long number = 0;
+            if (value != NULL) {
+                char *end;
+                errno = 0;
+                number = strtoll(value, &end, 0);
+                if (*value == '\0' || *end != '\0' || errno != 0) {
+                    return -1;  // the program reports invalid numbers
+                }
+            }
+            spec[len++] = 'l';
+            spec[len++] = 'l';
+            spec[len++] = *c;
+            spec[len] = '\0';
+            if (out != NULL && (*c == 'd' || *c == 'i')) {
+                fprintf(out, spec, number);
+            } else if (out != NULL) {
+                fprintf(out, spec, (unsigned long long) number);
+            }
+        }
+        if (conversions == 0 && arg < argc) {  // the program warns about unused arguments
+            return -1;
+        }
+    } while (arg < argc);
+    return 0;
+}
+
+static int printf_supported(int argc, char **argv) {
+    return format_printf(argc, argv, NULL) == 0;
+}
+
+static int builtin_printf(strvec_t *tokens, shell_t *sh) {
+    format_printf(tokens->length, strvec_argv(tokens), stdout);
+    return 0;
+}
+
+// Parse an integer operand of test(1), returns 0 or -1 if it is not one
+static int test_integer(const char *s, long long *value) {
+    char *end;
+    errno = 0;
+    *value = strtoll(s, &end, 10);
+    return *s == '\0' || *end != '\0' || errno != 0 ? -1 : 0;
+}
+
+static int test_unary(const char *op, const char *operand) {
+    struct stat st;
+    if (strcmp(op, "-n") == 0) {
+        return operand[0] != '\0';
+    } else if (strcmp(op, "-z") == 0) {
+        return operand[0] == '\0';
+    } else if (strcmp(op, "-r") == 0) {
+        return access(operand, R_OK) == 0;
+    } else if (strcmp(op, "-w") == 0) {
+        return access(operand, W_OK) == 0;
+    } else if (strcmp(op, "-x") == 0) {
+        return access(operand, X_OK) == 0;
+    } else if (strcmp(op, "-L") == 0 || strcmp(op, "-h") == 0) {
+        return lstat(operand, &st) == 0 && S_ISLNK(st.st_mode);
+    } else if (strcmp(op, "-e") != 0 && strcmp(op, "-f") != 0 && strcmp(op, "-d") != 0 &&
+               strcmp(op, "-s") != 0 && strcmp(op, "-p") != 0) {
+        return -1;
+    }
+    if (stat(operand, &st) != 0) {
+        return 0;
+    }
+    switch (op[1]) {
+        case 'f': return S_ISREG(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 's': return st.st_size > 0;
+        case 'p': return S_ISFIFO(st.st_mode);
+        default: return 1;
+    }
+}
+
+static int test_binary(const char *left, const char *op, const char *right) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) {
+        return strcmp(left, right) == 0;
+    } else if (strcmp(op, "!=") == 0) {
+        return strcmp(left, right) != 0;
+    }
+    static const char *int_ops[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+    unsigned i = 0;
+    while (i < sizeof(int_ops) / sizeof(int_ops[0]) && strcmp(op, int_ops[i]) != 0) {
+        i++;
+    }
+    long long a, b;
+    if (i == sizeof(int_ops) / sizeof(int_ops[0]) ||
+        test_integer(left, &a) != 0 || test_integer(right, &b) != 0) {
+        return -1;
+    }
+    switch (i) {
+        case 0: return a == b;
+        case 1: return a != b;
+        case 2: return a < b;
+        case 3: return a <= b;
+        case 4: return a > b;
+        default: return a >= b;
+    }
+}
+
+static int is_test_binary(const char *op) {
+    return strcmp(op, "=") == 0 || strcmp(op, "==") == 0 || strcmp(op, "!=") == 0 ||
+           (op[0] == '-' && strlen(op) == 3 && op[1] != '-');
+}
+
+// Evaluate the test(1) expression made of 'argc' operands, following the
+// POSIX rules for up to four of them
+// Returns 1 if it is true, 0 if it is false, or -1 if it must be left to the
+// program (-a, -o, parentheses, invalid integers, ...)
+static int eval_test(int argc, char **argv) {
+    int result;
+    switch (argc) {
+        case 0:
+            return 0;
+        case 1:
+            return argv[0][0] != '\0';
+        case 2:
+            if (strcmp(argv[0], "!") == 0) {
+                return argv[1][0] == '\0';
+            }
+            return test_unary(argv[0], argv[1]);
+        case 3:
+            if (is_test_binary(argv[1])) {
+                return test_binary(argv[0], argv[1], argv[2]);
+            }
+            // fall through
+        case 4:
+            if (strcmp(argv[0], "!") == 0 && (result = eval_test(argc - 1, argv + 1)) != -1) {
+                return !result;
+            }
+            return -1;
+        default:
+            return -1;
+    }
+}
+
+static int test_supported(int argc, char **argv) {
+    return eval_test(argc - 1, argv + 1) != -1;
+}
+
+static int builtin_test(strvec_t *tokens, shell_t *sh) {
+    return !eval_test(tokens->length - 1, strvec_argv(tokens) + 1);
+}
+
+// "[ expression ]"
+static int bracket_supported(int argc, char **argv) {
+    return argc >= 2 && strcmp(argv[argc - 1], "]") == 0 && eval_test(argc - 2, argv + 1) != -1;
+}
+
+static int builtin_bracket(strvec_t *tokens, shell_t *sh) {
+    return !eval_test(tokens->length - 2, strvec_argv(tokens) + 1);
+}
+
+// Reading standard input is only done in-process when it was redirected:
+// otherwise it is the terminal or the shell's own input
+static int cat_supported(int argc, char **argv) {
+    int input_redirected = 0;
+    for (int i = argc; argv[i] != NULL; i++) {
+        input_redirected |= strcmp(argv[i], "<") == 0 || strcmp(argv[i], "<&") == 0;
+    }
+    if (argc == 1) {
+        return input_redirected;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && (argv[i][1] != '\0' || !input_redirected)) {
+            return 0;  // options are left to the program
+        }
+    }
+    return 1;
+}
+
+// Copy 'fd' to standard output, reporting errors as cat(1) does
+// Returns 0 on success or -1 on error
+static int cat_fd(int fd, const char *name) {
+    static char buf[COPY_LEN];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            return -1;
+        }
+        for (ssize_t written = 0; written < n; ) {
+            ssize_t w = write(STDOUT_FILENO, buf + written, n - written);
+            if (w == -1 && errno != EINTR) {
+                fprintf(stderr, "cat: write error: %s\n", strerror(errno));
+                return -1;
+            }
+            written += w == -1 ? 0 : w;
+        }
+    }
+    return 0;
+}
+
+static int builtin_cat(strvec_t *tokens, shell_t *sh) {
+    fflush(stdout);  // keep earlier builtin output ahead of the file
+    if (tokens->length == 1) {
+        return cat_fd(STDIN_FILENO, "-") == 0 ? 0 : 1;
+    }
+    int status = 0;
+    for (unsigned i = 1; i < tokens->length; i++) {
+        const char *name = strvec_get(tokens, i);
+        int fd = strcmp(name, "-") == 0 ? STDIN_FILENO : open(name, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            status = 1;
+            continue;
+        }
+        if (cat_fd(fd, name) != 0) {
+            status = 1;
+        }
+        if (fd != STDIN_FILENO) {
+            close(fd);
+        }
+    }
+    return status;
+}
+
+// Sorted by name (in strcmp() order) for bsearch()
+static const builtin_t builtins[] = {
+    {"[", builtin_bracket, bracket_supported, BUILTIN_PROGRAM},
+    {"bg", builtin_bg, NULL, 0},
+    {"cat", builtin_cat, cat_supported, BUILTIN_PROGRAM},
+    {"cd", builtin_cd, NULL, 0},
+    {"echo", builtin_echo, echo_supported, BUILTIN_PROGRAM},
+    {"exit", builtin_exit, NULL, 0},
+    {"export", builtin_export, NULL, 0},
+    {"false", builtin_false, NULL, BUILTIN_PROGRAM},
+    {"fg", builtin_fg, NULL, 0},
+    {"hash", builtin_hash, NULL, 0},
+    {"history", builtin_history, NULL, 0},
+    {"job-opts", builtin_job_opts, NULL, 0},
+    {"jobs", builtin_jobs, NULL, 0},
+    {"output", builtin_output, NULL, 0},
+    {"parallel", builtin_parallel, NULL, BUILTIN_OWN_REDIRECTS},
+    {"printf", builtin_printf, printf_supported, BUILTIN_PROGRAM},
+    {"pwd", builtin_pwd, NULL, 0},
+    {"test", builtin_test, test_supported, BUILTIN_PROGRAM},
+    {"true", builtin_true, NULL, BUILTIN_PROGRAM},
+    {"unset", builtin_unset, NULL, 0},
+    {"wait-all", builtin_wait_all, NULL, 0},
+    {"wait-any", builtin_wait_any, NULL, 0},
+    {"wait-for", builtin_wait_for, NULL, 0},
+};
+#define NUM_BUILTINS (sizeof(builtins) / sizeof(builtins[0]))
+
+const char *builtin_name(unsigned i) {
+    return i < NUM_BUILTINS ? builtins[i].name : NULL;
+}
+
+static int compare_builtin(const void *name, const void *builtin) {
+    return strcmp(name, ((const builtin_t *) builtin)->name);
+}
+
+// Index of the first redirection operator in 'tokens', or its length if there is none
+static unsigned first_redirect(strvec_t *tokens) {
+    unsigned i = 0;
+    for (const char *token; (token = strvec_get(tokens, i)) != NULL; i++) {
+        if (strcmp(token, "<") == 0 || strcmp(token, "<&") == 0 ||
+            strcmp(token, ">") == 0 || strcmp(token, ">>") == 0) {
+            break;
+        }
+    }
+    return i;
+}
+
+// Replace 'fd' with 'new_fd' (which is closed), saving the original in 'saved'
+// (-1 if 'fd' was not open). On error 'fd' is left as it was.
+static int replace_fd(int fd, int new_fd, int *saved) {
+    if ((*saved = fcntl(fd, F_DUPFD_CLOEXEC, SAVED_FD_MIN)) == -1 && errno != EBADF) {
+        perror("fcntl");
+        close(new_fd);
+        return -1;
+    }
+    if (dup2(new_fd, fd) == -1) {
+        perror("dup2");
+        close(new_fd);
+        if (*saved != -1) {
+            close(*saved);
+        }
+        return -1;
+    }
+    close(new_fd);
+    return 0;
+}
+
+// Put the descriptors saved by replace_fd() back
+static void restore_fd(int fd, int saved) {
+    if (saved == -1) {  // 'fd' was closed before the builtin ran
+        close(fd);
+    } else {
+        if (dup2(saved, fd) == -1) {
+            perror("dup2");
+        }
+        close(saved);
+    }
+}
+
+const builtin_t *builtin_find(const char *name) {
+    return bsearch(name, builtins, NUM_BUILTINS, sizeof(builtin_t), compare_builtin);
+}
+
+int run_builtin(strvec_t *tokens, shell_t *sh) {
+    return builtin_run(builtin_find(strvec_get(tokens, 0)), tokens, sh);
+}
+
+// Replace 'tokens' (a builtin's stage of a pipeline, with its redirections
+// removed) with the rest of the pipeline 'rest', whose first stage reads from
+// 'fd' unless it redirects its input itself
+static int rewrite_pipeline(strvec_t *tokens, strvec_t *rest, int fd) {
+    char fd_str[16];
+    snprintf(fd_str, sizeof(fd_str), "%d", fd);
+    // The redirection goes with those of the first stage: before its first
+    // one, or else before the next "|" or the final "&"
+    unsigned end = rest->length;
+    int pipe_index = strvec_find(rest, "|");
+    if (pipe_index != -1) {
+        end = pipe_index;
+    } else if (end > 0 && strcmp(strvec_get(rest, end - 1), "&") == 0) {
+        end--;
+    }
+    unsigned insert = end;
+    for (unsigned i = end; i-- > 0;) {
+        const char *token = strvec_get(rest, i);
+        if (strcmp(token, "<") == 0 || strcmp(token, DUP_INPUT_OPERATOR) == 0) {
+            insert = rest->length + 1;  // the stage's own input is used instead
+            break;
+        } else if (strcmp(token, ">") == 0 || strcmp(token, ">>") == 0) {
+            insert = i;
+        }
+    }
+    strvec_clear(tokens);
+    for (unsigned i = 0; i <= rest->length; i++) {
+        if (i == insert && (strvec_add(tokens, DUP_INPUT_OPERATOR) != 0 || strvec_add(tokens, fd_str) != 0)) {
+            perror("strvec_add");
+            return -1;
+        }
+        if (i < rest->length && strvec_add(tokens, strvec_get(rest, i)) != 0) {
+            perror("strvec_add");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int builtin_run(const builtin_t *builtin, strvec_t *tokens, shell_t *sh) {
+    if (builtin == NULL) {
+        return BUILTIN_EXTERNAL;
+    }
+    // Programs run as jobs in pipes and in the background
+    int pipe_index = strvec_find(tokens, "|");
+    int background = strcmp(strvec_get(tokens, tokens->length - 1), "&") == 0;
+    if ((builtin->flags & BUILTIN_PROGRAM) && (pipe_index != -1 || background)) {
+        return BUILTIN_EXTERNAL;
+    }
+    if (builtin->supported != NULL && !builtin->supported(first_redirect(tokens), strvec_argv(tokens))) {
+        return BUILTIN_EXTERNAL;
+    }
+    // A shell builtin changes the shell itself, so it cannot run as a job of
+    // its own; at the start of a pipeline it runs first, writing into a memfd
+    // the rest of the pipeline then reads from
+    if (pipe_index == -1 && background) {
+        fprintf(stderr, "%s: builtins cannot run in the background\n", builtin->name);
+        return 1;
+    }
+    strvec_t rest;
+    int pipe_fd = -1;
+    if (pipe_index != -1) {
+        if (strvec_init(&rest) != 0) {
+            perror("strvec_init");
+            return 1;
+        }
+        for (unsigned i = pipe_index + 1; i < tokens->length; i++) {
+            if (strvec_add(&rest, strvec_get(tokens, i)) != 0) {
+                perror("strvec_add");
+                strvec_free(&rest);
+                return 1;
+            }
+        }
+        strvec_take(tokens, pipe_index);
+        if ((pipe_fd = memfd_create("builtin", MFD_CLOEXEC)) == -1) {
+            perror("memfd_create");
+            strvec_free(&rest);
+            return 1;
+        }
+    }
+
+    uint64_t trace_start = TRACE_CLOCK();
+    int in_fd = -1, out_fd = -1;
+    int saved_in = -1, saved_out = -1;
+    int status = -1;
+    if (!(builtin->flags & BUILTIN_OWN_REDIRECTS) && open_redirects(tokens, &in_fd, &out_fd, O_CLOEXEC) != 0) {
+        goto done;
+    }
+    // An output redirection takes precedence over the pipe, as in sh
+    if (out_fd == -1 && pipe_fd != -1 && (out_fd = fcntl(pipe_fd, F_DUPFD_CLOEXEC, 0)) == -1) {
+        perror("fcntl");
+        close_redirects(in_fd, -1);
+        goto done;
+    }
+    fflush(stdout);
+    if (in_fd != -1 && replace_fd(STDIN_FILENO, in_fd, &saved_in) != 0) {
+        close_redirects(-1, out_fd);
+        goto done;
+    }
+    if (out_fd != -1 && replace_fd(STDOUT_FILENO, out_fd, &saved_out) != 0) {
+        if (in_fd != -1) {
+            restore_fd(STDIN_FILENO, saved_in);
+        }
+        goto done;
+    }
+
+    status = builtin->run(tokens, sh);
+
+    if (out_fd != -1) {
+        fflush(stdout);
+        restore_fd(STDOUT_FILENO, saved_out);
+    }
+    if (in_fd != -1) {
+        restore_fd(STDIN_FILENO, saved_in);
+    }
+    TRACE_COMPLETE("builtin", trace_start, 0, builtin->name);
+
+done:
+    if (pipe_fd == -1) {
+        return status == -1 ? 1 : status;
+    }
+    // The rest of the pipeline then runs as a job, whose status is that of
+    // the pipeline; the memfd is closed with the command line's
+    // here-documents (see heredoc.h), once the job has started
+    if (status != -1 && lseek(pipe_fd, 0, SEEK_SET) == -1) {
+        perror("lseek");
+        status = -1;
+    }
+    if (status == -1 || heredoc_keep(pipe_fd) != 0) {
+        close(pipe_fd);
+        strvec_free(&rest);
+        return 1;
+    }
+    int ret = rewrite_pipeline(tokens, &rest, pipe_fd);
+    strvec_free(&rest);
+    return ret == 0 ? BUILTIN_EXTERNAL : 1;
+}
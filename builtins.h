@@ -0,0 +1,70 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "job_list.h"
+#include "reader.h"
+#include "string_vector.h"
+
+/*
+ * Shell state that builtins read and modify
+ */
+typedef struct {
+    job_list_t *jobs;
+    reader_t *input;
+    int interactive;    // Nonzero when commands come from a terminal
+    int last_status;    // Exit status of the last command
+    int exiting;        // Set by "exit": the shell stops reading commands
+} shell_t;
+
+/*
+ * Returned by run_builtin() when the command line must run as a job instead
+ */
+#define BUILTIN_EXTERNAL -1
+
+/*
+ * Entry of the builtins table (opaque)
+ */
+typedef struct builtin builtin_t;
+
+/*
+ * Run a command line in the shell process if its first token names a builtin
+ * Builtins are looked up in a table sorted by name. Besides the shell's own
+ * builtins (cd, jobs, fg, wait-all, ...) the table holds in-process versions
+ * of cheap commands (echo, printf, test/[, true, false, cat) so they run
+ * without a fork() and exec(). Those are only a fast path: a line that uses
+ * them in a pipeline or in the background, or with an option or operand the
+ * in-process version does not handle, runs the program from PATH instead.
+ * Redirections ('<', '>', '>>') apply to the builtin: the shell's descriptors
+ * are saved, replaced while the builtin runs and then restored. A shell builtin
+ * that starts a pipeline runs the same way with its output in a memfd, and
+ * the tokens are then replaced with the rest of the pipeline, reading the
+ * memfd, to run as a job; a shell builtin followed by '&' is an error.
+ * tokens: Tokens of the command line (redirections are removed)
+ * sh: The shell's state
+ * Returns the builtin's exit status, or BUILTIN_EXTERNAL if the line is not
+ * run by a builtin
+ */
+int run_builtin(strvec_t *tokens, shell_t *sh);
+
+/*
+ * Look up a builtin by name, so a command that runs many times (e.g., in a
+ * loop) is only looked up once
+ * Returns the builtin, or NULL if no builtin has that name
+ */
+const builtin_t *builtin_find(const char *name);
+
+/*
+ * Run a command line with a builtin found by builtin_find(), as run_builtin() does
+ * builtin: The builtin named by the first token, or NULL for none
+ * Returns the builtin's exit status, or BUILTIN_EXTERNAL if the line is not
+ * run by a builtin
+ */
+int builtin_run(const builtin_t *builtin, strvec_t *tokens, shell_t *sh);
+
+/*
+ * Name of builtin 'i', in sorted order (e.g., for completion)
+ * Returns NULL once 'i' is past the last builtin
+ */
+const char *builtin_name(unsigned i);
+
+#endif // BUILTINS_H
@@ -0,0 +1,302 @@
+#define _GNU_SOURCE  // F_SETPIPE_SZ, pipe2()
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "job_list.h"
+#include "vars.h"
+
+#define CAPTURE_MAX (64UL << 20)
+#define INITIAL_SLOTS 16
+
+typedef struct {
+    int fd;             // Read end of the job's pipe, -1 after end of file
+    char *ring;         // The last 'size' bytes the job wrote
+    size_t size;
+    uint64_t written;   // Bytes the job wrote in all; the ring holds those from
+                        // max(written - size, 0) on, at their offset modulo 'size'
+    uint64_t shown;     // Bytes printed while following
+    char name[NAME_LEN];
+} capture_t;
+
+static capture_t **captures = NULL;  // Indexed by job ID
+static unsigned num_slots = 0;
+static unsigned num_open = 0;
+static int epoll_fd = -1;  // Watches the open pipes; the job ID is the event data
+static int following = 0;
+
+size_t capture_size(void) {
+    const char *value = vars_get("SWISH_CAPTURE");
+    if (value == NULL || *value == '\0') {
+        return 0;
+    }
+    char *end;
+    unsigned long size = strtoul(value, &end, 10);
+    int shift = 0;
+    if (*end == 'K' || *end == 'M') {
+        shift = *end == 'K' ? 10 : 20;
+        end++;
+    }
+    if (end == value || *end != '\0' || *value == '-' || size > CAPTURE_MAX >> shift) {
+        fprintf(stderr, "Invalid SWISH_CAPTURE '%s' (at most %luM)\n", value, CAPTURE_MAX >> 20);
+        return 0;
+    }
+    size <<= shift;
+    return size;
+}
+
+int capture_pipe(size_t size, int fds[2]) {
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return -1;
+    }
+    if (fcntl(fds[0], F_SETFL, O_NONBLOCK) == -1) {
+        perror("fcntl");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    // Best effort: the kernel caps pipes at /proc/sys/fs/pipe-max-size
+    fcntl(fds[1], F_SETPIPE_SZ, size);
+    return 0;
+}
+
+static void close_capture(capture_t *c) {
+    if (c->fd != -1) {
+        close(c->fd);  // also takes it out of the epoll set
+        c->fd = -1;
+        num_open--;
+    }
+}
+
+static void remove_capture(unsigned id) {
+    if (id < num_slots && captures[id] != NULL) {
+        close_capture(captures[id]);
+        free(captures[id]->ring);
+        free(captures[id]);
+        captures[id] = NULL;
+    }
+}
+
+int capture_add(unsigned id, const char *name, int fd, size_t size) {
+    if (epoll_fd == -1 && (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        perror("epoll_create1");
+        close(fd);
+        return -1;
+    }
+    if (id >= num_slots) {
+        unsigned new_slots = num_slots == 0 ? INITIAL_SLOTS : num_slots;
+        while (id >= new_slots) {
+            new_slots *= 2;
+        }
+        capture_t **new_captures = realloc(captures, new_slots * sizeof(capture_t *));
+        if (new_captures == NULL) {
+            perror("realloc");
+            close(fd);
+            return -1;
+        }
+        memset(new_captures + num_slots, 0, (new_slots - num_slots) * sizeof(capture_t *));
+        captures = new_captures;
+        num_slots = new_slots;
+    }
+    remove_capture(id);  // the job that had the ID before
+    capture_t *c = calloc(1, sizeof(capture_t));
+    if (c == NULL || (c->ring = malloc(size)) == NULL) {
+        perror("malloc");
+        free(c);
+        close(fd);
+        return -1;
+    }
+    struct epoll_event event = { .events = EPOLLIN, .data.u32 = id };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        perror("epoll_ctl");
+        free(c->ring);
+        free(c);
+        close(fd);
+        return -1;
+    }
+    c->fd = fd;
+    c->size = size;
+    strncpy(c->name, name, NAME_LEN - 1);
+    captures[id] = c;
+    num_open++;
+    return 0;
+}
+
+int capture_fd(void) {
+    return num_open == 0 ? -1 : epoll_fd;
+}
+
+// Write the captured bytes from offset 'from' to 'to' to stdout
+static void put_range(const capture_t *c, uint64_t from, uint64_t to) {
+    while (from < to) {
+        size_t off = from % c->size;
+        size_t len = c->size - off;
+        if (len > to - from) {
+            len = to - from;
+        }
+        fwrite(c->ring + off, 1, len, stdout);
+        from += len;
+    }
+}
+
+// Find the first '\n' at or after 'from', or return 'written' if there is none
+static uint64_t find_newline(const capture_t *c, uint64_t from) {
+    while (from < c->written) {
+        size_t off = from % c->size;
+        size_t len = c->size - off;
+        if (len > c->written - from) {
+            len = c->written - from;
+        }
+        const char *nl = memchr(c->ring + off, '\n', len);
+        if (nl != NULL) {
+            return from + (nl - (c->ring + off));
+        }
+        from += len;
+    }
+    return c->written;
+}
+
+// Print the lines not shown yet, each tagged with the job ID
+// flush: Nonzero to also print an unfinished last line
+static void show_lines(capture_t *c, unsigned id, int flush) {
+    uint64_t start = c->written > c->size ? c->written - c->size : 0;
+    if (c->shown < start) {
+        printf("[%u] (%llu bytes dropped)\n", id, (unsigned long long) (start - c->shown));
+        c->shown = start;
+    }
+    while (c->shown < c->written) {
+        uint64_t end = find_newline(c, c->shown);
+        // Hold back an unfinished line until it ends, unless it fills the ring
+        if (end == c->written && !flush && end - c->shown < c->size) {
+            break;
+        }
+        printf("[%u] ", id);
+        put_range(c, c->shown, end);
+        putchar('\n');
+        c->shown = end < c->written ? end + 1 : end;
+    }
+}
+
+static void drain_one(capture_t *c, unsigned id) {
+    // Take at most one ring's worth at a time, so one chatty job cannot keep
+    // the shell from the others
+    size_t budget = c->size;
+    while (c->fd != -1 && budget > 0) {
+        size_t off = c->written % c->size;
+        size_t room = c->size - off < budget ? c->size - off : budget;
+        ssize_t n = read(c->fd, c->ring + off, room);
+        if (n > 0) {
+            c->written += n;
+            budget -= n;
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && errno == EAGAIN) {
+            break;
+        } else {  // end of file: every process of the job closed its output
+            close_capture(c);
+        }
+    }
+    if (following) {
+        show_lines(c, id, c->fd == -1);
+        fflush(stdout);
+    }
+}
+
+void capture_drain(void) {
+    if (num_open == 0) {
+        return;
+    }
+    struct epoll_event events[INITIAL_SLOTS];
+    int n = epoll_wait(epoll_fd, events, INITIAL_SLOTS, 0);
+    for (int i = 0; i < n; i++) {
+        unsigned id = events[i].data.u32;
+        if (id < num_slots && captures[id] != NULL) {
+            drain_one(captures[id], id);
+        }
+    }
+}
+
+int capture_print(unsigned id, long lines) {
+    capture_drain();
+    if (id >= num_slots || captures[id] == NULL) {
+        return -1;
+    }
+    capture_t *c = captures[id];
+    uint64_t start = c->written > c->size ? c->written - c->size : 0;
+    uint64_t from = start;
+    if (lines >= 0) {
+        // Walk back until 'lines' line ends are found, not counting the one at the very end
+        from = c->written;
+        if (from > start && c->ring[(from - 1) % c->size] == '\n') {
+            from--;
+        }
+        long found = 0;
+        while (lines > 0 && from > start) {
+            if (c->ring[(from - 1) % c->size] == '\n' && ++found == lines) {
+                break;
+            }
+            from--;
+        }
+        if (lines == 0) {
+            from = c->written;
+        }
+    } else if (start > 0) {
+        fprintf(stderr, "output: %llu earlier bytes dropped\n", (unsigned long long) start);
+    }
+    put_range(c, from, c->written);
+    fflush(stdout);
+    return 0;
+}
+
+void capture_list(void) {
+    capture_drain();
+    for (unsigned id = 0; id < num_slots; id++) {
+        capture_t *c = captures[id];
+        if (c == NULL) {
+            continue;
+        }
+        uint64_t dropped = c->written > c->size ? c->written - c->size : 0;
+        printf("[%u] %s  %llu bytes (%llu dropped)  %s\n", id, c->name, (unsigned long long) c->written,
+               (unsigned long long) dropped, c->fd == -1 ? "closed" : "open");
+    }
+}
+
+void capture_follow(int on) {
+    capture_drain();
+    for (unsigned id = 0; id < num_slots; id++) {
+        if (captures[id] == NULL) {
+            continue;
+        }
+        if (on) {
+            captures[id]->shown = 0;
+        }
+        // Starting shows what is there already; stopping ends unfinished lines
+        show_lines(captures[id], id, !on || captures[id]->fd == -1);
+    }
+    fflush(stdout);
+    following = on;
+}
+
+unsigned capture_num_open(void) {
+    return num_open;
+}
+
+void capture_free(void) {
+    for (unsigned id = 0; id < num_slots; id++) {
+        remove_capture(id);
+    }
+    free(captures);
+    captures = NULL;
+    num_slots = 0;
+    if (epoll_fd != -1) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+#include <stddef.h>
+
+/*
+ * Output capture for background jobs
+ * When the SWISH_CAPTURE variable holds a size (e.g., "64K"), the stdout and
+ * stderr of each background job go into a pipe instead of the terminal. The
+ * shell drains the pipes whenever it waits (at the prompt, in wait-for,
+ * wait-any and wait-all, or in parallel) into one ring buffer per job of that
+ * size, keeping the job's latest output. No job ever takes more memory than
+ * its ring, however much it writes; older output is dropped. The pipes are
+ * enlarged to the ring size where the kernel allows it, so jobs keep running
+ * while the shell waits for a foreground job.
+ */
+
+/*
+ * Get the ring size for the next background job from SWISH_CAPTURE: a number
+ * of bytes with an optional K or M suffix
+ * Returns the size, or 0 if output is not captured (SWISH_CAPTURE is unset,
+ * empty, "0" or invalid, which is reported)
+ */
+size_t capture_size(void);
+
+/*
+ * Create the pipe for a job's output
+ * fds: Set to the read end (non-blocking) and the write end, both close-on-exec;
+ *      the write end is for the job's stdout and stderr and is closed by the
+ *      caller once the job is started
+ * Returns 0 on success or -1 on error
+ */
+int capture_pipe(size_t size, int fds[2]);
+
+/*
+ * Start capturing the output of a job, replacing any earlier capture under
+ * the same job ID
+ * id: The job's ID
+ * name: The job's name, shown by capture_list()
+ * fd: Read end from capture_pipe(), owned by this module from now on (even on error)
+ * Returns 0 on success or -1 on error
+ */
+int capture_add(unsigned id, const char *name, int fd, size_t size);
+
+/*
+ * Get a descriptor that is readable when any job has output to drain, for
+ * the shell's poll() calls, or -1 when no capture is in progress
+ */
+int capture_fd(void);
+
+/*
+ * Move the output waiting in the pipes into the rings, without blocking
+ * While following, complete lines are also printed tagged with the job ID.
+ */
+void capture_drain(void);
+
+/*
+ * Print a job's captured output
+ * lines: Print only the last 'lines' lines, or everything if negative
+ * Returns 0 on success or -1 if nothing was captured for the job
+ */
+int capture_print(unsigned id, long lines);
+
+/*
+ * Print one line per capture: job ID, name, bytes written and dropped, and
+ * whether the job still holds its output open
+ */
+void capture_list(void);
+
+/*
+ * Start or stop following: on starting, the lines captured so far are
+ * printed, each prefixed with "[id] "; then capture_drain() prints new lines
+ * as they complete, until following stops
+ */
+void capture_follow(int on);
+
+/*
+ * Returns the number of captures whose pipe is still open
+ */
+unsigned capture_num_open(void);
+
+/*
+ * Close the pipes and release the rings
+ */
+void capture_free(void);
+
+#endif // CAPTURE_H
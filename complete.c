@@ -0,0 +1,350 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtins.h"
+#include "complete.h"
+#include "string_vector.h"
+#include "vars.h"
+#include "wildcard.h"
+
+#define INITIAL_NODES 4096
+
+// Trie node for one character of a name; node 0 is the root
+typedef struct {
+    uint32_t child;     // First child, 0 if there is none
+    uint32_t sibling;   // Next child of the same parent, in increasing order of 'c'
+    uint32_t live;      // Names ending in this subtree, counted once per directory holding them
+    uint32_t ends;      // Directories holding the name that ends at this node
+    char c;
+} node_t;
+
+typedef struct {
+    char *path;         // Directory as written in PATH
+    struct timespec mtime;
+    int scanned;        // Nonzero once 'names' reflects the directory as of 'mtime'
+    char *names;        // Executables added to the trie, back to back, each ending in '\0'
+    size_t names_len;
+} path_dir_t;
+
+static node_t *nodes = NULL;
+static uint32_t num_nodes = 0;
+static uint32_t nodes_cap = 0;
+
+static char *cached_path_var = NULL;  // Value of PATH the directories were taken from
+static path_dir_t *dirs = NULL;
+static unsigned num_dirs = 0;
+
+static uint32_t new_node(char c, uint32_t sibling) {
+    if (num_nodes == nodes_cap) {
+        uint32_t new_cap = nodes_cap == 0 ? INITIAL_NODES : nodes_cap * 2;
+        node_t *new_nodes = realloc(nodes, new_cap * sizeof(node_t));
+        if (new_nodes == NULL) {
+            perror("realloc");
+            return 0;
+        }
+        nodes = new_nodes;
+        nodes_cap = new_cap;
+    }
+    nodes[num_nodes] = (node_t) {0, sibling, 0, 0, c};
+    return num_nodes++;
+}
+
+static int trie_insert(const char *name) {
+    if (num_nodes == 0) {  // add the root
+        new_node('\0', 0);
+        if (num_nodes == 0) {
+            return -1;
+        }
+    }
+    // Create the nodes first, so a failed allocation leaves the counts alone
+    uint32_t node = 0;
+    for (const char *c = name; *c != '\0'; c++) {
+        uint32_t *link = &nodes[node].child;
+        while (*link != 0 && nodes[*link].c < *c) {
+            link = &nodes[*link].sibling;
+        }
+        if (*link == 0 || nodes[*link].c != *c) {
+            size_t offset = (char *) link - (char *) nodes;  // new_node() may move 'nodes'
+            uint32_t child = new_node(*c, *link);
+            if (child == 0) {
+                return -1;
+            }
+            *(uint32_t *) ((char *) nodes + offset) = child;
+            node = child;
+        } else {
+            node = *link;
+        }
+    }
+    nodes[node].ends++;
+    node = 0;
+    nodes[0].live++;
+    for (const char *c = name; *c != '\0'; c++) {
+        for (node = nodes[node].child; nodes[node].c != *c; node = nodes[node].sibling) {
+        }
+        nodes[node].live++;
+    }
+    return 0;
+}
+
+// Returns the node where 'prefix' ends, or 0 if no name starts with it
+static uint32_t trie_find(const char *prefix) {
+    if (num_nodes == 0) {
+        return 0;
+    }
+    uint32_t node = 0;
+    for (const char *c = prefix; *c != '\0'; c++) {
+        node = nodes[node].child;
+        while (node != 0 && nodes[node].c < *c) {
+            node = nodes[node].sibling;
+        }
+        if (node == 0 || nodes[node].c != *c) {
+            return 0;
+        }
+    }
+    return node;
+}
+
+// The name must be in the trie
+static void trie_remove(const char *name) {
+    uint32_t node = 0;
+    nodes[0].live--;
+    for (const char *c = name; *c != '\0'; c++) {
+        for (node = nodes[node].child; nodes[node].c != *c; node = nodes[node].sibling) {
+        }
+        nodes[node].live--;
+    }
+    nodes[node].ends--;
+}
+
+// Add the names below 'node' to 'matches' in sorted order; 'name' holds the
+// 'len' characters leading to 'node'
+static int trie_collect(uint32_t node, char *name, size_t len, strvec_t *matches) {
+    if (nodes[node].ends > 0) {
+        name[len] = '\0';
+        if (strvec_add(matches, name) != 0) {
+            perror("strvec_add");
+            return -1;
+        }
+    }
+    if (len + 1 >= NAME_MAX + 1) {
+        return 0;
+    }
+    for (uint32_t child = nodes[node].child; child != 0; child = nodes[child].sibling) {
+        if (nodes[child].live == 0) {  // only names that were removed
+            continue;
+        }
+        name[len] = nodes[child].c;
+        if (trie_collect(child, name, len + 1, matches) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void forget_dirs(void) {
+    for (unsigned i = 0; i < num_dirs; i++) {
+        free(dirs[i].path);
+        free(dirs[i].names);
+    }
+    free(dirs);
+    dirs = NULL;
+    num_dirs = 0;
+    free(cached_path_var);
+    cached_path_var = NULL;
+    free(nodes);
+    nodes = NULL;
+    num_nodes = 0;
+    nodes_cap = 0;
+}
+
+// Start over with the directories of PATH if it changed
+static int check_path(void) {
+    const char *path_var = vars_get("PATH");
+    if (path_var == NULL) {
+        path_var = "";
+    }
+    if (cached_path_var != NULL && strcmp(cached_path_var, path_var) == 0) {
+        return 0;
+    }
+    forget_dirs();
+    unsigned count = 1;
+    for (const char *c = path_var; *c != '\0'; c++) {
+        if (*c == ':') {
+            count++;
+        }
+    }
+    if ((cached_path_var = strdup(path_var)) == NULL || (dirs = calloc(count, sizeof(path_dir_t))) == NULL) {
+        perror("malloc");
+        forget_dirs();
+        return -1;
+    }
+    const char *start = path_var;
+    for (unsigned i = 0; i < count; i++) {
+        const char *end = strchr(start, ':');
+        size_t len = end == NULL ? strlen(start) : (size_t) (end - start);
+        // An empty element means the current directory, as in execvp()
+        if ((dirs[i].path = len == 0 ? strdup(".") : strndup(start, len)) == NULL) {
+            perror("strdup");
+            forget_dirs();
+            return -1;
+        }
+        num_dirs++;
+        start = end == NULL ? start : end + 1;
+    }
+    return 0;
+}
+
+// Replace the names the directory added to the trie with the executables it holds now
+static int scan_dir(path_dir_t *dir, const struct stat *dir_st) {
+    for (size_t off = 0; off < dir->names_len; off += strlen(dir->names + off) + 1) {
+        trie_remove(dir->names + off);
+    }
+    dir->names_len = 0;
+    dir->scanned = 1;
+    dir->mtime = dir_st->st_mtim;
+
+    char **names;
+    int num_names = wildcard_list(dir->path, &names);
+    int dir_fd = num_names == -1 ? -1 : open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1) {
+        return 0;  // the directory does not exist (yet)
+    }
+    size_t cap = 0;
+    for (int i = 0; i < num_names; i++) {
+        struct stat st;
+        if (fstatat(dir_fd, names[i], &st, 0) != 0 || !S_ISREG(st.st_mode) || !(st.st_mode & 0111)) {
+            continue;
+        }
+        size_t len = strlen(names[i]) + 1;
+        if (dir->names_len + len > cap) {
+            size_t new_cap = cap == 0 ? 4096 : cap * 2;
+            while (dir->names_len + len > new_cap) {
+                new_cap *= 2;
+            }
+            char *new_names = realloc(dir->names, new_cap);
+            if (new_names == NULL) {
+                perror("realloc");
+                break;
+            }
+            dir->names = new_names;
+            cap = new_cap;
+        }
+        if (trie_insert(names[i]) != 0) {
+            break;
+        }
+        memcpy(dir->names + dir->names_len, names[i], len);
+        dir->names_len += len;
+    }
+    close(dir_fd);
+    return 0;
+}
+
+// Read the first directory that is new or changed; returns 1 if one was read
+static int refresh_one(void) {
+    for (unsigned i = 0; i < num_dirs; i++) {
+        struct stat st;
+        if (stat(dirs[i].path, &st) != 0) {
+            st.st_mtim = (struct timespec) {0, 0};  // compares equal once it has been scanned while missing
+        }
+        if (!dirs[i].scanned || st.st_mtim.tv_sec != dirs[i].mtime.tv_sec ||
+            st.st_mtim.tv_nsec != dirs[i].mtime.tv_nsec) {
+            scan_dir(&dirs[i], &st);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int complete_step(void) {
+    if (check_path() != 0) {
+        return 0;
+    }
+    return refresh_one();
+}
+
+int complete_command(const char *prefix, strvec_t *matches) {
+    if (check_path() != 0) {
+        return -1;
+    }
+    while (refresh_one()) {  // finish the trie and catch up with changes
+    }
+    strvec_t executables;
+    if (strvec_init_arena(&executables) != 0) {
+        perror("strvec_init_arena");
+        return -1;
+    }
+    char name[NAME_MAX + 1];
+    size_t len = strlen(prefix);
+    uint32_t node = trie_find(prefix);
+    int ret = 0;
+    if (node != 0 && len <= NAME_MAX) {
+        memcpy(name, prefix, len);
+        ret = trie_collect(node, name, len, &executables);
+    }
+    // Merge with the builtins, which are sorted too
+    unsigned b = 0;
+    unsigned e = 0;
+    while (ret == 0) {
+        const char *builtin;
+        while ((builtin = builtin_name(b)) != NULL && strncmp(builtin, prefix, len) != 0) {
+            b++;
+        }
+        const char *executable = strvec_get(&executables, e);
+        if (builtin == NULL && executable == NULL) {
+            break;
+        }
+        int order = builtin == NULL ? 1 : executable == NULL ? -1 : strcmp(builtin, executable);
+        if (strvec_add(matches, order <= 0 ? builtin : executable) != 0) {
+            perror("strvec_add");
+            ret = -1;
+        }
+        b += order <= 0;
+        e += order >= 0;
+    }
+    strvec_free(&executables);
+    return ret;
+}
+
+int complete_file(const char *prefix, strvec_t *matches) {
+    const char *slash = strrchr(prefix, '/');
+    const char *base = slash == NULL ? prefix : slash + 1;
+    char dir[PATH_MAX];
+    size_t dir_len = base - prefix;
+    if (dir_len >= sizeof(dir)) {
+        return 0;
+    }
+    memcpy(dir, prefix, dir_len);
+    dir[dir_len] = '\0';
+    char **names;
+    int num_names = wildcard_list(dir, &names);
+    size_t base_len = strlen(base);
+    char path[PATH_MAX];
+    for (int i = 0; i < num_names; i++) {
+        if (strncmp(names[i], base, base_len) != 0 || (names[i][0] == '.' && base[0] != '.')) {
+            continue;
+        }
+        int len = snprintf(path, sizeof(path), "%s%s", dir, names[i]);
+        if (len < 0 || len + 1 >= sizeof(path)) {
+            continue;
+        }
+        struct stat st;
+        if (wildcard_maybe_dir(names[i]) && stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            strcat(path, "/");
+        }
+        if (strvec_add(matches, path) != 0) {
+            perror("strvec_add");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void complete_free(void) {
+    forget_dirs();
+}
@@ -0,0 +1,46 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#include "string_vector.h"
+
+/*
+ * Completion of command and file names for the line editor
+ * Executables on PATH are kept in a prefix trie. The trie is filled one PATH
+ * directory at a time by complete_step(), which the editor calls while it
+ * waits for keys, so it is usually ready by the time it is first needed.
+ * Each directory's modification time is remembered, and only directories
+ * that changed since they were read are read again, removing the names they
+ * used to hold and adding the ones they hold now. Looking up a prefix walks
+ * the trie and visits only the names that start with it.
+ */
+
+/*
+ * Do a slice of background work: read one PATH directory that is new or has
+ * changed into the trie
+ * Returns 1 if more work is left, or 0 if the trie is up to date
+ */
+int complete_step(void);
+
+/*
+ * Find the builtins and executables on PATH whose names start with 'prefix'
+ * The trie is brought up to date first.
+ * matches: Vector the names are added to, sorted and without duplicates
+ * Returns 0 on success or -1 on error
+ */
+int complete_command(const char *prefix, strvec_t *matches);
+
+/*
+ * Find the files whose paths start with 'prefix' (e.g., "src/ma")
+ * Names starting with '.' are only included if the last component of 'prefix'
+ * starts with '.'. A '/' is appended to directories.
+ * matches: Vector the paths are added to, sorted
+ * Returns 0 on success or -1 on error
+ */
+int complete_file(const char *prefix, strvec_t *matches);
+
+/*
+ * Release the trie and the list of PATH directories
+ */
+void complete_free(void);
+
+#endif // COMPLETE_H
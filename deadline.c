@@ -0,0 +1,258 @@
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "deadline.h"
+#include "swish_funcs.h"
+#include "trace.h"
+
+#define NS_PER_SEC 1000000000ULL
+#define MAX_SECONDS 1e9  // about 31 years, well within a uint64_t of nanoseconds
+#define INITIAL_CAPACITY 16
+
+typedef struct {
+    uint64_t when;      // CLOCK_MONOTONIC time in nanoseconds
+    uint64_t grace;     // Time to SIGKILL once 'signal' is SIGTERM, 0 for none
+    pid_t pgid;
+    unsigned id;        // Job ID or DEADLINE_FOREGROUND
+    int signal;         // SIGTERM, then SIGKILL
+} entry_t;
+
+static entry_t *heap = NULL;  // Min-heap on 'when'
+static unsigned length = 0;
+static unsigned capacity = 0;
+static int timer_fd = -1;
+static job_list_t *job_list = NULL;
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+void deadline_init(job_list_t *jobs) {
+    job_list = jobs;
+}
+
+// Parse a duration such as "10", "0.5" or "2m" into nanoseconds
+static int parse_duration(const char *text, uint64_t *ns) {
+    char *end;
+    errno = 0;
+    double seconds = strtod(text, &end);
+    if (end == text || errno != 0 || !isfinite(seconds) || seconds < 0) {
+        return -1;
+    }
+    switch (*end) {
+        case 'd':
+            seconds *= 24;
+            // fall through
+        case 'h':
+            seconds *= 60;
+            // fall through
+        case 'm':
+            seconds *= 60;
+            // fall through
+        case 's':
+            end++;
+            break;
+    }
+    if (*end != '\0' || seconds > MAX_SECONDS) {
+        return -1;
+    }
+    *ns = seconds * NS_PER_SEC;
+    return 0;
+}
+
+int deadline_parse(strvec_t *tokens, deadline_t *deadline) {
+    deadline->grace = DEADLINE_GRACE_DEFAULT * NS_PER_SEC;
+    unsigned i = 1;
+    const char *arg = strvec_get(tokens, i);
+    if (arg != NULL && strcmp(arg, "-k") == 0) {
+        const char *grace = strvec_get(tokens, i + 1);
+        if (grace == NULL || parse_duration(grace, &deadline->grace) != 0) {
+            fprintf(stderr, "timeout: invalid grace period '%s'\n", grace == NULL ? "" : grace);
+            return -1;
+        }
+        i += 2;
+        arg = strvec_get(tokens, i);
+    }
+    if (arg == NULL || strvec_get(tokens, i + 1) == NULL) {
+        fprintf(stderr, "Usage: timeout [-k GRACE] DURATION command\n");
+        return -1;
+    }
+    if (parse_duration(arg, &deadline->timeout) != 0) {
+        fprintf(stderr, "timeout: invalid duration '%s'\n", arg);
+        return -1;
+    }
+    return i + 1;
+}
+
+static void swap(unsigned a, unsigned b) {
+    entry_t tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+}
+
+static void sift_up(unsigned i) {
+    while (i > 0 && heap[(i - 1) / 2].when > heap[i].when) {
+        swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void sift_down(unsigned i) {
+    while (1) {
+        unsigned smallest = i;
+        unsigned left = 2 * i + 1;
+        unsigned right = left + 1;
+        if (left < length && heap[left].when < heap[smallest].when) {
+            smallest = left;
+        }
+        if (right < length && heap[right].when < heap[smallest].when) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        swap(i, smallest);
+        i = smallest;
+    }
+}
+
+// Arm the timer for the earliest deadline, or disarm it when there is none
+static void arm(void) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (length > 0) {
+        // An absolute time of 0 would disarm the timer, so stay above it
+        uint64_t when = heap[0].when > 0 ? heap[0].when : 1;
+        spec.it_value.tv_sec = when / NS_PER_SEC;
+        spec.it_value.tv_nsec = when % NS_PER_SEC;
+    }
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == -1) {
+        perror("timerfd_settime");
+    }
+}
+
+static int push(const entry_t *entry) {
+    if (length == capacity) {
+        unsigned new_capacity = capacity == 0 ? INITIAL_CAPACITY : capacity * 2;
+        entry_t *new_heap = realloc(heap, new_capacity * sizeof(entry_t));
+        if (new_heap == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        heap = new_heap;
+        capacity = new_capacity;
+    }
+    heap[length] = *entry;
+    sift_up(length++);
+    return 0;
+}
+
+static void pop(void) {
+    heap[0] = heap[--length];
+    sift_down(0);
+}
+
+int deadline_add(pid_t pgid, unsigned id, const deadline_t *deadline) {
+    if (timer_fd == -1 && (timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1) {
+        perror("timerfd_create");
+        return -1;
+    }
+    entry_t entry = {now_ns() + deadline->timeout, deadline->grace, pgid, id, SIGTERM};
+    if (push(&entry) != 0) {
+        return -1;
+    }
+    arm();
+    return 0;
+}
+
+void deadline_move(pid_t pgid, unsigned id) {
+    for (unsigned i = 0; i < length; i++) {
+        if (heap[i].pgid == pgid) {
+            heap[i].id = id;
+        }
+    }
+}
+
+void deadline_cancel(pid_t pgid) {
+    unsigned kept = 0;
+    for (unsigned i = 0; i < length; i++) {
+        if (heap[i].pgid != pgid) {
+            heap[kept++] = heap[i];
+        }
+    }
+    if (kept == length) {
+        return;
+    }
+    length = kept;
+    for (unsigned i = length / 2; i-- > 0;) {
+        sift_down(i);
+    }
+    arm();
+}
+
+int deadline_fd(void) {
+    return length == 0 ? -1 : timer_fd;
+}
+
+// Send a signal to every live process of a job
+static void signal_job(const job_t *job, int sig) {
+    if (job_control) {
+        kill(-job->pid, sig);
+        return;
+    }
+    // Without job control the job shares the shell's process group
+    for (unsigned i = 0; i < job->num_pids; i++) {
+        kill(job->pids[i], sig);
+    }
+}
+
+void deadline_expire(job_t *foreground) {
+    if (length == 0) {
+        return;
+    }
+    uint64_t expirations;
+    while (read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+    }
+    uint64_t now = now_ns();
+    while (length > 0 && heap[0].when <= now) {
+        entry_t entry = heap[0];
+        pop();
+        job_t *job = entry.id == DEADLINE_FOREGROUND ? foreground : job_list_get(job_list, entry.id);
+        // The job may have finished, and its ID gone to another job, since
+        if (job == NULL || job->pid != entry.pgid || job->num_pids == 0) {
+            continue;
+        }
+        TRACE_INSTANT("timeout", job->pid, job->name, entry.signal);
+        signal_job(job, entry.signal);
+        if (entry.signal == SIGTERM) {
+            job->timed_out = 1;
+            signal_job(job, SIGCONT);  // a stopped job could not act on SIGTERM
+            if (entry.grace > 0) {
+                entry.when = now + entry.grace;
+                entry.signal = SIGKILL;
+                push(&entry);
+            }
+        }
+    }
+    arm();
+}
+
+void deadline_free(void) {
+    free(heap);
+    heap = NULL;
+    length = 0;
+    capacity = 0;
+    if (timer_fd != -1) {
+        close(timer_fd);
+        timer_fd = -1;
+    }
+}
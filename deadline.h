@@ -0,0 +1,84 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "job_list.h"
+#include "string_vector.h"
+
+/*
+ * Deadlines for jobs started with "timeout DURATION command"
+ * When a job's deadline passes, its processes are sent SIGTERM (and SIGCONT,
+ * in case they are stopped), then SIGKILL if any are left after a grace
+ * period. All deadlines share one timerfd, armed for the earliest of them,
+ * and wait in a binary heap, so a deadline costs O(log n) to set and to fire
+ * and no process of its own. The shell polls deadline_fd() wherever it waits
+ * (see reaper.h).
+ */
+
+// Grace period from SIGTERM to SIGKILL when "timeout" is not given -k
+#define DEADLINE_GRACE_DEFAULT 5
+
+// Key of the foreground job, which is not in the jobs list
+#define DEADLINE_FOREGROUND ((unsigned) -1)
+
+typedef struct {
+    uint64_t timeout;   // Nanoseconds from the job's start to SIGTERM
+    uint64_t grace;     // Nanoseconds from SIGTERM to SIGKILL, or 0 for no SIGKILL
+} deadline_t;
+
+/*
+ * Set up deadlines for the jobs in 'jobs' (the timerfd is created on first use)
+ */
+void deadline_init(job_list_t *jobs);
+
+/*
+ * Parse the arguments of "timeout [-k GRACE] DURATION command ..."
+ * Durations are numbers of seconds, possibly with a fraction, optionally
+ * followed by s, m, h or d (as in timeout(1))
+ * tokens: The command line, with "timeout" at index 0
+ * deadline: Filled in from the arguments
+ * Returns the index of the command, or -1 on error (reported)
+ */
+int deadline_parse(strvec_t *tokens, deadline_t *deadline);
+
+/*
+ * Start the clock on a job's deadline
+ * pgid: The job's process group ID (job_t.pid)
+ * id: The job's ID in the jobs list, or DEADLINE_FOREGROUND while it is only
+ *     known to the shell's foreground wait
+ * Returns 0 on success or -1 on error (reported)
+ */
+int deadline_add(pid_t pgid, unsigned id, const deadline_t *deadline);
+
+/*
+ * Move a foreground job's deadline to its ID, once it stopped and joined the jobs list
+ */
+void deadline_move(pid_t pgid, unsigned id);
+
+/*
+ * Drop a job's deadline, once the job is done
+ * Deadlines of background jobs are dropped when they come due instead, if
+ * their job is gone by then.
+ */
+void deadline_cancel(pid_t pgid);
+
+/*
+ * Get a descriptor that is readable when a deadline has passed, for the
+ * shell's poll() calls, or -1 when no deadline is set
+ */
+int deadline_fd(void);
+
+/*
+ * Signal the jobs whose deadline or grace period has passed, without blocking
+ * Jobs that were sent SIGTERM are marked as timed out (job_t.timed_out).
+ * foreground: The job the shell waits for in the foreground, or NULL
+ */
+void deadline_expire(job_t *foreground);
+
+/*
+ * Release the heap and close the timerfd
+ */
+void deadline_free(void);
+
+#endif // DEADLINE_H
@@ -0,0 +1,672 @@
+#define _GNU_SOURCE  // memmem(), memrchr()
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "complete.h"
+#include "editor.h"
+#include "history.h"
+#include "string_vector.h"
+#include "vars.h"
+
+#define INITIAL_SIZE 256
+#define DEFAULT_COLUMNS 80
+#define LIST_QUERY_MIN 100  // Ask before listing this many completions
+#define SEARCH_MAX 256      // Longest text for a reverse search
+
+// Keys that arrive as escape sequences
+enum {
+    KEY_NONE = 1000,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_UP,
+    KEY_DOWN,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+    KEY_WORD_LEFT,
+    KEY_WORD_RIGHT,
+};
+
+// Output collected so a redraw goes out in one write()
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} out_t;
+
+static void out_append(out_t *out, const char *s, size_t len) {
+    if (out->len + len > out->cap) {
+        size_t new_cap = out->cap == 0 ? INITIAL_SIZE : out->cap;
+        while (out->len + len > new_cap) {
+            new_cap *= 2;
+        }
+        char *new_data = realloc(out->data, new_cap);
+        if (new_data == NULL) {
+            return;  // the redraw is incomplete, the line is not
+        }
+        out->data = new_data;
+        out->cap = new_cap;
+    }
+    memcpy(out->data + out->len, s, len);
+    out->len += len;
+}
+
+static void out_printf(out_t *out, const char *format, size_t n) {
+    char seq[32];
+    int len = snprintf(seq, sizeof(seq), format, n);
+    out_append(out, seq, len);
+}
+
+static void out_flush(out_t *out) {
+    for (size_t written = 0; written < out->len;) {
+        ssize_t n = write(STDOUT_FILENO, out->data + written, out->len - written);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1) {
+            break;
+        }
+        written += n;
+    }
+    free(out->data);
+    *out = (out_t) {NULL, 0, 0};
+}
+
+static void write_str(const char *s) {
+    out_t out = {NULL, 0, 0};
+    out_append(&out, s, strlen(s));
+    out_flush(&out);
+}
+
+static size_t columns(void) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
+        return DEFAULT_COLUMNS;
+    }
+    return ws.ws_col;
+}
+
+int editor_init(editor_t *ed, int fd) {
+    const char *term = vars_get("TERM");
+    struct winsize ws;
+    if (!isatty(fd) || !isatty(STDOUT_FILENO) ||
+        (term != NULL && (strcmp(term, "dumb") == 0 || strcmp(term, "emacs") == 0))) {
+        return -1;
+    }
+    // A pseudo-terminal without a size is driven by a program rather than shown
+    // in a terminal window; lines cannot be redrawn without knowing the width
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
+        return -1;
+    }
+    memset(ed, 0, sizeof(*ed));
+    ed->fd = fd;
+    ed->cap = INITIAL_SIZE;
+    if ((ed->buf = malloc(INITIAL_SIZE)) == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    return 0;
+}
+
+void editor_set_wait(editor_t *ed, int (*wait)(int fd, void *arg), void *arg) {
+    ed->wait = wait;
+    ed->wait_arg = arg;
+}
+
+void editor_free(editor_t *ed) {
+    free(ed->buf);
+    free(ed->killed);
+    free(ed->saved_line);
+    ed->buf = NULL;
+    ed->killed = NULL;
+    ed->saved_line = NULL;
+}
+
+static int enable_raw(editor_t *ed) {
+    if (tcgetattr(ed->fd, &ed->saved) == -1) {
+        return -1;
+    }
+    struct termios raw = ed->saved;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    // Output processing stays on, so '\n' still starts the next line at its first column.
+    // TCSANOW keeps keys typed ahead.
+    return tcsetattr(ed->fd, TCSANOW, &raw);
+}
+
+static void disable_raw(editor_t *ed) {
+    tcsetattr(ed->fd, TCSANOW, &ed->saved);
+}
+
+// Read one byte, building the completion trie while no key is waiting
+// Returns the byte, or -1 at end of input or on error
+static int read_byte(editor_t *ed) {
+    struct pollfd pfd = { .fd = ed->fd, .events = POLLIN };
+    while (poll(&pfd, 1, 0) == 0 && complete_step()) {
+    }
+    unsigned char c;
+    while (1) {
+        if (ed->wait != NULL && ed->wait(ed->fd, ed->wait_arg) != 0) {
+            return -1;
+        }
+        ssize_t n = read(ed->fd, &c, 1);
+        if (n == 1) {
+            return c;
+        } else if (n == 0 || errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+// Read a key, decoding the escape sequences of cursor and editing keys
+static int read_key(editor_t *ed) {
+    int c = read_byte(ed);
+    if (c != '\x1b') {
+        return c;
+    }
+    int c1 = read_byte(ed);
+    if (c1 == 'b' || c1 == 'f') {  // Alt-B, Alt-F
+        return c1 == 'b' ? KEY_WORD_LEFT : KEY_WORD_RIGHT;
+    } else if (c1 != '[' && c1 != 'O') {
+        return c1 == -1 ? -1 : KEY_NONE;
+    }
+    int c2 = read_byte(ed);
+    if (c1 == '[' && isdigit(c2)) {  // "ESC [ n ~"
+        int c3 = read_byte(ed);
+        while (c3 != '~' && c3 != -1 && !isalpha(c3)) {  // skip modifiers such as ";5"
+            c3 = read_byte(ed);
+        }
+        switch (c2) {
+            case '1':
+            case '7':
+                return KEY_HOME;
+            case '4':
+            case '8':
+                return KEY_END;
+            case '3':
+                return KEY_DELETE;
+            default:
+                return c3 == -1 ? -1 : KEY_NONE;
+        }
+    }
+    switch (c2) {
+        case 'A':
+            return KEY_UP;
+        case 'B':
+            return KEY_DOWN;
+        case 'C':
+            return KEY_RIGHT;
+        case 'D':
+            return KEY_LEFT;
+        case 'H':
+            return KEY_HOME;
+        case 'F':
+            return KEY_END;
+        default:
+            return c2 == -1 ? -1 : KEY_NONE;
+    }
+}
+
+// Redraw the prompt and the line and put the cursor in place; the line may
+// wrap over several rows
+static void refresh(editor_t *ed) {
+    size_t cols = columns();
+    out_t out = {NULL, 0, 0};
+    if (ed->shown / cols > 0) {
+        out_printf(&out, "\x1b[%zuA", ed->shown / cols);
+    }
+    out_append(&out, "\r\x1b[J", 4);
+    out_append(&out, ed->prompt, ed->prompt_len);
+    out_append(&out, ed->buf, ed->len);
+    size_t end = ed->prompt_len + ed->len;
+    if (end > 0 && end % cols == 0) {  // the terminal only wraps when the next character comes
+        out_append(&out, "\n", 1);
+    }
+    size_t cursor = ed->prompt_len + ed->pos;
+    if (end / cols > cursor / cols) {
+        out_printf(&out, "\x1b[%zuA", end / cols - cursor / cols);
+    }
+    out_append(&out, "\r", 1);
+    if (cursor % cols > 0) {
+        out_printf(&out, "\x1b[%zuC", cursor % cols);
+    }
+    out_flush(&out);
+    ed->shown = cursor;
+}
+
+static int reserve(editor_t *ed, size_t len) {
+    if (ed->len + len + 1 <= ed->cap) {  // + 1 for the '\0' added when the line is done
+        return 0;
+    }
+    size_t new_cap = ed->cap * 2;
+    while (ed->len + len + 1 > new_cap) {
+        new_cap *= 2;
+    }
+    char *new_buf = realloc(ed->buf, new_cap);
+    if (new_buf == NULL) {
+        perror("realloc");
+        return -1;
+    }
+    ed->buf = new_buf;
+    ed->cap = new_cap;
+    return 0;
+}
+
+static void insert(editor_t *ed, const char *s, size_t len) {
+    if (len == 0 || reserve(ed, len) != 0) {
+        return;
+    }
+    memmove(ed->buf + ed->pos + len, ed->buf + ed->pos, ed->len - ed->pos);
+    memcpy(ed->buf + ed->pos, s, len);
+    ed->len += len;
+    ed->pos += len;
+    if (ed->pos < ed->len) {
+        refresh(ed);
+        return;
+    }
+    // Typing at the end of the line: echo what was typed, as the terminal would
+    out_t out = {NULL, 0, 0};
+    out_append(&out, s, len);
+    size_t cols = columns();
+    size_t end = ed->prompt_len + ed->len;
+    if (end % cols == 0) {
+        out_append(&out, "\n", 1);
+    }
+    out_flush(&out);
+    ed->shown = end;
+}
+
+// Remove the text from 'start' to 'end', keeping it for Ctrl-Y if 'kill' is set
+static void delete_range(editor_t *ed, size_t start, size_t end, int kill) {
+    if (start >= end) {
+        return;
+    }
+    if (kill) {
+        char *killed = realloc(ed->killed, end - start);
+        if (killed != NULL) {
+            memcpy(killed, ed->buf + start, end - start);
+            ed->killed = killed;
+            ed->killed_len = end - start;
+        }
+    }
+    memmove(ed->buf + start, ed->buf + end, ed->len - end);
+    ed->len -= end - start;
+    ed->pos = start;
+    refresh(ed);
+}
+
+static void set_line(editor_t *ed, const char *s, size_t len) {
+    ed->len = 0;
+    if (reserve(ed, len) == 0) {
+        memcpy(ed->buf, s, len);
+        ed->len = len;
+    }
+    ed->pos = ed->len;
+}
+
+static size_t word_left(editor_t *ed) {
+    size_t i = ed->pos;
+    while (i > 0 && ed->buf[i - 1] == ' ') {
+        i--;
+    }
+    while (i > 0 && ed->buf[i - 1] != ' ') {
+        i--;
+    }
+    return i;
+}
+
+static size_t word_right(editor_t *ed) {
+    size_t i = ed->pos;
+    while (i < ed->len && ed->buf[i] == ' ') {
+        i++;
+    }
+    while (i < ed->len && ed->buf[i] != ' ') {
+        i++;
+    }
+    return i;
+}
+
+// Show history entry 'i', or the line being written when 'i' is past the last entry
+static void show_history(editor_t *ed, long i) {
+    long length = history_length();
+    if (ed->hist_pos >= length && i < length) {  // leaving the new line: keep it
+        free(ed->saved_line);
+        if ((ed->saved_line = strndup(ed->buf, ed->len)) == NULL) {
+            perror("strndup");
+            return;
+        }
+    }
+    history_entry_t entry;
+    if (i < length && history_get(i, &entry) == 0) {
+        set_line(ed, entry.line, entry.line_len);
+    } else if (i >= length) {
+        set_line(ed, ed->saved_line == NULL ? "" : ed->saved_line,
+                 ed->saved_line == NULL ? 0 : strlen(ed->saved_line));
+        i = length;
+    }
+    ed->hist_pos = i;
+    refresh(ed);
+}
+
+// Reverse incremental search: each key typed narrows the search, Ctrl-R finds
+// an older match. Returns the key that ended the search, for the caller to handle.
+static int reverse_search(editor_t *ed) {
+    const char *prompt = ed->prompt;
+    size_t prompt_len = ed->prompt_len;
+    char *original = strndup(ed->buf, ed->len);
+    char query[SEARCH_MAX];
+    size_t query_len = 0;
+    char search_prompt[SEARCH_MAX + 32];
+    long match = -1;
+    int failed = 0;
+    int key;
+    while (1) {
+        query[query_len] = '\0';
+        snprintf(search_prompt, sizeof(search_prompt), "(%sreverse-i-search)`%s': ",
+                 failed ? "failed " : "", query);
+        ed->prompt = search_prompt;
+        ed->prompt_len = strlen(search_prompt);
+        refresh(ed);
+
+        key = read_key(ed);
+        long found = -1;
+        if (key == CTRL('R')) {
+            found = query_len == 0 ? -1 : history_search(query, match == -1 ? history_length() : match);
+        } else if ((key == 127 || key == CTRL('H')) && query_len > 0) {
+            query[--query_len] = '\0';
+            found = query_len == 0 ? -1 : history_search(query, history_length());
+        } else if (key >= ' ' && key < 127 && query_len + 1 < SEARCH_MAX) {
+            query[query_len++] = key;
+            query[query_len] = '\0';
+            // The current match stays if it still contains the longer text
+            found = history_search(query, match == -1 ? history_length() : match + 1);
+        } else if (key == CTRL('G') || key == CTRL('C')) {
+            if (original != NULL) {
+                set_line(ed, original, strlen(original));
+            }
+            key = KEY_NONE;
+            break;
+        } else {
+            break;  // accept the match and let the caller handle the key
+        }
+        failed = found == -1 && query_len > 0;
+        history_entry_t entry;
+        if (found != -1 && history_get(found, &entry) == 0) {
+            match = found;
+            set_line(ed, entry.line, entry.line_len);
+            const char *at = memmem(entry.line, entry.line_len, query, query_len);
+            ed->pos = at == NULL ? ed->len : (size_t) (at - entry.line);
+        }
+    }
+    free(original);
+    if (match != -1) {
+        ed->hist_pos = match;
+    }
+    ed->prompt = prompt;
+    ed->prompt_len = prompt_len;
+    refresh(ed);
+    return key;
+}
+
+// Print completions in columns below the line, then redraw the line
+static void list_matches(editor_t *ed, strvec_t *matches) {
+    if (matches->length >= LIST_QUERY_MIN) {
+        char question[64];
+        snprintf(question, sizeof(question), "\nDisplay all %u possibilities? (y or n)", matches->length);
+        write_str(question);
+        int key = read_key(ed);
+        if (key != 'y' && key != 'Y') {
+            write_str("\n");
+            ed->shown = 0;
+            refresh(ed);
+            return;
+        }
+    }
+    // Show the last component of paths, as the rest is already on the line
+    size_t width = 0;
+    for (unsigned i = 0; i < matches->length; i++) {
+        char *match = strvec_get(matches, i);
+        size_t len = strlen(match);
+        char *slash = len > 1 ? memrchr(match, '/', len - 1) : NULL;
+        size_t shown = slash == NULL ? len : len - (slash + 1 - match);
+        if (shown > width) {
+            width = shown;
+        }
+    }
+    width += 2;
+    size_t per_row = columns() / width;
+    if (per_row == 0) {
+        per_row = 1;
+    }
+    size_t rows = (matches->length + per_row - 1) / per_row;
+    out_t out = {NULL, 0, 0};
+    out_append(&out, "\n", 1);
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t i = r; i < matches->length; i += rows) {  // down the columns, like ls
+            char *match = strvec_get(matches, i);
+            size_t len = strlen(match);
+            char *slash = len > 1 ? memrchr(match, '/', len - 1) : NULL;
+            char *name = slash == NULL ? match : slash + 1;
+            size_t name_len = strlen(name);
+            out_append(&out, name, name_len);
+            if (i + rows < matches->length) {
+                for (size_t pad = name_len; pad < width; pad++) {
+                    out_append(&out, " ", 1);
+                }
+            }
+        }
+        out_append(&out, "\n", 1);
+    }
+    out_flush(&out);
+    ed->shown = 0;
+    refresh(ed);
+}
+
+static void complete(editor_t *ed) {
+    size_t start = ed->pos;
+    while (start > 0 && ed->buf[start - 1] != ' ' && ed->buf[start - 1] != '\t') {
+        start--;
+    }
+    // A command name comes first on the line or after a '|'
+    size_t before = start;
+    while (before > 0 && (ed->buf[before - 1] == ' ' || ed->buf[before - 1] == '\t')) {
+        before--;
+    }
+    int command = before == 0 || ed->buf[before - 1] == '|';
+    char *word = strndup(ed->buf + start, ed->pos - start);
+    strvec_t matches;
+    if (word == NULL || strvec_init_arena(&matches) != 0) {
+        free(word);
+        return;
+    }
+    int ret;
+    if (command && strchr(word, '/') == NULL) {
+        ret = complete_command(word, &matches);
+    } else {
+        ret = complete_file(word, &matches);
+    }
+    size_t word_len = strlen(word);
+    free(word);
+    if (ret != 0 || matches.length == 0) {
+        write_str("\a");
+        strvec_free(&matches);
+        return;
+    }
+
+    // Insert what all the matches have in common
+    const char *first = strvec_get(&matches, 0);
+    size_t common = strlen(first);
+    for (unsigned i = 1; i < matches.length; i++) {
+        const char *match = strvec_get(&matches, i);
+        size_t j = 0;
+        while (j < common && match[j] == first[j]) {
+            j++;
+        }
+        common = j;
+    }
+    if (common > word_len) {
+        insert(ed, first + word_len, common - word_len);
+        if (matches.length == 1 && first[common - 1] != '/') {
+            insert(ed, " ", 1);
+        }
+    } else if (matches.length == 1) {
+        if (first[common - 1] != '/') {
+            insert(ed, " ", 1);
+        }
+    } else if (ed->tab_count >= 2) {  // a second Tab lists the choices
+        list_matches(ed, &matches);
+    } else {
+        write_str("\a");
+    }
+    strvec_free(&matches);
+}
+
+ssize_t editor_read(editor_t *ed, const char *prompt, char **line) {
+    fflush(stdout);
+    if (enable_raw(ed) != 0) {
+        return -1;
+    }
+    ed->prompt = prompt;
+    ed->prompt_len = strlen(prompt);
+    ed->len = 0;
+    ed->pos = 0;
+    ed->hist_pos = history_length();
+    ed->tab_count = 0;
+    write_str(prompt);
+    ed->shown = ed->prompt_len;
+
+    ssize_t ret = -1;
+    int key = read_key(ed);
+    while (key != -1) {
+        int next = -1;
+        ed->tab_count = key == '\t' ? ed->tab_count + 1 : 0;
+        switch (key) {
+            case '\r':
+            case '\n':
+                if (ed->pos < ed->len) {
+                    ed->pos = ed->len;
+                    refresh(ed);
+                }
+                write_str("\n");
+                ret = ed->len;
+                break;
+            case CTRL('C'):
+                write_str("^C\n");
+                ed->len = 0;
+                ed->pos = 0;
+                ed->hist_pos = history_length();
+                write_str(prompt);
+                ed->shown = ed->prompt_len;
+                break;
+            case CTRL('D'):
+                if (ed->len == 0) {
+                    write_str("\n");
+                    key = -1;
+                    continue;
+                }
+                delete_range(ed, ed->pos, ed->pos < ed->len ? ed->pos + 1 : ed->pos, 0);
+                break;
+            case KEY_DELETE:
+                delete_range(ed, ed->pos, ed->pos < ed->len ? ed->pos + 1 : ed->pos, 0);
+                break;
+            case 127:
+            case CTRL('H'):
+                if (ed->pos > 0) {
+                    delete_range(ed, ed->pos - 1, ed->pos, 0);
+                }
+                break;
+            case KEY_LEFT:
+            case CTRL('B'):
+                if (ed->pos > 0) {
+                    ed->pos--;
+                    refresh(ed);
+                }
+                break;
+            case KEY_RIGHT:
+            case CTRL('F'):
+                if (ed->pos < ed->len) {
+                    ed->pos++;
+                    refresh(ed);
+                }
+                break;
+            case KEY_WORD_LEFT:
+                ed->pos = word_left(ed);
+                refresh(ed);
+                break;
+            case KEY_WORD_RIGHT:
+                ed->pos = word_right(ed);
+                refresh(ed);
+                break;
+            case KEY_HOME:
+            case CTRL('A'):
+                ed->pos = 0;
+                refresh(ed);
+                break;
+            case KEY_END:
+            case CTRL('E'):
+                ed->pos = ed->len;
+                refresh(ed);
+                break;
+            case CTRL('K'):
+                delete_range(ed, ed->pos, ed->len, 1);
+                break;
+            case CTRL('U'):
+                delete_range(ed, 0, ed->pos, 1);
+                break;
+            case CTRL('W'):
+                delete_range(ed, word_left(ed), ed->pos, 1);
+                break;
+            case CTRL('Y'):
+                insert(ed, ed->killed, ed->killed_len);
+                break;
+            case KEY_UP:
+            case CTRL('P'):
+                if (ed->hist_pos > 0) {
+                    show_history(ed, ed->hist_pos - 1);
+                }
+                break;
+            case KEY_DOWN:
+            case CTRL('N'):
+                if (ed->hist_pos < history_length()) {
+                    show_history(ed, ed->hist_pos + 1);
+                }
+                break;
+            case CTRL('R'):
+                next = reverse_search(ed);
+                break;
+            case CTRL('L'):
+                write_str("\x1b[H\x1b[2J");
+                ed->shown = 0;
+                refresh(ed);
+                break;
+            case '\t':
+                complete(ed);
+                break;
+            default:
+                if (key >= ' ' && key < KEY_NONE && key != 127) {
+                    char c = key;
+                    insert(ed, &c, 1);
+                }
+                break;
+        }
+        if (ret != -1) {
+            break;
+        }
+        key = next != -1 ? next : read_key(ed);
+    }
+    disable_raw(ed);
+    if (ret == -1) {
+        return -1;
+    }
+    ed->buf[ed->len] = '\0';
+    *line = ed->buf;
+    return ret;
+}
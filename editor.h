@@ -0,0 +1,75 @@
+#ifndef EDITOR_H
+#define EDITOR_H
+#include <stddef.h>
+#include <sys/types.h>
+#include <termios.h>
+
+/*
+ * Line editor for interactive shells
+ * While a line is being read the terminal is put in raw mode and the editor
+ * handles each key itself; the terminal's own settings are back in place
+ * before the line is returned, so commands always run with them. Typing at
+ * the end of the line only echoes the new characters, and the whole line is
+ * redrawn only after changes elsewhere in it.
+ *
+ * Keys (emacs style):
+ *   Left/Ctrl-B, Right/Ctrl-F    Move by one character
+ *   Alt-B, Alt-F                 Move by one word
+ *   Home/Ctrl-A, End/Ctrl-E      Move to the start or the end of the line
+ *   Backspace/Ctrl-H, Delete     Delete the character before or under the cursor
+ *   Ctrl-D                       Delete under the cursor, or end input on an empty line
+ *   Ctrl-K, Ctrl-U, Ctrl-W       Kill to the end of the line, to its start, or the word before
+ *   Ctrl-Y                       Yank (paste) the text killed last
+ *   Up/Ctrl-P, Down/Ctrl-N       Move through the history
+ *   Ctrl-R                       Reverse incremental search of the history
+ *   Tab                          Complete a command or file name
+ *   Ctrl-C                       Abandon the line
+ *   Ctrl-L                       Clear the screen
+ */
+typedef struct {
+    int fd;                 // The terminal
+    struct termios saved;   // The terminal's settings outside of editor_read()
+    char *buf;              // The line being edited
+    size_t len;
+    size_t cap;
+    size_t pos;             // Cursor offset in 'buf'
+    size_t shown;           // Cursor offset (counting the prompt) as last drawn
+    const char *prompt;
+    size_t prompt_len;
+    char *killed;           // Text for Ctrl-Y
+    size_t killed_len;
+    char *saved_line;       // The new line, kept while browsing the history
+    long hist_pos;          // History entry shown, or history_length() for the new line
+    int tab_count;          // Consecutive Tab presses
+    int (*wait)(int fd, void *arg);  // Called to block until 'fd' is readable
+    void *wait_arg;
+} editor_t;
+
+/*
+ * Initialize an editor for a terminal
+ * Fails when the editor cannot be used: 'fd' or standard output is not a
+ * terminal, the terminal has no window size, or TERM is "dumb"
+ * Returns 0 on success or -1 if the shell should read lines without editing
+ */
+int editor_init(editor_t *ed, int fd);
+
+/*
+ * Install a function the editor calls to block until its terminal is
+ * readable (see reader_set_wait())
+ * Before blocking, the editor uses idle time to build the completion trie.
+ */
+void editor_set_wait(editor_t *ed, int (*wait)(int fd, void *arg), void *arg);
+
+/*
+ * Release the memory used by an editor
+ */
+void editor_free(editor_t *ed);
+
+/*
+ * Print a prompt and read a line with editing
+ * line: Set to the line, valid (and modifiable) until the next call
+ * Returns the length of the line, or -1 at end of input or on error
+ */
+ssize_t editor_read(editor_t *ed, const char *prompt, char **line);
+
+#endif // EDITOR_H
@@ -0,0 +1,374 @@
+#define _GNU_SOURCE  // execvpe(), MSG_CMSG_CLOEXEC
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "forkserver.h"
+#include "job_opts.h"
+#include "reaper.h"
+#include "vars.h"
+
+#define NUM_FDS 4  // stdin, stdout, stderr and the current directory
+
+typedef struct {
+    uint32_t size;          // Bytes of strings following the header
+    int32_t pgid;           // Process group to join, 0 to lead a new one
+    uint32_t argc;
+    uint32_t envc;          // Strings of a new environment, after the arguments
+    uint8_t has_env;        // Nonzero if the environment changed since the last request
+    uint8_t has_path;       // Nonzero if the strings start with the program's path
+    uint8_t has_opts;
+    uint8_t foreground;     // Nonzero to take the terminal before exec()
+    job_opts_t opts;
+} request_t;
+
+static int sock = -1;           // The shell's end of the socket pair
+static pid_t server_pid = -1;
+static int sent_env = 0;        // Nonzero once the helper has an environment
+static unsigned sent_generation;
+
+// Buffer for the strings of a request, on both sides
+static char *buf = NULL;
+static size_t buf_cap = 0;
+
+static int reserve(size_t size) {
+    if (size <= buf_cap) {
+        return 0;
+    }
+    size_t new_cap = buf_cap == 0 ? 4096 : buf_cap;
+    while (new_cap < size) {
+        new_cap *= 2;
+    }
+    char *new_buf = realloc(buf, new_cap);
+    if (new_buf == NULL) {
+        return -1;
+    }
+    buf = new_buf;
+    buf_cap = new_cap;
+    return 0;
+}
+
+static int write_full(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_full(int fd, void *data, size_t len) {
+    char *p = data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Split 'count' NUL-terminated strings starting at '*pos' into 'vec'
+static int split_strings(char **pos, char *end, uint32_t count, char **vec) {
+    for (uint32_t i = 0; i < count; i++) {
+        char *s = *pos;
+        char *nul = memchr(s, '\0', end - s);
+        if (nul == NULL) {
+            return -1;
+        }
+        vec[i] = s;
+        *pos = nul + 1;
+    }
+    vec[count] = NULL;
+    return 0;
+}
+
+// In the new process: the same setup as run_command(), then exec
+static void run_child(const request_t *req, const int fds[NUM_FDS], const char *path, char **argv, char **envp) {
+    if (setpgid(0, req->pgid) != 0) {
+        perror("setpgid");
+        _exit(1);
+    }
+    // SIGTTOU is still ignored here, as in the shell, so a background group may
+    // take the terminal; the helper's stdin is the shell's
+    if (req->foreground && tcsetpgrp(STDIN_FILENO, getpgrp()) != 0) {
+        perror("tcsetpgrp");
+    }
+    struct sigaction sac;
+    sac.sa_handler = SIG_DFL;
+    sigfillset(&sac.sa_mask);
+    sac.sa_flags = 0;
+    sigaction(SIGTTIN, &sac, NULL);
+    sigaction(SIGTTOU, &sac, NULL);
+    sigprocmask(SIG_SETMASK, &child_sigmask, NULL);
+    // The received descriptors are above 2, since the helper keeps its own
+    // stdin, stdout and stderr, and close on exec
+    for (int i = 0; i < 3; i++) {
+        if (dup2(fds[i], i) == -1) {
+            perror("dup2");
+            _exit(1);
+        }
+    }
+    if (fchdir(fds[3]) != 0) {
+        perror("fchdir");
+        _exit(1);
+    }
+    if (req->has_opts && job_opts_apply(&req->opts) != 0) {
+        _exit(1);
+    }
+    environ = envp;  // execvpe() searches the PATH of 'environ'
+    if (path != NULL) {
+        execve(path, argv, envp);
+    } else {
+        execvpe(argv[0], argv, envp);
+    }
+    perror("exec");
+    _exit(127);
+}
+
+// Receive a request's header along with its descriptors
+static int receive_header(request_t *req, int fds[NUM_FDS]) {
+    char control[CMSG_SPACE(NUM_FDS * sizeof(int))];
+    struct iovec iov = { .iov_base = req, .iov_len = sizeof(*req) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0) {
+        return -1;  // the shell exited
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(NUM_FDS * sizeof(int))) {
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), NUM_FDS * sizeof(int));
+    if ((size_t) n < sizeof(*req) && read_full(sock, (char *) req + n, sizeof(*req) - n) != 0) {
+        for (int i = 0; i < NUM_FDS; i++) {
+            close(fds[i]);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// The helper's loop: one request in, one process ID out
+static void serve(void) {
+    char **argv = NULL;
+    size_t argv_cap = 0;
+    char *env_strings = NULL;  // The last environment sent, kept for later requests
+    char **envp = NULL;
+    char *empty_env[] = {NULL};
+    while (1) {
+        request_t req;
+        int fds[NUM_FDS];
+        if (receive_header(&req, fds) != 0) {
+            break;
+        }
+        if (reserve(req.size) != 0 || read_full(sock, buf, req.size) != 0) {
+            break;
+        }
+        int32_t reply = -EINVAL;
+        char *pos = buf;
+        char *end = buf + req.size;
+        char *path[2] = {NULL, NULL};
+        if (req.argc + 1 > argv_cap) {
+            free(argv);
+            argv_cap = req.argc + 1;
+            argv = malloc(argv_cap * sizeof(char *));
+        }
+        int valid = argv != NULL && req.argc > 0 &&
+                    (!req.has_path || split_strings(&pos, end, 1, path) == 0) &&
+                    split_strings(&pos, end, req.argc, argv) == 0;
+        if (valid && req.has_env) {
+            // Keep a copy, since 'buf' is reused by the next request
+            free(env_strings);
+            free(envp);
+            env_strings = malloc(end - pos + 1);
+            envp = malloc((req.envc + 1) * sizeof(char *));
+            if (env_strings == NULL || envp == NULL) {
+                free(env_strings);
+                free(envp);
+                env_strings = NULL;
+                envp = NULL;
+                valid = 0;
+            } else {
+                memcpy(env_strings, pos, end - pos);
+                char *env_pos = env_strings;
+                valid = split_strings(&env_pos, env_strings + (end - pos), req.envc, envp) == 0;
+            }
+        }
+        if (valid) {
+            // clone() with CLONE_PARENT and no new stack works like fork(),
+            // except that the new process is the shell's child, not ours
+            pid_t pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, NULL);
+            if (pid == 0) {
+                run_child(&req, fds, path[0], argv, envp != NULL ? envp : empty_env);
+            }
+            reply = pid == -1 ? -errno : pid;
+        }
+        for (int i = 0; i < NUM_FDS; i++) {
+            close(fds[i]);
+        }
+        if (write_full(sock, &reply, sizeof(reply)) != 0) {
+            break;
+        }
+    }
+    _exit(0);
+}
+
+int forkserver_start(void) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) == -1) {
+        perror("socketpair");
+        return -1;
+    }
+    pid_t shell_pid = getpid();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(pair[0]);
+        close(pair[1]);
+        return -1;
+    } else if (pid == 0) {
+        close(pair[0]);
+        sock = pair[1];
+        // Go away with the shell, and stay out of the way of signals from the
+        // terminal (e.g., Ctrl-C at the prompt) by leading a process group
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != shell_pid) {
+            _exit(0);
+        }
+        setpgid(0, 0);
+        serve();
+    }
+    close(pair[1]);
+    sock = pair[0];
+    server_pid = pid;
+    sent_env = 0;
+    return 0;
+}
+
+pid_t forkserver_spawn(const char *path, char **argv, const int fds[3], pid_t pgid, int foreground,
+                       const job_opts_t *opts) {
+    if (sock == -1) {
+        fprintf(stderr, "fork server: not running\n");
+        return -1;
+    }
+    request_t req;
+    memset(&req, 0, sizeof(req));
+    req.pgid = pgid;
+    req.has_path = path != NULL;
+    req.foreground = foreground != 0;
+    if (opts != NULL) {
+        req.has_opts = 1;
+        req.opts = *opts;
+    }
+    // Lay out the strings: path, arguments, then the environment if it changed
+    char **envp = vars_envp();
+    req.has_env = !sent_env || vars_envp_generation() != sent_generation;
+    size_t size = path != NULL ? strlen(path) + 1 : 0;
+    for (char **a = argv; *a != NULL; a++) {
+        size += strlen(*a) + 1;
+        req.argc++;
+    }
+    for (char **e = envp; req.has_env && *e != NULL; e++) {
+        size += strlen(*e) + 1;
+        req.envc++;
+    }
+    if (size > UINT32_MAX || reserve(size) != 0) {
+        fprintf(stderr, "fork server: request too large\n");
+        return -1;
+    }
+    req.size = size;
+    char *pos = buf;
+    if (path != NULL) {
+        pos = stpcpy(pos, path) + 1;
+    }
+    for (char **a = argv; *a != NULL; a++) {
+        pos = stpcpy(pos, *a) + 1;
+    }
+    for (char **e = envp; req.has_env && *e != NULL; e++) {
+        pos = stpcpy(pos, *e) + 1;
+    }
+
+    int cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd == -1) {
+        perror("open .");
+        return -1;
+    }
+    int all_fds[NUM_FDS] = {fds[0], fds[1], fds[2], cwd};
+    char control[CMSG_SPACE(sizeof(all_fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { .iov_base = &req, .iov_len = sizeof(req) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(all_fds));
+    memcpy(CMSG_DATA(cmsg), all_fds, sizeof(all_fds));
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n == -1 && errno == EINTR);
+    close(cwd);
+    int32_t reply;
+    if (n == -1 || ((size_t) n < sizeof(req) && write_full(sock, (char *) &req + n, sizeof(req) - n) != 0) ||
+        write_full(sock, buf, size) != 0 || read_full(sock, &reply, sizeof(reply)) != 0) {
+        fprintf(stderr, "fork server: %s\n", n == -1 ? strerror(errno) : "helper exited");
+        return -1;
+    }
+    if (req.has_env) {
+        sent_env = 1;
+        sent_generation = vars_envp_generation();
+    }
+    if (reply < 0) {
+        fprintf(stderr, "fork server: %s\n", strerror(-reply));
+        return -1;
+    }
+    return reply;
+}
+
+void forkserver_stop(void) {
+    if (sock == -1) {
+        return;
+    }
+    close(sock);  // the helper sees end of file and exits
+    sock = -1;
+    waitpid(server_pid, NULL, 0);
+    server_pid = -1;
+    free(buf);
+    buf = NULL;
+    buf_cap = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef FORKSERVER_H
+#define FORKSERVER_H
+#include <sys/types.h>
+
+#include "job_opts.h"
+
+/*
+ * Fork server: a helper process, forked from the shell at startup while its
+ * memory is still small, that starts commands on the shell's behalf
+ * The shell sends each request over a Unix socket: the argv, the resolved
+ * path, the process group to join, job options, and the environment when it
+ * changed since the last request. The descriptors for stdin, stdout and stderr
+ * and the current directory go along as SCM_RIGHTS. The helper starts the
+ * command with clone(CLONE_PARENT), so its cost depends on the helper's
+ * small image rather than the shell's, and the new process is a child of the
+ * shell: waitpid(), WUNTRACED stops, SIGCHLD and job control work as for
+ * children the shell forks itself.
+ */
+
+/*
+ * Start the helper
+ * Returns 0 on success or -1 on error (the shell should launch commands
+ * itself)
+ */
+int forkserver_start(void);
+
+/*
+ * Start a command through the helper
+ * path: The program's path, or NULL to search PATH for argv[0]
+ * argv: NULL-terminated arguments
+ * fds: Descriptors for the child's stdin, stdout and stderr
+ * pgid: Process group to join, or 0 to lead a new one
+ * foreground: Nonzero to make the child's process group the terminal's
+ *             foreground group before exec(), so it cannot read the terminal
+ *             (and be stopped by SIGTTIN) before the shell gets to tcsetpgrp()
+ * opts: Job options to apply in the child (see job_opts.h), or NULL
+ * Returns the child's process ID, or -1 on error (reported)
+ */
+pid_t forkserver_spawn(const char *path, char **argv, const int fds[3], pid_t pgid, int foreground,
+                       const job_opts_t *opts);
+
+/*
+ * Stop the helper
+ */
+void forkserver_stop(void);
+
+#endif // FORKSERVER_H
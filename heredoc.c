@@ -0,0 +1,239 @@
+#define _GNU_SOURCE  // memfd_create(), pipe2()
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "heredoc.h"
+#include "reader.h"
+#include "string_vector.h"
+#include "trace.h"
+
+static strvec_t scratch;  // The command line being rewritten
+static int scratch_ready = 0;
+
+static int *fds = NULL;  // Descriptors opened for the current command line
+static unsigned num_fds = 0;
+static unsigned fds_cap = 0;
+
+static char *body = NULL;  // Contents of the here-document being read
+static size_t body_len = 0;
+static size_t body_cap = 0;
+
+static int append(const char *s, size_t len) {
+    if (body_len + len > body_cap) {
+        size_t new_cap = body_cap == 0 ? 256 : body_cap;
+        while (new_cap < body_len + len) {
+            new_cap *= 2;
+        }
+        char *new_body = realloc(body, new_cap);
+        if (new_body == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        body = new_body;
+        body_cap = new_cap;
+    }
+    memcpy(body + body_len, s, len);
+    body_len += len;
+    return 0;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Make room for one more descriptor in 'fds'
+static int reserve_fd(void) {
+    if (num_fds == fds_cap) {
+        unsigned new_cap = fds_cap == 0 ? 4 : fds_cap * 2;
+        int *new_fds = realloc(fds, new_cap * sizeof(int));
+        if (new_fds == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        fds = new_fds;
+        fds_cap = new_cap;
+    }
+    return 0;
+}
+
+// Put 'body' in a pipe or a memfd and return a descriptor to read it from, or -1
+static int store_body(void) {
+    if (reserve_fd() != 0) {
+        return -1;
+    }
+
+    int fd;
+    if (body_len <= HEREDOC_PIPE_MAX) {
+        int pipe_fds[2];
+        if (pipe2(pipe_fds, O_CLOEXEC) == -1) {
+            perror("pipe");
+            return -1;
+        }
+        if (write_all(pipe_fds[1], body, body_len) != 0) {
+            perror("write");
+            close(pipe_fds[0]);
+            close(pipe_fds[1]);
+            return -1;
+        }
+        close(pipe_fds[1]);  // readers see end of file after the contents
+        fd = pipe_fds[0];
+    } else {
+        if ((fd = memfd_create("heredoc", MFD_CLOEXEC)) == -1) {
+            perror("memfd_create");
+            return -1;
+        }
+        if (write_all(fd, body, body_len) != 0 || lseek(fd, 0, SEEK_SET) == -1) {
+            perror("write");
+            close(fd);
+            return -1;
+        }
+    }
+    fds[num_fds++] = fd;
+    return fd;
+}
+
+// Remove matching quotes around a here-document's delimiter
+static const char *unquote(char *word) {
+    size_t len = strlen(word);
+    if (len >= 2 && (word[0] == '\'' || word[0] == '"') && word[len - 1] == word[0]) {
+        word[len - 1] = '\0';
+        return word + 1;
+    }
+    return word;
+}
+
+// Read lines into 'body' up to a line equal to 'delimiter' or the end of input
+static int read_body(reader_t *input, const char *delimiter, int strip_tabs, int prompt) {
+    char *line;
+    ssize_t len;
+    while (1) {
+        if (prompt) {
+            printf("> ");
+            fflush(stdout);
+        }
+        if ((len = reader_next(input, &line)) == -1) {
+            fprintf(stderr, "swish: warning: here-document delimited by end-of-file (wanted '%s')\n",
+                    delimiter);
+            return 0;
+        }
+        while (strip_tabs && *line == '\t') {
+            line++;
+            len--;
+        }
+        if (strcmp(line, delimiter) == 0) {
+            return 0;
+        }
+        if (append(line, len) != 0 || append("\n", 1) != 0) {
+            return -1;
+        }
+    }
+}
+
+int heredoc_collect(strvec_t *tokens, reader_t *input, int prompt) {
+    // Most lines have none: look before copying anything
+    unsigned i = 0;
+    while (i < tokens->length && strncmp(strvec_get(tokens, i), HEREDOC_OPERATOR, 2) != 0) {
+        i++;
+    }
+    if (i == tokens->length) {
+        return 0;
+    }
+
+    uint64_t trace_start = TRACE_CLOCK();
+    if (!scratch_ready) {
+        if (strvec_init_arena(&scratch) != 0) {
+            perror("strvec_init_arena");
+            return -1;
+        }
+        scratch_ready = 1;
+    }
+    strvec_clear(&scratch);
+    for (i = 0; i < tokens->length; i++) {
+        char *token = strvec_get(tokens, i);
+        if (strncmp(token, HEREDOC_OPERATOR, 2) != 0) {
+            if (strvec_add(&scratch, token) != 0) {
+                perror("strvec_add");
+                return -1;
+            }
+            continue;
+        }
+        int is_string = strncmp(token, HERESTRING_OPERATOR, 3) == 0;
+        int strip_tabs = !is_string && strncmp(token, HEREDOC_STRIP_OPERATOR, 3) == 0;
+        char *word = token + (is_string || strip_tabs ? 3 : 2);
+        if (*word == '\0' && (word = strvec_get(tokens, ++i)) == NULL) {
+            fprintf(stderr, "No word specified after \"%s\"\n", token);
+            return -1;
+        }
+
+        body_len = 0;
+        if (is_string) {
+            if (append(word, strlen(word)) != 0 || append("\n", 1) != 0) {
+                return -1;
+            }
+        } else if (read_body(input, unquote(word), strip_tabs, prompt) != 0) {
+            return -1;
+        }
+        int fd = store_body();
+        if (fd == -1) {
+            return -1;
+        }
+        char fd_str[16];
+        snprintf(fd_str, sizeof(fd_str), "%d", fd);
+        if (strvec_add(&scratch, DUP_INPUT_OPERATOR) != 0 || strvec_add(&scratch, fd_str) != 0) {
+            perror("strvec_add");
+            return -1;
+        }
+    }
+
+    strvec_clear(tokens);
+    for (i = 0; i < scratch.length; i++) {
+        if (strvec_add(tokens, strvec_get(&scratch, i)) != 0) {
+            perror("strvec_add");
+            return -1;
+        }
+    }
+    TRACE_COMPLETE("heredoc", trace_start, 0, strvec_get(tokens, 0));
+    return 0;
+}
+
+int heredoc_keep(int fd) {
+    if (reserve_fd() != 0) {
+        return -1;
+    }
+    fds[num_fds++] = fd;
+    return 0;
+}
+
+void heredoc_close(void) {
+    for (unsigned i = 0; i < num_fds; i++) {
+        close(fds[i]);
+    }
+    num_fds = 0;
+}
+
+void heredoc_free(void) {
+    heredoc_close();
+    free(fds);
+    fds = NULL;
+    fds_cap = 0;
+    free(body);
+    body = NULL;
+    body_len = 0;
+    body_cap = 0;
+    if (scratch_ready) {
+        strvec_free(&scratch);
+        scratch_ready = 0;
+    }
+}
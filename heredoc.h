@@ -0,0 +1,52 @@
+#ifndef HEREDOC_H
+#define HEREDOC_H
+
+#include "reader.h"
+#include "string_vector.h"
+
+#define HEREDOC_OPERATOR "<<"
+#define HEREDOC_STRIP_OPERATOR "<<-"
+#define HERESTRING_OPERATOR "<<<"
+#define DUP_INPUT_OPERATOR "<&"
+
+// Contents up to this size go into a pipe, which a single write() fills
+// without blocking; larger ones go into a memfd
+#define HEREDOC_PIPE_MAX 4096
+
+/*
+ * Read the here-documents and here-strings of a command line and replace each
+ * with a "<& fd" redirection from a descriptor holding its contents
+ *   cmd <<WORD     The following lines of input up to a line equal to WORD
+ *   cmd <<-WORD    The same, with leading tabs removed from each line
+ *   cmd <<< word   'word' followed by a newline
+ * The operator and its word may also be separate tokens ("<< WORD"), and WORD
+ * may be quoted. Contents are kept in memory (a pipe or a memfd_create()
+ * file), never in a file on disk. The descriptors stay open until
+ * heredoc_close() and are not inherited by children.
+ * tokens: Tokens of the command line, rewritten in place
+ * input: Reader that the lines of here-documents are read from
+ * prompt: Nonzero to print "> " before each line of a here-document
+ * Returns 0 on success or -1 on error
+ */
+int heredoc_collect(strvec_t *tokens, reader_t *input, int prompt);
+
+/*
+ * Keep 'fd' open until heredoc_close(), like the descriptors opened by
+ * heredoc_collect() (e.g., the output of a builtin that a pipeline reads)
+ * Returns 0 on success or -1 on error ('fd' is then left open)
+ */
+int heredoc_keep(int fd);
+
+/*
+ * Close the descriptors opened by heredoc_collect() or kept by heredoc_keep()
+ * for the last command line
+ * Commands already started keep their own copies.
+ */
+void heredoc_close(void);
+
+/*
+ * Close any open descriptors and release the memory used for here-documents
+ */
+void heredoc_free(void);
+
+#endif // HEREDOC_H
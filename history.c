@@ -0,0 +1,417 @@
+#define _GNU_SOURCE  // mremap(), memmem()
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "vars.h"
+
+#define HISTORY_FILE ".swish_history"  // In $HOME
+#define INITIAL_ENTRIES 1024
+#define INITIAL_INDEX_SIZE 4096  // Must be a power of 2
+#define INITIAL_POSTINGS 4
+#define TRIGRAM(s) (((uint32_t) (unsigned char) (s)[0] << 16) | \
+                    ((uint32_t) (unsigned char) (s)[1] << 8) | (unsigned char) (s)[2])
+
+// Entries whose lines contain one trigram, in increasing order
+typedef struct {
+    uint32_t trigram;
+    uint32_t *ids;      // NULL for an empty slot
+    uint32_t len;
+    uint32_t cap;
+} posting_t;
+
+static int hist_fd = -1;
+static char *map = NULL;         // The history file, mapped read-only
+static size_t map_len = 0;
+static size_t scanned = 0;       // Bytes of 'map' already split into entries
+
+static size_t *offsets = NULL;   // Where each entry's record starts in 'map'
+static long num_entries = 0;
+static long offsets_cap = 0;
+
+static posting_t *index_table = NULL;  // Trigram index, NULL until the first search
+static unsigned index_size = 0;  // Number of slots in 'index_table'
+static unsigned index_used = 0;  // Number of trigrams in 'index_table'
+
+static char *pending = NULL;     // Line passed to history_start()
+static size_t pending_cap = 0;
+static int has_pending = 0;
+static char pending_cwd[PATH_MAX];  // Directory the pending line runs in
+static char *record = NULL;      // Record being written by history_finish()
+static size_t record_cap = 0;
+
+// Parse the record from 'start' to the '\n' at 'end': "time\tstatus\tcwd\tline"
+// Returns 0 on success or -1 if the record is malformed
+static int parse_record(const char *start, const char *end, history_entry_t *entry) {
+    const char *tab1 = memchr(start, '\t', end - start);
+    const char *tab2 = tab1 == NULL ? NULL : memchr(tab1 + 1, '\t', end - tab1 - 1);
+    const char *tab3 = tab2 == NULL ? NULL : memchr(tab2 + 1, '\t', end - tab2 - 1);
+    if (tab3 == NULL) {
+        return -1;
+    }
+    entry->time = strtoll(start, NULL, 10);  // stops at the tab
+    entry->status = atoi(tab1 + 1);
+    entry->cwd = tab2 + 1;
+    entry->cwd_len = tab3 - tab2 - 1;
+    entry->line = tab3 + 1;
+    entry->line_len = end - tab3 - 1;
+    return 0;
+}
+
+// FNV-1a
+static unsigned hash_trigram(uint32_t trigram) {
+    unsigned h = 2166136261u;
+    for (int shift = 16; shift >= 0; shift -= 8) {
+        h ^= (trigram >> shift) & 0xff;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Returns the slot holding 'trigram', or the empty slot where it would be inserted
+static unsigned find_slot(uint32_t trigram) {
+    unsigned mask = index_size - 1;
+    unsigned i = hash_trigram(trigram) & mask;
+    while (index_table[i].ids != NULL && index_table[i].trigram != trigram) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int grow_index(void) {
+    unsigned new_size = index_size == 0 ? INITIAL_INDEX_SIZE : index_size * 2;
+    posting_t *new_table = calloc(new_size, sizeof(posting_t));
+    if (new_table == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    posting_t *old_table = index_table;
+    unsigned old_size = index_size;
+    index_table = new_table;
+    index_size = new_size;
+    for (unsigned i = 0; i < old_size; i++) {
+        if (old_table[i].ids != NULL) {
+            index_table[find_slot(old_table[i].trigram)] = old_table[i];
+        }
+    }
+    free(old_table);
+    return 0;
+}
+
+// Add entry 'id' to the posting list of every trigram of its line
+static int index_entry(uint32_t id, const char *line, size_t len) {
+    for (size_t i = 0; i + 3 <= len; i++) {
+        if ((index_used + 1) * 10 > index_size * 7 && grow_index() != 0) {  // keep load factor <= 0.7
+            return -1;
+        }
+        posting_t *posting = &index_table[find_slot(TRIGRAM(line + i))];
+        if (posting->ids == NULL) {
+            if ((posting->ids = malloc(INITIAL_POSTINGS * sizeof(uint32_t))) == NULL) {
+                perror("malloc");
+                return -1;
+            }
+            posting->trigram = TRIGRAM(line + i);
+            posting->len = 0;
+            posting->cap = INITIAL_POSTINGS;
+            index_used++;
+        } else if (posting->ids[posting->len - 1] == id) {  // trigram repeated in the line
+            continue;
+        } else if (posting->len == posting->cap) {
+            uint32_t *new_ids = realloc(posting->ids, 2 * posting->cap * sizeof(uint32_t));
+            if (new_ids == NULL) {
+                perror("realloc");
+                return -1;
+            }
+            posting->ids = new_ids;
+            posting->cap *= 2;
+        }
+        posting->ids[posting->len++] = id;
+    }
+    return 0;
+}
+
+static void free_index(void) {
+    for (unsigned i = 0; i < index_size; i++) {
+        free(index_table[i].ids);
+    }
+    free(index_table);
+    index_table = NULL;
+    index_size = 0;
+    index_used = 0;
+}
+
+// Index every entry found so far; later entries are indexed as they are found
+static int build_index(void) {
+    if (grow_index() != 0) {
+        return -1;
+    }
+    history_entry_t entry;
+    for (long i = 0; i < num_entries; i++) {
+        if (history_get(i, &entry) == 0 && index_entry(i, entry.line, entry.line_len) != 0) {
+            free_index();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Map the whole history file, following it as other shells append to it
+static int remap(void) {
+    struct stat st;
+    if (fstat(hist_fd, &st) == -1) {
+        perror("fstat");
+        return -1;
+    }
+    size_t size = st.st_size;
+    if (size < map_len) {  // truncated: start over
+        munmap(map, map_len);
+        map = NULL;
+        map_len = 0;
+        scanned = 0;
+        num_entries = 0;
+        free_index();
+    }
+    if (size == map_len) {
+        return 0;
+    }
+    char *new_map;
+    if (map == NULL) {
+        new_map = mmap(NULL, size, PROT_READ, MAP_SHARED, hist_fd, 0);
+    } else {
+        new_map = mremap(map, map_len, size, MREMAP_MAYMOVE);
+    }
+    if (new_map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    map = new_map;
+    map_len = size;
+    return 0;
+}
+
+// Locate the records added to the file since the last call
+static int sync_entries(void) {
+    if (hist_fd == -1 || remap() != 0) {
+        return -1;
+    }
+    history_entry_t entry;
+    char *end;
+    // A record without its '\n' is still being written and is left for later
+    while (scanned < map_len && (end = memchr(map + scanned, '\n', map_len - scanned)) != NULL) {
+        size_t start = scanned;
+        if (parse_record(map + start, end, &entry) != 0) {
+            scanned = end + 1 - map;
+            continue;
+        }
+        if (num_entries == offsets_cap) {
+            long new_cap = offsets_cap == 0 ? INITIAL_ENTRIES : offsets_cap * 2;
+            size_t *new_offsets = realloc(offsets, new_cap * sizeof(size_t));
+            if (new_offsets == NULL) {
+                perror("realloc");
+                return -1;
+            }
+            offsets = new_offsets;
+            offsets_cap = new_cap;
+        }
+        offsets[num_entries] = start;
+        if (index_table != NULL && index_entry(num_entries, entry.line, entry.line_len) != 0) {
+            free_index();  // searches fall back to scanning
+        }
+        num_entries++;
+        scanned = end + 1 - map;
+    }
+    return 0;
+}
+
+int history_init(int interactive) {
+    const char *file = vars_get("SWISH_HISTFILE");
+    char path[PATH_MAX];
+    if (file == NULL) {
+        const char *home = vars_get("HOME");
+        if (!interactive || home == NULL) {
+            return 0;
+        }
+        snprintf(path, sizeof(path), "%s/%s", home, HISTORY_FILE);
+        file = path;
+    }
+    if (file[0] == '\0') {
+        return 0;
+    }
+    if ((hist_fd = open(file, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600)) == -1) {
+        perror(file);
+        return -1;
+    }
+    // Only map the file here: its records are located on first use
+    if (remap() != 0) {
+        close(hist_fd);
+        hist_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void history_free(void) {
+    if (map != NULL) {
+        munmap(map, map_len);
+    }
+    map = NULL;
+    map_len = 0;
+    scanned = 0;
+    if (hist_fd != -1) {
+        close(hist_fd);
+        hist_fd = -1;
+    }
+    free(offsets);
+    offsets = NULL;
+    num_entries = 0;
+    offsets_cap = 0;
+    free_index();
+    free(pending);
+    pending = NULL;
+    pending_cap = 0;
+    has_pending = 0;
+    free(record);
+    record = NULL;
+    record_cap = 0;
+}
+
+void history_start(const char *line) {
+    has_pending = 0;
+    size_t len = strlen(line);
+    if (hist_fd == -1 || len == 0 || line[0] == ' ') {
+        return;
+    }
+    if (len + 1 > pending_cap) {
+        char *new_pending = realloc(pending, len + 1);
+        if (new_pending == NULL) {
+            perror("realloc");
+            return;
+        }
+        pending = new_pending;
+        pending_cap = len + 1;
+    }
+    memcpy(pending, line, len + 1);
+    has_pending = 1;
+    if (getcwd(pending_cwd, sizeof(pending_cwd)) == NULL) {
+        strcpy(pending_cwd, "?");
+    }
+    for (char *c = pending_cwd; *c != '\0'; c++) {  // keep the record's fields and lines apart
+        if (*c == '\t' || *c == '\n') {
+            *c = '?';
+        }
+    }
+}
+
+void history_finish(int status) {
+    if (!has_pending) {
+        return;
+    }
+    has_pending = 0;
+    size_t line_len = strlen(pending);
+    size_t needed = 64 + strlen(pending_cwd) + line_len;
+    if (needed > record_cap) {
+        char *new_record = realloc(record, needed);
+        if (new_record == NULL) {
+            perror("realloc");
+            return;
+        }
+        record = new_record;
+        record_cap = needed;
+    }
+    size_t len = snprintf(record, record_cap, "%lld\t%d\t%s\t", (long long) time(NULL), status,
+                          pending_cwd);
+    memcpy(record + len, pending, line_len);
+    len += line_len;
+    record[len++] = '\n';
+    // O_APPEND puts the whole record at the end of the file, after the
+    // records of any other shell, without a lock
+    for (size_t written = 0; written < len;) {
+        ssize_t n = write(hist_fd, record + written, len - written);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1) {
+            perror("write");
+            return;
+        }
+        written += n;
+    }
+}
+
+long history_length(void) {
+    sync_entries();
+    return num_entries;
+}
+
+int history_get(long i, history_entry_t *entry) {
+    if (i < 0 || i >= num_entries) {
+        return -1;
+    }
+    const char *start = map + offsets[i];
+    const char *end = memchr(start, '\n', map_len - offsets[i]);
+    return parse_record(start, end, entry);
+}
+
+// Nonzero if the line of entry 'i' contains 'text'
+static int entry_contains(long i, const char *text, size_t text_len) {
+    history_entry_t entry;
+    return history_get(i, &entry) == 0 && memmem(entry.line, entry.line_len, text, text_len) != NULL;
+}
+
+long history_search(const char *text, long before) {
+    if (sync_entries() != 0) {
+        return -1;
+    }
+    if (before > num_entries) {
+        before = num_entries;
+    }
+    size_t text_len = strlen(text);
+    if (text_len >= 3 && index_table == NULL) {
+        build_index();
+    }
+    if (text_len < 3 || index_table == NULL) {  // nothing to look up: check every line
+        for (long i = before - 1; i >= 0; i--) {
+            if (entry_contains(i, text, text_len)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // Only entries holding every trigram of 'text' can match: walk the shortest list
+    posting_t *shortest = NULL;
+    for (size_t i = 0; i + 3 <= text_len; i++) {
+        posting_t *posting = &index_table[find_slot(TRIGRAM(text + i))];
+        if (posting->ids == NULL) {
+            return -1;
+        }
+        if (shortest == NULL || posting->len < shortest->len) {
+            shortest = posting;
+        }
+    }
+    // Binary search for the first entry not before 'before'
+    uint32_t lo = 0;
+    uint32_t hi = shortest->len;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (shortest->ids[mid] < before) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    while (lo > 0) {
+        long id = shortest->ids[--lo];
+        if (entry_contains(id, text, text_len)) {
+            return id;
+        }
+    }
+    return -1;
+}
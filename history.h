@@ -0,0 +1,77 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+#include <stddef.h>
+#include <time.h>
+
+/*
+ * Command history kept in an append-only log file
+ * Each line the shell runs is appended as one record holding the time, the
+ * exit status, the working directory and the line itself. Every record goes
+ * out in a single write() on a descriptor opened with O_APPEND, so several
+ * shells can share one file without locking: their records interleave but
+ * never mix. The file is mmap()'d, and records are only located when they
+ * are first needed, so starting the shell costs the same however long the
+ * history is. Records appended by other shells show up as the file grows.
+ * Searches use an index of the three-byte substrings (trigrams) of every
+ * line, built on the first search and then kept up to date, so a search
+ * only looks at lines holding every trigram of the text searched for.
+ */
+
+typedef struct {
+    time_t time;        // When the line finished running
+    int status;         // Its exit status
+    const char *cwd;    // The working directory it ran in (not NUL-terminated)
+    size_t cwd_len;
+    const char *line;   // The command line (not NUL-terminated)
+    size_t line_len;
+} history_entry_t;
+
+/*
+ * Open (creating it if needed) and map the history file: $SWISH_HISTFILE,
+ * or ~/.swish_history in an interactive shell. A shell that is not
+ * interactive keeps no history unless SWISH_HISTFILE is set, and setting it
+ * to an empty string turns history off.
+ * interactive: Nonzero if the shell reads commands from a terminal
+ * Returns 0 on success (including when history is off) or -1 on error
+ */
+int history_init(int interactive);
+
+/*
+ * Unmap and close the history file and release the index
+ */
+void history_free(void);
+
+/*
+ * Remember the line about to run; it is written out by history_finish()
+ * Empty lines and lines starting with a space are not kept.
+ */
+void history_start(const char *line);
+
+/*
+ * Append the line given to history_start() (if any) with its exit status
+ */
+void history_finish(int status);
+
+/*
+ * Number of entries in the history, including those appended by other shells
+ */
+long history_length(void);
+
+/*
+ * Get entry 'i' (0 is the oldest)
+ * Returns 0 on success or -1 if there is no such entry
+ * Note: The pointers in 'entry' are valid until the next call into this module
+ */
+int history_get(long i, history_entry_t *entry);
+
+/*
+ * Reverse search: find the most recent entry before entry 'before' whose
+ * line contains 'text'. Calling it again with the index it returned finds
+ * the next older match, as in an incremental search.
+ * text: The text to look for (at least three bytes to use the index)
+ * before: Index one past the newest entry to consider (history_length() for all)
+ * Returns the index of the entry or -1 if no entry matches
+ */
+long history_search(const char *text, long before);
+
+#endif // HISTORY_H
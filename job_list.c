@@ -1,111 +1,301 @@
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include "job_list.h"
 
+#define NO_JOB ((unsigned) -1)   // End of the free slot chain
+#define INITIAL_SLOTS 8
+#define INITIAL_INDEX_SIZE 16    // Must be a power of 2
+
+// Fibonacci hashing: multiply by 2^32 / phi and keep the top 'bits' bits of
+// the product, which depend on every bit of the pid (its low bits only depend
+// on the low bits of the pid). Consecutive pids are spread over the table
+// about 0.618 of its size apart, instead of filling one run of slots.
+static unsigned hash_pid(pid_t pid, unsigned bits) {
+    return (uint32_t) ((uint32_t) pid * 2654435761u) >> (32 - bits);
+}
+
+// Returns the slot holding 'pid', or the empty slot where it would be inserted
+static unsigned index_find(const job_list_t *list, pid_t pid) {
+    unsigned mask = list->index_size - 1;
+    unsigned i = hash_pid(pid, list->index_bits);
+    while (list->index[i].pid != 0 && list->index[i].pid != pid) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int index_grow(job_list_t *list) {
+    unsigned new_size = list->index_size == 0 ? INITIAL_INDEX_SIZE : list->index_size * 2;
+    pid_entry_t *new_index = calloc(new_size, sizeof(pid_entry_t));
+    if (new_index == NULL) {
+        return -1;
+    }
+    pid_entry_t *old_index = list->index;
+    unsigned old_size = list->index_size;
+    list->index = new_index;
+    list->index_size = new_size;
+    list->index_bits = 0;
+    while ((1u << list->index_bits) < new_size) {
+        list->index_bits++;
+    }
+    for (unsigned i = 0; i < old_size; i++) {
+        if (old_index[i].pid != 0) {
+            list->index[index_find(list, old_index[i].pid)] = old_index[i];
+        }
+    }
+    free(old_index);
+    return 0;
+}
+
+static int index_insert(job_list_t *list, pid_t pid, unsigned id) {
+    if ((list->index_used + 1) * 2 > list->index_size) {  // keep load factor <= 0.5
+        if (index_grow(list) != 0) {
+            return -1;
+        }
+    }
+    unsigned i = index_find(list, pid);
+    if (list->index[i].pid == 0) {
+        list->index_used++;
+    }
+    list->index[i].pid = pid;
+    list->index[i].id = id;
+    return 0;
+}
+
+// Linear probing removal by shifting later entries of the cluster back. The
+// entry is only removed if it still maps to 'id' (the pid may have been reused).
+static void index_remove(job_list_t *list, pid_t pid, unsigned id) {
+    if (list->index_size == 0) {
+        return;
+    }
+    unsigned mask = list->index_size - 1;
+    unsigned i = index_find(list, pid);
+    if (list->index[i].pid == 0 || list->index[i].id != id) {
+        return;
+    }
+    list->index[i].pid = 0;
+    list->index_used--;
+    unsigned j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (list->index[j].pid == 0) {
+            return;
+        }
+        unsigned home = hash_pid(list->index[j].pid, list->index_bits);
+        // Move the entry back if its home slot is not within (i, j]
+        if ((i <= j) ? (home <= i || home > j) : (home <= i && home > j)) {
+            list->index[i] = list->index[j];
+            list->index[j].pid = 0;
+            i = j;
+        }
+    }
+}
+
+// Returns a free job ID, growing the slot array if needed, or NO_JOB on error
+static unsigned take_slot(job_list_t *list) {
+    if (list->free_head != NO_JOB) {
+        unsigned id = list->free_head;
+        list->free_head = list->slots[id].id;
+        return id;
+    }
+    if (list->end == list->capacity) {
+        unsigned new_capacity = list->capacity == 0 ? INITIAL_SLOTS : list->capacity * 2;
+        job_t *new_slots = realloc(list->slots, new_capacity * sizeof(job_t));
+        if (new_slots == NULL) {
+            return NO_JOB;
+        }
+        for (unsigned i = list->capacity; i < new_capacity; i++) {
+            new_slots[i].pids = NULL;
+        }
+        list->slots = new_slots;
+        list->capacity = new_capacity;
+    }
+    return list->end++;
+}
+
+static void release_slot(job_list_t *list, unsigned id) {
+    job_t *job = &list->slots[id];
+    for (unsigned i = 0; i < job->pids_len; i++) {
+        index_remove(list, job->pids[i], id);
+    }
+    free(job->pids);
+    job->pids = NULL;
+    job->id = list->free_head;
+    list->free_head = id;
+    list->length--;
+    if (list->length == 0) {  // start numbering from 0 again, as other shells do
+        list->end = 0;
+        list->free_head = NO_JOB;
+    }
+}
+
 void job_list_init(job_list_t *list) {
-    list->head = NULL;
+    list->slots = NULL;
+    list->capacity = 0;
+    list->end = 0;
+    list->free_head = NO_JOB;
     list->length = 0;
+    list->index = NULL;
+    list->index_size = 0;
+    list->index_bits = 0;
+    list->index_used = 0;
 }
 
 void job_list_free(job_list_t *list) {
-    job_t *current = list->head;
-    while (current != NULL) {
-        job_t *temp = current;
-        current = current->next;
-        free(temp);
+    for (unsigned i = 0; i < list->end; i++) {
+        free(list->slots[i].pids);
     }
-    list->head = NULL;
-    list->length = 0;
+    free(list->slots);
+    free(list->index);
+    job_list_init(list);
 }
 
 int job_list_add(job_list_t *list, pid_t pid, const char *name, int status) {
-    if (list->head == NULL) {
-        if ((list->head = malloc(sizeof(job_t))) == NULL) {
+    job_t job;
+    if ((job.pids = malloc(sizeof(pid_t))) == NULL) {
+        return -1;
+    }
+    strncpy(job.name, name, NAME_LEN);
+    job.pid = pid;
+    job.pids[0] = pid;
+    job.num_pids = 1;
+    job.last_pid = pid;
+    job.exit_status = 0;
+    job.timed_out = 0;
+    job.status = status;
+    clock_gettime(CLOCK_MONOTONIC, &job.started);
+    memset(&job.usage, 0, sizeof(job.usage));
+    if (job_list_add_job(list, &job) == -1) {
+        free(job.pids);
+        return -1;
+    }
+    return 0;
+}
+
+int job_list_add_job(job_list_t *list, const job_t *job) {
+    unsigned id = take_slot(list);
+    if (id == NO_JOB) {
+        return -1;
+    }
+    job_t *new_job = &list->slots[id];
+    *new_job = *job;
+    new_job->name[NAME_LEN - 1] = '\0';
+    new_job->notify = 0;
+    new_job->id = id;
+    new_job->pids_len = job->num_pids;  // processes that already exited are not tracked
+    list->length++;
+    for (unsigned i = 0; i < new_job->pids_len; i++) {
+        if (index_insert(list, new_job->pids[i], id) != 0) {
+            new_job->pids_len = i;
+            new_job->pids = NULL;  // the caller keeps ownership on failure
+            for (unsigned j = 0; j < i; j++) {
+                index_remove(list, job->pids[j], id);
+            }
+            new_job->id = list->free_head;
+            list->free_head = id;
+            list->length--;
             return -1;
         }
-        strncpy(list->head->name, name, NAME_LEN);
-        list->head->pid = pid;
-        list->head->status = status;
-        list->head->next = NULL;
-        list->length = 1;
-        return 0;
     }
+    return id;
+}
 
-    job_t *current = list->head;
-    while (current->next != NULL) {
-        current = current->next;
+int job_remove_pid(job_t *job, pid_t pid) {
+    for (unsigned i = 0; i < job->num_pids; i++) {
+        if (job->pids[i] == pid) {
+            // Keep the exited pid after the live ones so it can be unindexed later
+            job->pids[i] = job->pids[job->num_pids - 1];
+            job->pids[job->num_pids - 1] = pid;
+            job->num_pids--;
+            if (job->num_pids == 0) {
+                clock_gettime(CLOCK_MONOTONIC, &job->finished);
+            }
+            return job->num_pids;
+        }
     }
-    if ((current->next = malloc(sizeof(job_t))) == NULL) {
-        return -1;
+    return -1;
+}
+
+static void add_time(struct timeval *total, const struct timeval *t) {
+    total->tv_sec += t->tv_sec;
+    total->tv_usec += t->tv_usec;
+    if (total->tv_usec >= 1000000) {
+        total->tv_sec++;
+        total->tv_usec -= 1000000;
     }
-    strncpy(current->next->name, name, NAME_LEN);
-    current->next->next = NULL;
-    current->next->pid = pid;
-    current->next->status = status;
-    list->length++;
-    return 0;
+}
+
+void job_add_usage(job_t *job, const struct rusage *usage) {
+    add_time(&job->usage.ru_utime, &usage->ru_utime);
+    add_time(&job->usage.ru_stime, &usage->ru_stime);
+    if (usage->ru_maxrss > job->usage.ru_maxrss) {
+        job->usage.ru_maxrss = usage->ru_maxrss;
+    }
+    job->usage.ru_minflt += usage->ru_minflt;
+    job->usage.ru_majflt += usage->ru_majflt;
+    job->usage.ru_nvcsw += usage->ru_nvcsw;
+    job->usage.ru_nivcsw += usage->ru_nivcsw;
+}
+
+double job_elapsed(const job_t *job) {
+    struct timespec end = job->finished;
+    if (job->num_pids > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+    }
+    return (end.tv_sec - job->started.tv_sec) + (end.tv_nsec - job->started.tv_nsec) / 1e9;
 }
 
 job_t *job_list_get(job_list_t *list, unsigned idx) {
-    if (idx >= list->length) {
+    if (idx >= list->end || list->slots[idx].pids == NULL) {
+        return NULL;
+    }
+    return &list->slots[idx];
+}
+
+job_t *job_list_find_pid(job_list_t *list, pid_t pid) {
+    if (list->index_size == 0 || pid <= 0) {
+        return NULL;
+    }
+    pid_entry_t *entry = &list->index[index_find(list, pid)];
+    if (entry->pid == 0) {
         return NULL;
     }
+    job_t *job = &list->slots[entry->id];
+    for (unsigned i = 0; i < job->num_pids; i++) {  // ignore processes that already exited
+        if (job->pids[i] == pid) {
+            return job;
+        }
+    }
+    return NULL;
+}
 
-    job_t *current = list->head;
-    for (int i = 0; i < idx; i++) {
-        if (current == NULL) {
-            return NULL;
+job_t *job_list_next(job_list_t *list, const job_t *job) {
+    unsigned i = job == NULL ? 0 : (unsigned) (job - list->slots) + 1;
+    for (; i < list->end; i++) {
+        if (list->slots[i].pids != NULL) {
+            return &list->slots[i];
         }
-        current = current->next;
     }
-    return current;
+    return NULL;
 }
 
 int job_list_remove(job_list_t *list, unsigned idx) {
-    if (idx >= list->length) {
+    if (job_list_get(list, idx) == NULL) {
         return -1;
     }
-
-    if (idx == 0) {
-        job_t *temp = list->head;
-        list->head = list->head->next;
-        free(temp);
-        list->length--;
-        return 0;
-    }
-
-    job_t *current = list->head;
-    for (int i = 0; i < idx - 1; i++) {
-        current = current->next;
-    }
-    job_t *temp = current->next;
-    current->next = current->next->next;
-    free(temp);
-    list->length--;
+    release_slot(list, idx);
     return 0;
 }
 
 void job_list_remove_by_status(job_list_t *list, int status) {
-    while (list->head != NULL && list->head->status == status) {
-        job_t *temp = list->head;
-        list->head = list->head->next;
-        list->length--;
-        free(temp);
-    }
-
-    if (list->head != NULL) { // Could have removed all nodes in loop above
-        job_t *current = list->head;
-        while (current->next != NULL) {
-            if (current->next->status == status) {
-                job_t *temp = current->next;
-                current->next = current->next->next;
-                list->length--;
-                free(temp);
-            } else {
-                current = current->next;
-            }
+    for (unsigned i = 0; i < list->end; i++) {
+        if (list->slots[i].pids != NULL && list->slots[i].status == status) {
+            release_slot(list, i);
         }
     }
 }
@@ -1,7 +1,9 @@
 #ifndef JOB_LIST_H
 #define JOB_LIST_H
 #include <stdlib.h>
+#include <sys/resource.h>
 #include <sys/types.h>
+#include <time.h>
 
 #define JOB_STOPPED 0
 #define JOB_BACKGROUND 1
@@ -10,17 +12,42 @@
 typedef struct job {
     char name[NAME_LEN];
     int status;
-    pid_t pid;
-    struct job *next;
+    pid_t pid;          // Process group ID of the job (pid of its first process)
+    pid_t *pids;        // Processes of the job, the first 'num_pids' have not exited yet
+    unsigned num_pids;  // Number of live processes at the start of 'pids'
+    unsigned pids_len;  // Number of entries in 'pids', exited processes included
+    pid_t last_pid;     // Process whose exit status is the job's (last pipeline stage)
+    int exit_status;    // Exit status of 'last_pid' in shell terms (128 + n if killed by signal n)
+    int notify;         // Nonzero if the job finished or stopped in the background and was not reported yet
+    int timed_out;      // Nonzero once the job's deadline passed (see deadline.h)
+    unsigned id;        // Job ID, stable for as long as the job is in the list
+    struct timespec started;   // CLOCK_MONOTONIC time the job was spawned
+    struct timespec finished;  // CLOCK_MONOTONIC time its last process exited (once num_pids is 0)
+    struct rusage usage;       // Resources used by the processes that have exited (see job_add_usage())
 } job_t;
 
 typedef struct {
-    job_t *head;
-    unsigned length;
+    pid_t pid;          // 0 for an empty slot
+    unsigned id;
+} pid_entry_t;
+
+typedef struct {
+    job_t *slots;           // Jobs indexed by ID, a free slot has pids == NULL
+    unsigned capacity;      // Allocated length of 'slots'
+    unsigned end;           // One past the highest ID ever handed out
+    unsigned free_head;     // Most recently freed ID, free slots are chained through 'id'
+    unsigned length;        // Number of jobs in the list
+    pid_entry_t *index;     // Open addressing hash table from process ID to job ID
+    unsigned index_size;    // Number of slots in 'index', a power of 2
+    unsigned index_bits;    // log2(index_size)
+    unsigned index_used;    // Number of entries in 'index'
 } job_list_t;
 
 /*
  * Initialize a new, empty jobs list
+ * Jobs are kept in a slot array: a job's ID is its slot and does not change
+ * when other jobs are removed. Freed IDs are reused, most recently freed first.
+ * Adding, removing and looking up a job by ID or by process ID take O(1) time.
  * list: Pointer to the jobs list to initialize
  */
 void job_list_init(job_list_t *list);
@@ -42,19 +69,71 @@ void job_list_free(job_list_t *list);
  */
 int job_list_add(job_list_t *list, pid_t pid, const char *name, int status);
 
+/*
+ * Add a new job made up of several processes (e.g., the stages of a pipeline)
+ * list: The jobs list to add to
+ * job: The job to add. Its name, status, pid (the process group ID), pids and
+ *      num_pids fields must be set. The list takes ownership of the malloc()'d
+ *      'pids' array, which is freed when the job is removed
+ * Returns the new job's ID on success or -1 on error
+ * Adding a job may move the others in memory, so earlier job_t pointers are invalidated
+ */
+int job_list_add_job(job_list_t *list, const job_t *job);
+
+/*
+ * Record that one of a job's processes has exited
+ * When the last process exits, the job's 'finished' time is set
+ * job: The job owning the process
+ * pid: The process ID that exited
+ * Returns the number of the job's processes still alive, or -1 if 'pid' is not part of the job
+ */
+int job_remove_pid(job_t *job, pid_t pid);
+
+/*
+ * Add the resource usage of one of a job's processes, as returned by wait4(),
+ * to the job's totals: CPU times, context switches and page faults are summed,
+ * and the maximum resident set size is the largest of any process
+ * job: The job owning the process
+ * usage: Resource usage of the process that exited
+ */
+void job_add_usage(job_t *job, const struct rusage *usage);
+
+/*
+ * Wall-clock time a job has been running, in seconds: from its start until
+ * its last process exited, or until now if some are still running
+ */
+double job_elapsed(const job_t *job);
+
 /*
  * Retrieve an element from a jobs list
  * list: Pointer to the jobs list to retrieve from
- * idx: Index of the entry to retrieve
- * Returns a pointer to a job_t (not a copy) on success or NULL on error
+ * idx: ID of the job to retrieve
+ * Returns a pointer to a job_t (not a copy) on success or NULL if there is no such job
  */
 job_t *job_list_get(job_list_t *list, unsigned idx);
 
 /*
- * Removes an element at a specific index from a jobs list
- * The memory for this element is freed
+ * Find the job a live process belongs to
+ * list: Pointer to the jobs list to search
+ * pid: Process ID of any of the job's processes that has not exited yet
+ * Returns a pointer to a job_t (not a copy) or NULL if no job has that process
+ */
+job_t *job_list_find_pid(job_list_t *list, pid_t pid);
+
+/*
+ * Iterate over a jobs list in order of job ID
+ * list: Pointer to the jobs list
+ * job: The job returned by the previous call, or NULL to get the first job
+ * Returns the next job or NULL when there are no more
+ * The current job may be removed before asking for the next one
+ */
+job_t *job_list_next(job_list_t *list, const job_t *job);
+
+/*
+ * Removes an element with a specific ID from a jobs list
+ * The memory for this element is freed and its ID may be reused
  * list: Pointer to the jobs list to remove from
- * idx: Index of the element to remove
+ * idx: ID of the job to remove
  * Returns 0 on success or -1 on error
  */
 int job_list_remove(job_list_t *list, unsigned idx);
@@ -0,0 +1,363 @@
+#define _GNU_SOURCE  // sched_setaffinity(), cpu_set_t
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "job_opts.h"
+#include "string_vector.h"
+
+#define WORD_BITS (sizeof(unsigned long) * CHAR_BIT)
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+#define IO_LEVEL_DEFAULT 4
+
+static job_opts_t defaults;
+static job_opts_t overrides;
+static job_opts_t active;       // 'defaults' with 'overrides' on top
+static unsigned next_cpu = 0;   // Where the search for the next spread CPU starts
+
+static void cpu_add(job_opts_t *opts, unsigned cpu) {
+    opts->cpus[cpu / WORD_BITS] |= 1UL << (cpu % WORD_BITS);
+}
+
+static int cpu_has(const job_opts_t *opts, unsigned cpu) {
+    return (opts->cpus[cpu / WORD_BITS] >> (cpu % WORD_BITS)) & 1;
+}
+
+// Parse a CPU list such as "0-3,6"
+static int parse_cpus(const char *list, job_opts_t *opts) {
+    memset(opts->cpus, 0, sizeof(opts->cpus));
+    const char *c = list;
+    while (1) {
+        char *end;
+        unsigned long first = strtoul(c, &end, 10);
+        unsigned long last = first;
+        if (end == c || first >= JOB_MAX_CPUS) {
+            return -1;
+        }
+        if (*end == '-') {
+            c = end + 1;
+            last = strtoul(c, &end, 10);
+            if (end == c || last >= JOB_MAX_CPUS || last < first) {
+                return -1;
+            }
+        }
+        for (unsigned long cpu = first; cpu <= last; cpu++) {
+            cpu_add(opts, cpu);
+        }
+        if (*end == '\0') {
+            return 0;
+        } else if (*end != ',') {
+            return -1;
+        }
+        c = end + 1;
+    }
+}
+
+// Parse a limit: a number with an optional K, M or G suffix (when 'sizes' is
+// set), or "unlimited"
+static int parse_limit(const char *s, int sizes, rlim_t *limit) {
+    if (strcmp(s, "unlimited") == 0) {
+        *limit = RLIM_INFINITY;
+        return 0;
+    }
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(s, &end, 10);
+    if (end == s || *s == '-' || errno != 0) {
+        return -1;
+    }
+    int shift = 0;
+    if (sizes && *end != '\0' && end[1] == '\0') {
+        const char *suffixes = "KMG";
+        const char *suffix = strchr(suffixes, *end);
+        if (suffix == NULL) {
+            return -1;
+        }
+        shift = 10 * (suffix - suffixes + 1);
+        end++;
+    }
+    if (*end != '\0' || n > (RLIM_INFINITY - 1) >> shift) {
+        return -1;
+    }
+    *limit = (rlim_t) n << shift;
+    return 0;
+}
+
+static int parse_io(const char *s, job_opts_t *opts) {
+    const char *colon = strchr(s, ':');
+    size_t len = colon == NULL ? strlen(s) : (size_t) (colon - s);
+    if ((len == 8 && strncmp(s, "realtime", len) == 0) || (len == 2 && strncmp(s, "rt", len) == 0)) {
+        opts->io_class = JOB_IO_REALTIME;
+    } else if ((len == 11 && strncmp(s, "best-effort", len) == 0) || (len == 2 && strncmp(s, "be", len) == 0)) {
+        opts->io_class = JOB_IO_BEST_EFFORT;
+    } else if (len == 4 && strncmp(s, "idle", len) == 0) {
+        opts->io_class = JOB_IO_IDLE;
+    } else {
+        return -1;
+    }
+    opts->io_level = opts->io_class == JOB_IO_IDLE ? 0 : IO_LEVEL_DEFAULT;
+    if (colon != NULL) {
+        char *end;
+        long level = strtol(colon + 1, &end, 10);
+        if (end == colon + 1 || *end != '\0' || level < 0 || level > 7 || opts->io_class == JOB_IO_IDLE) {
+            return -1;
+        }
+        opts->io_level = level;
+    }
+    return 0;
+}
+
+int job_opts_parse(strvec_t *tokens, unsigned start, job_opts_t *opts) {
+    memset(opts, 0, sizeof(*opts));
+    unsigned i = start;
+    for (; i < tokens->length; i++) {
+        const char *option = strvec_get(tokens, i);
+        if (strcmp(option, "--") == 0) {
+            return i + 1;
+        } else if (strcmp(option, "-r") == 0 || strcmp(option, "-R") == 0) {
+            opts->set |= JOB_OPT_SPREAD;
+            opts->spread = option[1] == 'r';
+            continue;
+        } else if (option[0] != '-' || option[1] == '\0' || option[2] != '\0' ||
+                   strchr("cnimtf", option[1]) == NULL) {
+            if (option[0] == '-') {
+                fprintf(stderr, "job-opts: %s: unknown option\n", option);
+                return -1;
+            }
+            return i;  // the first word that is not an option
+        }
+        const char *value = strvec_get(tokens, ++i);
+        if (value == NULL) {
+            fprintf(stderr, "job-opts: %s: needs a value\n", option);
+            return -1;
+        }
+        int ret = 0;
+        switch (option[1]) {
+            case 'c':
+                opts->set |= JOB_OPT_CPUS;
+                ret = parse_cpus(value, opts);
+                break;
+            case 'n': {
+                char *end;
+                long nice = strtol(value, &end, 10);
+                opts->set |= JOB_OPT_NICE;
+                opts->nice = nice;
+                ret = end == value || *end != '\0' || nice < -20 || nice > 19 ? -1 : 0;
+                break;
+            }
+            case 'i':
+                opts->set |= JOB_OPT_IO;
+                ret = parse_io(value, opts);
+                break;
+            case 'm':
+                opts->set |= JOB_OPT_AS;
+                ret = parse_limit(value, 1, &opts->as);
+                break;
+            case 't':
+                opts->set |= JOB_OPT_CPU_TIME;
+                ret = parse_limit(value, 0, &opts->cpu_time);
+                break;
+            case 'f':
+                opts->set |= JOB_OPT_NOFILE;
+                ret = parse_limit(value, 0, &opts->nofile);
+                break;
+        }
+        if (ret != 0) {
+            fprintf(stderr, "job-opts: %s: invalid value '%s'\n", option, value);
+            return -1;
+        }
+    }
+    return i;
+}
+
+// Copy the fields 'from' holds into 'into'
+static void merge(job_opts_t *into, const job_opts_t *from) {
+    if (from->set & JOB_OPT_CPUS) {
+        memcpy(into->cpus, from->cpus, sizeof(into->cpus));
+    }
+    if (from->set & JOB_OPT_NICE) {
+        into->nice = from->nice;
+    }
+    if (from->set & JOB_OPT_IO) {
+        into->io_class = from->io_class;
+        into->io_level = from->io_level;
+    }
+    if (from->set & JOB_OPT_AS) {
+        into->as = from->as;
+    }
+    if (from->set & JOB_OPT_CPU_TIME) {
+        into->cpu_time = from->cpu_time;
+    }
+    if (from->set & JOB_OPT_NOFILE) {
+        into->nofile = from->nofile;
+    }
+    if (from->set & JOB_OPT_SPREAD) {
+        into->spread = from->spread;
+    }
+    into->set |= from->set;
+}
+
+static void update_active(void) {
+    active = defaults;
+    merge(&active, &overrides);
+}
+
+void job_opts_set_defaults(const job_opts_t *opts) {
+    merge(&defaults, opts);
+    update_active();
+}
+
+void job_opts_clear_defaults(void) {
+    memset(&defaults, 0, sizeof(defaults));
+    update_active();
+}
+
+static void print_limit(const char *option, rlim_t limit) {
+    if (limit == RLIM_INFINITY) {
+        printf(" %s unlimited", option);
+    } else {
+        printf(" %s %llu", option, (unsigned long long) limit);
+    }
+}
+
+void job_opts_print_defaults(void) {
+    if (defaults.set == 0) {
+        return;
+    }
+    printf("job-opts");
+    if (defaults.set & JOB_OPT_CPUS) {
+        // Print runs of CPUs as ranges: "0-3,6"
+        int first = 1;
+        for (unsigned cpu = 0; cpu < JOB_MAX_CPUS; cpu++) {
+            if (!cpu_has(&defaults, cpu)) {
+                continue;
+            }
+            unsigned last = cpu;
+            while (last + 1 < JOB_MAX_CPUS && cpu_has(&defaults, last + 1)) {
+                last++;
+            }
+            printf(first ? " -c %u" : ",%u", cpu);
+            if (last > cpu) {
+                printf("-%u", last);
+            }
+            first = 0;
+            cpu = last;
+        }
+    }
+    if (defaults.set & JOB_OPT_NICE) {
+        printf(" -n %d", defaults.nice);
+    }
+    if (defaults.set & JOB_OPT_IO) {
+        const char *classes[] = {NULL, "realtime", "best-effort", "idle"};
+        if (defaults.io_class == JOB_IO_IDLE) {
+            printf(" -i idle");
+        } else {
+            printf(" -i %s:%d", classes[defaults.io_class], defaults.io_level);
+        }
+    }
+    if (defaults.set & JOB_OPT_AS) {
+        print_limit("-m", defaults.as);
+    }
+    if (defaults.set & JOB_OPT_CPU_TIME) {
+        print_limit("-t", defaults.cpu_time);
+    }
+    if (defaults.set & JOB_OPT_NOFILE) {
+        print_limit("-f", defaults.nofile);
+    }
+    if (defaults.set & JOB_OPT_SPREAD) {
+        printf(defaults.spread ? " -r" : " -R");
+    }
+    printf("\n");
+}
+
+void job_opts_push_overrides(const job_opts_t *opts) {
+    overrides = *opts;
+    update_active();
+}
+
+void job_opts_pop_overrides(void) {
+    memset(&overrides, 0, sizeof(overrides));
+    update_active();  // also drops the CPU a background job was spread to
+}
+
+void job_opts_prepare(int background) {
+    if (!background || !(active.set & JOB_OPT_SPREAD) || !active.spread) {
+        return;
+    }
+    // Spread over the CPUs given with -c, or else those the shell may use
+    job_opts_t allowed = active;
+    if (!(active.set & JOB_OPT_CPUS)) {
+        cpu_set_t cpus;
+        if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) {
+            perror("sched_getaffinity");
+            return;
+        }
+        memset(allowed.cpus, 0, sizeof(allowed.cpus));
+        for (unsigned cpu = 0; cpu < JOB_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &cpus)) {
+                cpu_add(&allowed, cpu);
+            }
+        }
+    }
+    for (unsigned i = 0; i < JOB_MAX_CPUS; i++) {
+        unsigned cpu = (next_cpu + i) % JOB_MAX_CPUS;
+        if (cpu_has(&allowed, cpu)) {
+            memset(active.cpus, 0, sizeof(active.cpus));
+            cpu_add(&active, cpu);
+            active.set |= JOB_OPT_CPUS;
+            next_cpu = cpu + 1;
+            return;
+        }
+    }
+}
+
+const job_opts_t *job_opts_active(void) {
+    return (active.set & ~JOB_OPT_SPREAD) == 0 ? NULL : &active;
+}
+
+static int set_limit(int resource, rlim_t limit, const char *name) {
+    struct rlimit rl = {limit, limit};
+    if (setrlimit(resource, &rl) != 0) {
+        fprintf(stderr, "job-opts: %s limit: %s\n", name, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int job_opts_apply(const job_opts_t *opts) {
+    if (opts->set & JOB_OPT_CPUS) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (unsigned cpu = 0; cpu < JOB_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+            if (cpu_has(opts, cpu)) {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+            perror("job-opts: sched_setaffinity");
+            return -1;
+        }
+    }
+    if ((opts->set & JOB_OPT_NICE) && setpriority(PRIO_PROCESS, 0, opts->nice) != 0) {
+        perror("job-opts: setpriority");
+        return -1;
+    }
+    // glibc has no wrapper for ioprio_set()
+    if ((opts->set & JOB_OPT_IO) &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, opts->io_class << IOPRIO_CLASS_SHIFT | opts->io_level) != 0) {
+        perror("job-opts: ioprio_set");
+        return -1;
+    }
+    if (((opts->set & JOB_OPT_AS) && set_limit(RLIMIT_AS, opts->as, "address space") != 0) ||
+        ((opts->set & JOB_OPT_CPU_TIME) && set_limit(RLIMIT_CPU, opts->cpu_time, "CPU time") != 0) ||
+        ((opts->set & JOB_OPT_NOFILE) && set_limit(RLIMIT_NOFILE, opts->nofile, "open file") != 0)) {
+        return -1;
+    }
+    return 0;
+}
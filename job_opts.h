@@ -0,0 +1,110 @@
+#ifndef JOB_OPTS_H
+#define JOB_OPTS_H
+#include <limits.h>
+#include <sys/resource.h>
+
+#include "string_vector.h"
+
+/*
+ * Per-job process controls applied in each child before it runs its program:
+ * CPU affinity, nice and I/O priority, and resource limits
+ * The job-opts builtin sets defaults for every later job, and
+ * "job-opts OPTIONS -- command" applies options to one job on top of them.
+ * With spreading on, successive background jobs are each pinned to the next
+ * allowed CPU in turn.
+ */
+
+// Bits of job_opts_t.set
+#define JOB_OPT_CPUS 0x01
+#define JOB_OPT_NICE 0x02
+#define JOB_OPT_IO 0x04
+#define JOB_OPT_AS 0x08
+#define JOB_OPT_CPU_TIME 0x10
+#define JOB_OPT_NOFILE 0x20
+#define JOB_OPT_SPREAD 0x40
+
+// CPUs that can be named in a CPU list, as in the kernel's default cpu_set_t
+#define JOB_MAX_CPUS 1024
+#define JOB_CPU_WORDS (JOB_MAX_CPUS / (sizeof(unsigned long) * CHAR_BIT))
+
+// I/O scheduling classes, as in ionice(1)
+#define JOB_IO_REALTIME 1
+#define JOB_IO_BEST_EFFORT 2
+#define JOB_IO_IDLE 3
+
+typedef struct {
+    unsigned set;           // JOB_OPT_* bits of the fields that hold a value
+    unsigned long cpus[JOB_CPU_WORDS];  // Bit mask of the CPUs the job may run on
+    int nice;               // Nice value, -20 to 19
+    int io_class;           // JOB_IO_*
+    int io_level;           // Priority within the class, 0 (highest) to 7
+    rlim_t as;              // RLIMIT_AS: bytes of address space
+    rlim_t cpu_time;        // RLIMIT_CPU: seconds of CPU time
+    rlim_t nofile;          // RLIMIT_NOFILE: open descriptors
+    int spread;             // Nonzero to spread background jobs over the CPUs
+} job_opts_t;
+
+/*
+ * Parse options starting at token 'start':
+ *   -c CPUS          CPU list, e.g. "0-3,6"
+ *   -n NICE          Nice value
+ *   -i CLASS[:LEVEL] I/O class (realtime, best-effort or idle) and level
+ *   -m BYTES         Address space limit (K, M and G suffixes, or "unlimited")
+ *   -t SECONDS       CPU time limit (or "unlimited")
+ *   -f COUNT         Open file limit (or "unlimited")
+ *   -r, -R           Spread background jobs over the CPUs, or stop
+ * Parsing stops after "--" or at the first token that is not an option.
+ * opts: Filled in with the options given (cleared first)
+ * Returns the index of the first token after the options, or -1 after
+ * reporting an invalid option
+ */
+int job_opts_parse(strvec_t *tokens, unsigned start, job_opts_t *opts);
+
+/*
+ * Add 'opts' to the defaults for later jobs; the fields 'opts' holds replace
+ * those of the defaults
+ */
+void job_opts_set_defaults(const job_opts_t *opts);
+
+/*
+ * Forget every default
+ */
+void job_opts_clear_defaults(void);
+
+/*
+ * Print the defaults as the job-opts command that sets them, or nothing if
+ * there are none
+ */
+void job_opts_print_defaults(void);
+
+/*
+ * Use 'opts' on top of the defaults for the jobs started until
+ * job_opts_pop_overrides()
+ */
+void job_opts_push_overrides(const job_opts_t *opts);
+
+/*
+ * Go back to the defaults alone
+ */
+void job_opts_pop_overrides(void);
+
+/*
+ * Called before starting a job from the command line; a background job is
+ * pinned to the next allowed CPU when spreading is on (until
+ * job_opts_pop_overrides())
+ */
+void job_opts_prepare(int background);
+
+/*
+ * Get the options for the next child, or NULL if there are none (the usual
+ * case, in which children start exactly as without this module)
+ */
+const job_opts_t *job_opts_active(void);
+
+/*
+ * Apply options to the calling process; meant for a child before exec()
+ * Returns 0 on success or -1 after reporting the setting that failed
+ */
+int job_opts_apply(const job_opts_t *opts);
+
+#endif // JOB_OPTS_H
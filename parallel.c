@@ -0,0 +1,265 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "job_list.h"
+#include "parallel.h"
+#include "reader.h"
+#include "reaper.h"
+#include "spawn.h"
+#include "string_vector.h"
+#include "trace.h"
+
+#define USAGE "usage: parallel [-j N] [-a file] [-e] command [args...]\n"
+
+typedef struct {
+    job_t job;          // The item's processes, job.pids == NULL when the worker is idle
+    unsigned seq;       // Position of the item in the input
+    char *item;
+} worker_t;
+
+typedef struct {
+    worker_t *workers;
+    unsigned num_workers;
+    unsigned running;   // Number of busy workers
+    int failure;        // Exit status of the first item that failed, 0 if none did
+} pool_t;
+
+static void finish_worker(pool_t *pool, worker_t *worker) {
+    report_status(worker->seq, worker->item, worker->job.exit_status, job_elapsed(&worker->job));
+    if (worker->job.exit_status != 0 && pool->failure == 0) {
+        pool->failure = worker->job.exit_status;
+    }
+    free(worker->job.pids);
+    worker->job.pids = NULL;
+    free(worker->item);
+    worker->item = NULL;
+    pool->running--;
+}
+
+// Called by the reaper for every child that is not one of the shell's jobs
+static void worker_exited(pid_t pid, int wstatus, void *arg) {
+    pool_t *pool = arg;
+    if (!WIFEXITED(wstatus) && !WIFSIGNALED(wstatus)) {  // stopped or continued
+        return;
+    }
+    for (unsigned i = 0; i < pool->num_workers; i++) {
+        worker_t *worker = &pool->workers[i];
+        if (worker->job.pids == NULL || job_remove_pid(&worker->job, pid) == -1) {
+            continue;
+        }
+        int status = WIFSIGNALED(wstatus) ? 128 + WTERMSIG(wstatus) : WEXITSTATUS(wstatus);
+        if (pid == worker->job.last_pid) {
+            worker->job.exit_status = status;
+        }
+        TRACE_EXIT(pid, &worker->job.started, worker->item, status);
+        if (worker->job.num_pids == 0) {
+            finish_worker(pool, worker);
+        }
+        return;
+    }
+}
+
+// Copy 'token' into '*buf' with every placeholder replaced by 'item'
+static int substitute(const char *token, const char *item, char **buf, size_t *cap) {
+    size_t item_len = strlen(item);
+    size_t len = 0;
+    for (const char *c = token; *c != '\0'; ) {
+        const char *piece = c;
+        size_t piece_len = 1;
+        if (strncmp(c, PARALLEL_PLACEHOLDER, strlen(PARALLEL_PLACEHOLDER)) == 0) {
+            piece = item;
+            piece_len = item_len;
+            c += strlen(PARALLEL_PLACEHOLDER);
+        } else {
+            c++;
+        }
+        if (len + piece_len + 1 > *cap) {
+            size_t new_cap = (len + piece_len + 1) * 2;
+            char *new_buf = realloc(*buf, new_cap);
+            if (new_buf == NULL) {
+                return -1;
+            }
+            *buf = new_buf;
+            *cap = new_cap;
+        }
+        memcpy(*buf + len, piece, piece_len);
+        len += piece_len;
+    }
+    (*buf)[len] = '\0';
+    return 0;
+}
+
+// Build the command line for one item from the template tokens[first..]
+static int build_command(strvec_t *tokens, unsigned first, const char *item, strvec_t *cmd,
+                         char **buf, size_t *cap) {
+    strvec_clear(cmd);
+    int has_placeholder = 0;
+    int first_stage = 1;
+    int redirects_input = 0;
+    for (unsigned i = first; i < tokens->length; i++) {
+        const char *token = strvec_get(tokens, i);
+        if (first_stage && strcmp(token, PIPE_OPERATOR) == 0) {
+            // Workers must not compete for the shell's input
+            if (!redirects_input && (strvec_add(cmd, "<") != 0 || strvec_add(cmd, "/dev/null") != 0)) {
+                return -1;
+            }
+            first_stage = 0;
+        } else if (first_stage && (strcmp(token, "<") == 0 || strcmp(token, "<&") == 0)) {
+            redirects_input = 1;
+        }
+        if (strstr(token, PARALLEL_PLACEHOLDER) != NULL) {
+            has_placeholder = 1;
+            if (substitute(token, item, buf, cap) != 0) {
+                return -1;
+            }
+            token = *buf;
+        }
+        if (strvec_add(cmd, token) != 0) {
+            return -1;
+        }
+    }
+    if (!has_placeholder && strvec_add(cmd, item) != 0) {
+        return -1;
+    }
+    if (first_stage && !redirects_input &&
+        (strvec_add(cmd, "<") != 0 || strvec_add(cmd, "/dev/null") != 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Feed the items to the workers until the input runs out (or an item fails
+// with 'halt' set) and every started item has finished
+// Returns 0 on success or -1 on error
+static int run_items(pool_t *pool, reader_t *items, strvec_t *tokens, unsigned first, int halt,
+                     job_list_t *jobs) {
+    strvec_t cmd;
+    if (strvec_init_arena(&cmd) != 0) {
+        perror("strvec_init_arena");
+        return -1;
+    }
+    char *buf = NULL;  // holds a token with the placeholder replaced
+    size_t cap = 0;
+    int ret = 0;
+    unsigned seq = 0;
+    int more = 1;  // Nonzero until the input runs out or an item fails with -e
+    reaper_set_untracked(worker_exited, pool);
+    while (1) {
+        while (more && pool->running < pool->num_workers && !(halt && pool->failure != 0)) {
+            char *line;
+            ssize_t len = reader_next(items, &line);
+            if (len == -1) {
+                more = 0;
+                break;
+            }
+            if (len == 0) {
+                continue;
+            }
+            worker_t *worker = pool->workers;
+            while (worker->job.pids != NULL) {  // an idle worker exists since running < num_workers
+                worker++;
+            }
+            if (build_command(tokens, first, line, &cmd, &buf, &cap) != 0 ||
+                (worker->item = strdup(line)) == NULL) {
+                perror("parallel");
+                more = 0;
+                ret = -1;
+                break;
+            }
+            worker->seq = seq++;
+            if (spawn_job(&cmd, &worker->job, -1, -1, 0) == -1) {  // nothing started, error already reported
+                report_status(worker->seq, worker->item, 127, 0);
+                if (pool->failure == 0) {
+                    pool->failure = 127;
+                }
+                free(worker->item);
+                worker->item = NULL;
+                continue;
+            }
+            pool->running++;
+        }
+        if (pool->running == 0) {
+            break;
+        }
+        if (reaper_wait(jobs, -1) == -1) {  // workers that exit are handled by worker_exited()
+            ret = -1;
+            break;
+        }
+    }
+    reaper_set_untracked(NULL, NULL);
+    free(buf);
+    strvec_free(&cmd);
+    return ret;
+}
+
+int parallel_command(strvec_t *tokens, job_list_t *jobs) {
+    long num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *file = NULL;
+    int halt = 0;
+    unsigned first = 1;
+    const char *arg;
+    while ((arg = strvec_get(tokens, first)) != NULL && arg[0] == '-') {
+        if (strcmp(arg, "-e") == 0) {
+            halt = 1;
+        } else if (strcmp(arg, "-a") == 0 && strvec_get(tokens, first + 1) != NULL) {
+            file = strvec_get(tokens, ++first);
+        } else if (strcmp(arg, "-j") == 0 && strvec_get(tokens, first + 1) != NULL) {
+            const char *n = strvec_get(tokens, ++first);
+            char *end;
+            num_workers = strtol(n, &end, 10);
+            if (*n == '\0' || *end != '\0' || num_workers < 1 || num_workers > INT_MAX) {
+                fprintf(stderr, "parallel: -j: expected a positive number\n");
+                return -1;
+            }
+        } else {
+            fprintf(stderr, USAGE);
+            return -1;
+        }
+        first++;
+    }
+    if (first >= tokens->length) {
+        fprintf(stderr, USAGE);
+        return -1;
+    }
+    if (num_workers < 1) {  // sysconf() failed
+        num_workers = 1;
+    }
+
+    int fd = STDIN_FILENO;
+    if (file != NULL && (fd = open(file, O_RDONLY | O_CLOEXEC)) == -1) {
+        perror(file);
+        return -1;
+    }
+    reader_t items;
+    if (reader_init_fd(&items, fd) != 0) {
+        perror("reader_init_fd");
+        if (fd != STDIN_FILENO) {
+            close(fd);
+        }
+        return -1;
+    }
+    pool_t pool = { NULL, num_workers, 0, 0 };
+    int ret = -1;
+    if ((pool.workers = calloc(num_workers, sizeof(worker_t))) == NULL) {
+        perror("calloc");
+    } else {
+        ret = run_items(&pool, &items, tokens, first, halt, jobs);
+        for (unsigned i = 0; i < pool.num_workers; i++) {  // left over only after an error
+            free(pool.workers[i].job.pids);
+            free(pool.workers[i].item);
+        }
+        free(pool.workers);
+    }
+    reader_free(&items);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return ret == -1 ? -1 : pool.failure;
+}
@@ -0,0 +1,29 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "job_list.h"
+#include "string_vector.h"
+
+#define PARALLEL_PLACEHOLDER "{}"
+
+/*
+ * Run a command once per input item, keeping up to N copies running at a time
+ *   parallel [-j N] [-a file] [-e] command [args...]
+ * Items are the lines of 'file' (standard input by default); empty lines are
+ * skipped. Every "{}" in the command is replaced by the item, or the item is
+ * appended as the last argument if the command has no "{}". The command may
+ * contain redirections and pipes, and is launched through spawn_job(). Its
+ * standard input is /dev/null unless the command redirects it.
+ * -j: Number of items run at once, the number of online CPUs by default
+ * -e: Start no more items after the first one fails (running ones are still waited for)
+ * Each item is reported as it finishes ("[3] Exit 1  item  0.250s"), numbered
+ * from 0 in input order. Workers are reaped through the reaper, so background
+ * jobs keep being tracked while the builtin runs.
+ * tokens: Tokens from the command typed in by the user
+ * jobs: The shell's jobs list
+ * Returns 0 if every item succeeded, the exit status of the first item that
+ * failed, or -1 on error
+ */
+int parallel_command(strvec_t *tokens, job_list_t *jobs);
+
+#endif // PARALLEL_H
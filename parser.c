@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtins.h"
+#include "heredoc.h"
+#include "parser.h"
+#include "subst.h"
+#include "vars.h"
+
+#define BLOCK_SIZE 4096
+#define ALIGN 16
+#define TEXT_INITIAL_SIZE 256
+
+// Memory for the nodes and words of a tree, handed out in order and all
+// released at once when the next command is parsed
+struct parser_block {
+    struct parser_block *next;
+    size_t size;        // Bytes of 'data'
+    size_t used;
+    _Alignas(ALIGN) char data[];
+};
+
+#define TOKEN_WORD 0
+#define TOKEN_SEPARATOR 1  // ';' or a newline
+#define TOKEN_AND 2
+#define TOKEN_OR 3
+#define TOKEN_END 4
+
+typedef struct {
+    parser_t *p;
+    const char *pos;    // Start of the text not yet split into tokens
+    int type;           // The current token
+    const char *start;
+    size_t len;
+    int newline;        // The current token is a TOKEN_SEPARATOR for a newline
+    int result;         // PARSE_MORE or PARSE_ERROR once parsing cannot go on
+    int in_loop;        // Parsing the body or condition of a loop
+} state_t;
+
+static void *arena_alloc(parser_t *p, size_t size) {
+    size = (size + ALIGN - 1) & ~(size_t) (ALIGN - 1);
+    struct parser_block *block = p->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = block == NULL ? BLOCK_SIZE : block->size * 2;
+        if (block_size < size) {
+            block_size = size;
+        }
+        if ((block = malloc(sizeof(struct parser_block) + block_size)) == NULL) {
+            perror("malloc");
+            return NULL;
+        }
+        block->next = p->blocks;
+        block->size = block_size;
+        block->used = 0;
+        p->blocks = block;
+    }
+    void *mem = block->data + block->used;
+    block->used += size;
+    return mem;
+}
+
+// Release the last tree, keeping one block big enough to hold it, so parsing
+// allocates nothing once the block has grown to fit the largest command
+static void arena_reset(parser_t *p) {
+    if (p->blocks == NULL) {
+        return;
+    }
+    if (p->blocks->next == NULL) {
+        p->blocks->used = 0;
+        return;
+    }
+    size_t total = 0;
+    while (p->blocks != NULL) {
+        struct parser_block *next = p->blocks->next;
+        total += p->blocks->size;
+        free(p->blocks);
+        p->blocks = next;
+    }
+    if ((p->blocks = malloc(sizeof(struct parser_block) + total)) != NULL) {
+        p->blocks->next = NULL;
+        p->blocks->size = total;
+        p->blocks->used = 0;
+    }
+}
+
+void parser_init(parser_t *p) {
+    p->text = NULL;
+    p->len = 0;
+    p->cap = 0;
+    p->blocks = NULL;
+}
+
+void parser_free(parser_t *p) {
+    free(p->text);
+    p->text = NULL;
+    p->len = 0;
+    p->cap = 0;
+    while (p->blocks != NULL) {
+        struct parser_block *next = p->blocks->next;
+        free(p->blocks);
+        p->blocks = next;
+    }
+}
+
+int parser_pending(const parser_t *p) {
+    return p->len > 0;
+}
+
+void parser_reset(parser_t *p) {
+    p->len = 0;
+}
+
+static void syntax_error(state_t *st) {
+    if (st->type == TOKEN_SEPARATOR && st->newline) {
+        fprintf(stderr, "swish: syntax error near newline\n");
+    } else {
+        fprintf(stderr, "swish: syntax error near '%.*s'\n", (int) st->len, st->start);
+    }
+    st->result = PARSE_ERROR;
+}
+
+// Move to the next token
+static void next_token(state_t *st) {
+    const char *c = st->pos;
+    while (1) {
+        while (*c == ' ' || *c == '\t') {
+            c++;
+        }
+        if (*c != '#') {
+            break;
+        }
+        while (*c != '\0' && *c != '\n') {  // a comment runs to the end of the line
+            c++;
+        }
+    }
+    st->start = c;
+    st->newline = 0;
+    if (*c == '\0') {
+        st->type = TOKEN_END;
+    } else if (*c == '\n' || *c == ';') {
+        st->type = TOKEN_SEPARATOR;
+        st->newline = *c == '\n';
+        c++;
+    } else if ((c[0] == '&' && c[1] == '&') || (c[0] == '|' && c[1] == '|')) {
+        st->type = *c == '&' ? TOKEN_AND : TOKEN_OR;
+        c += 2;
+    } else {
+        st->type = TOKEN_WORD;
+        while (*c != '\0' && strchr(" \t\n;", *c) == NULL &&
+               !(c[0] == '&' && c[1] == '&') && !(c[0] == '|' && c[1] == '|')) {
+            if (strncmp(c, SUBST_START, 2) != 0) {
+                c++;
+                continue;
+            }
+            // A substitution runs to the matching ')', whatever it holds
+            const char *end = c + 2;
+            for (int depth = 1; *end != '\0' && *end != '\n'; end++) {
+                depth += *end == '(' ? 1 : *end == ')' ? -1 : 0;
+                if (depth == 0) {
+                    break;
+                }
+            }
+            if (*end != ')') {
+                fprintf(stderr, "swish: unterminated command substitution\n");
+                st->result = PARSE_ERROR;
+                st->type = TOKEN_END;
+                return;
+            }
+            c = end + 1;
+        }
+    }
+    st->len = c - st->start;
+    st->pos = c;
+}
+
+static int is_word(const state_t *st, const char *word) {
+    return st->type == TOKEN_WORD && st->len == strlen(word) && strncmp(st->start, word, st->len) == 0;
+}
+
+// Nonzero if the current token ends a list: "do" or "done" where a command may start
+static int ends_list(const state_t *st) {
+    return is_word(st, "do") || is_word(st, "done");
+}
+
+static node_t *new_node(state_t *st, int type) {
+    node_t *node = arena_alloc(st->p, sizeof(node_t));
+    if (node == NULL) {
+        st->result = PARSE_ERROR;
+        return NULL;
+    }
+    memset(node, 0, sizeof(node_t));
+    node->type = type;
+    return node;
+}
+
+// Copy the words from the current token up to the next token that is not a
+// word into 'node'
+static int read_words(state_t *st, node_t *node) {
+    state_t start = *st;
+    unsigned n = 0;
+    for (; st->type == TOKEN_WORD; next_token(st)) {
+        n++;
+    }
+    if (st->result != 0) {
+        return -1;
+    }
+    if ((node->words = arena_alloc(st->p, (n + 1) * sizeof(char *))) == NULL) {
+        st->result = PARSE_ERROR;
+        return -1;
+    }
+    *st = start;
+    for (unsigned i = 0; i < n; i++, next_token(st)) {
+        char *word = arena_alloc(st->p, st->len + 1);
+        if (word == NULL) {
+            st->result = PARSE_ERROR;
+            return -1;
+        }
+        memcpy(word, st->start, st->len);
+        word[st->len] = '\0';
+        if (strpbrk(word, "$*?[") != NULL) {
+            node->expand = 1;
+        }
+        node->words[i] = word;
+    }
+    node->words[n] = NULL;
+    node->num_words = n;
+    return 0;
+}
+
+static node_t *parse_list(state_t *st);
+
+// Parse "do LIST done", which ends a loop, into 'node->body'
+static int parse_body(state_t *st, node_t *node) {
+    while (st->type == TOKEN_SEPARATOR) {
+        next_token(st);
+    }
+    if (st->type == TOKEN_END) {
+        st->result = st->result != 0 ? st->result : PARSE_MORE;
+        return -1;
+    } else if (!is_word(st, "do")) {
+        syntax_error(st);
+        return -1;
+    }
+    next_token(st);
+    if ((node->body = parse_list(st)) == NULL && st->result != 0) {
+        return -1;
+    }
+    if (st->type == TOKEN_END) {
+        st->result = st->result != 0 ? st->result : PARSE_MORE;
+        return -1;
+    } else if (node->body == NULL || !is_word(st, "done")) {
+        syntax_error(st);
+        return -1;
+    }
+    next_token(st);
+    if (st->type == TOKEN_WORD) {  // only a separator or an operator may follow
+        syntax_error(st);
+        return -1;
+    }
+    return 0;
+}
+
+static node_t *parse_for(state_t *st) {
+    node_t *node = new_node(st, NODE_FOR);
+    if (node == NULL) {
+        return NULL;
+    }
+    next_token(st);
+    if (st->type == TOKEN_WORD && vars_name_len(st->start) == st->len) {
+        char *name = arena_alloc(st->p, st->len + 1);
+        if (name == NULL) {
+            st->result = PARSE_ERROR;
+            return NULL;
+        }
+        memcpy(name, st->start, st->len);
+        name[st->len] = '\0';
+        node->name = name;
+        next_token(st);
+    }
+    if (st->type == TOKEN_END) {
+        st->result = st->result != 0 ? st->result : PARSE_MORE;
+        return NULL;
+    } else if (node->name == NULL || !is_word(st, "in")) {
+        syntax_error(st);
+        return NULL;
+    }
+    next_token(st);
+    if (read_words(st, node) != 0) {
+        return NULL;
+    }
+    if (st->type != TOKEN_SEPARATOR && st->type != TOKEN_END) {
+        syntax_error(st);
+        return NULL;
+    }
+    return parse_body(st, node) == 0 ? node : NULL;
+}
+
+static node_t *parse_while(state_t *st, int type) {
+    node_t *node = new_node(st, type);
+    if (node == NULL) {
+        return NULL;
+    }
+    next_token(st);
+    if ((node->cond = parse_list(st)) == NULL && st->result != 0) {
+        return NULL;
+    }
+    if (st->type == TOKEN_END) {
+        st->result = st->result != 0 ? st->result : PARSE_MORE;
+        return NULL;
+    } else if (node->cond == NULL) {
+        syntax_error(st);
+        return NULL;
+    }
+    return parse_body(st, node) == 0 ? node : NULL;
+}
+
+static node_t *parse_simple(state_t *st) {
+    node_t *node = new_node(st, NODE_COMMAND);
+    if (node == NULL || read_words(st, node) != 0) {
+        return NULL;
+    }
+    if (st->in_loop) {
+        // The lines of a here-document follow its command in the input, so
+        // the command could only run once
+        for (unsigned i = 0; i < node->num_words; i++) {
+            if (strncmp(node->words[i], HEREDOC_OPERATOR, 2) == 0 &&
+                strncmp(node->words[i], HERESTRING_OPERATOR, 3) != 0) {
+                fprintf(stderr, "swish: here-documents are not supported in loops\n");
+                st->result = PARSE_ERROR;
+                return NULL;
+            }
+        }
+    }
+    const char *first = node->words[0];
+    if (strpbrk(first, "$*?[") == NULL && !vars_is_assignment(first)) {
+        node->builtin = builtin_find(first);
+        node->resolved = 1;
+    }
+    return node;
+}
+
+static node_t *parse_command(state_t *st) {
+    if (is_word(st, "for") || is_word(st, "while") || is_word(st, "until")) {
+        int in_loop = st->in_loop;
+        st->in_loop = 1;
+        node_t *node = is_word(st, "for") ? parse_for(st) :
+                       parse_while(st, is_word(st, "while") ? NODE_WHILE : NODE_UNTIL);
+        st->in_loop = in_loop;
+        return node;
+    } else if (ends_list(st)) {
+        syntax_error(st);
+        return NULL;
+    }
+    return parse_simple(st);
+}
+
+// Parse commands joined by "&&" and "||"
+static node_t *parse_and_or(state_t *st) {
+    node_t *left = parse_command(st);
+    while (left != NULL && (st->type == TOKEN_AND || st->type == TOKEN_OR)) {
+        node_t *node = new_node(st, st->type == TOKEN_AND ? NODE_AND : NODE_OR);
+        if (node == NULL) {
+            return NULL;
+        }
+        next_token(st);
+        while (st->type == TOKEN_SEPARATOR && st->newline) {  // the command may go on on the next line
+            next_token(st);
+        }
+        if (st->type == TOKEN_END) {
+            st->result = st->result != 0 ? st->result : PARSE_MORE;
+            return NULL;
+        } else if (st->type != TOKEN_WORD) {
+            syntax_error(st);
+            return NULL;
+        }
+        node->left = left;
+        if ((node->right = parse_command(st)) == NULL) {
+            return NULL;
+        }
+        left = node;
+    }
+    return left;
+}
+
+// Parse commands separated by ';' or newlines, up to the end of the text or
+// a "do" or "done" where a command may start
+// Returns the first node of the list, or NULL if the list is empty or on error
+// (st->result is then set)
+static node_t *parse_list(state_t *st) {
+    node_t *head = NULL;
+    node_t *tail = NULL;
+    while (1) {
+        while (st->type == TOKEN_SEPARATOR) {
+            next_token(st);
+        }
+        if (st->type != TOKEN_WORD || ends_list(st)) {
+            if (st->type == TOKEN_AND || st->type == TOKEN_OR) {
+                syntax_error(st);
+                return NULL;
+            }
+            return head;
+        }
+        node_t *node = parse_and_or(st);
+        if (node == NULL) {
+            return NULL;
+        }
+        if (tail == NULL) {
+            head = node;
+        } else {
+            tail->next = node;
+        }
+        tail = node;
+    }
+}
+
+int parser_add_line(parser_t *p, const char *line, node_t **tree) {
+    size_t line_len = strlen(line);
+    size_t needed = p->len + line_len + 2;  // a '\n' before the line and the '\0'
+    if (needed > p->cap) {
+        size_t new_cap = p->cap == 0 ? TEXT_INITIAL_SIZE : p->cap;
+        while (new_cap < needed) {
+            new_cap *= 2;
+        }
+        char *new_text = realloc(p->text, new_cap);
+        if (new_text == NULL) {
+            perror("realloc");
+            p->len = 0;
+            return PARSE_ERROR;
+        }
+        p->text = new_text;
+        p->cap = new_cap;
+    }
+    if (p->len > 0) {
+        p->text[p->len++] = '\n';
+    }
+    memcpy(p->text + p->len, line, line_len + 1);
+    p->len += line_len;
+
+    // Parse the whole command again: commands spanning lines are rare and short
+    arena_reset(p);
+    state_t st = {p, p->text, 0, NULL, 0, 0, 0, 0};
+    next_token(&st);
+    *tree = parse_list(&st);
+    if (st.result == 0 && st.type != TOKEN_END) {  // a stray "do" or "done"
+        syntax_error(&st);
+    }
+    if (st.result != PARSE_MORE) {
+        p->len = 0;
+    }
+    if (st.result != 0) {
+        *tree = NULL;
+        return st.result;
+    }
+    return PARSE_DONE;
+}
@@ -0,0 +1,99 @@
+#ifndef PARSER_H
+#define PARSER_H
+#include <stddef.h>
+
+#include "builtins.h"
+
+/*
+ * Parser for command lists and loops
+ * A command is read once into a tree of nodes, which the shell then runs as
+ * many times as it needs to (e.g., the body of a loop) without looking at the
+ * text again:
+ *   cmd1 ; cmd2           Run cmd1, then cmd2 (a newline works like ';')
+ *   cmd1 && cmd2          Run cmd2 only if cmd1 succeeds
+ *   cmd1 || cmd2          Run cmd2 only if cmd1 fails
+ *   for NAME in WORDS ; do LIST ; done
+ *   while LIST ; do LIST ; done
+ *   until LIST ; do LIST ; done
+ * "&&" and "||" have equal precedence and group from the left, as in sh.
+ * Other text is split into words on spaces and tabs as by tokenize(): pipes,
+ * '&' and redirections stay words of their simple command, and a command
+ * substitution "$(...)" is kept whole in one word. Keywords (for, while, until,
+ * do, done, in) are only recognized where a command or the keyword may start.
+ * A simple command's first word is looked up among the builtins when the
+ * command is parsed, unless expansion may change it.
+ */
+
+#define NODE_COMMAND 0  // A simple command: words, possibly a pipeline
+#define NODE_AND 1      // left && right
+#define NODE_OR 2       // left || right
+#define NODE_FOR 3      // for name in words; do body; done
+#define NODE_WHILE 4    // while cond; do body; done
+#define NODE_UNTIL 5    // until cond; do body; done
+
+typedef struct node node_t;
+struct node {
+    int type;
+    node_t *next;       // Next command of the list this node is in, or NULL
+    // NODE_COMMAND: the command's words; NODE_FOR: the words after "in"
+    char **words;
+    unsigned num_words;
+    int expand;         // Nonzero if a word holds '$' or a pattern character ('*', '?', '[')
+    // NODE_COMMAND: the builtin named by the first word, or NULL for a
+    // program, valid if 'resolved' is set (the word needs no expansion and
+    // is not an assignment)
+    const builtin_t *builtin;
+    int resolved;
+    const char *name;   // NODE_FOR: the loop variable
+    node_t *left;       // NODE_AND, NODE_OR: the operands
+    node_t *right;
+    node_t *cond;       // NODE_WHILE, NODE_UNTIL: the condition list
+    node_t *body;       // Loops: the body list
+};
+
+// Results of parser_add_line()
+#define PARSE_DONE 0    // The command is complete
+#define PARSE_MORE 1    // The command continues on the next line
+#define PARSE_ERROR 2   // Syntax error (reported)
+
+struct parser_block;
+
+typedef struct {
+    char *text;         // Lines of the command being parsed, separated by '\n'
+    size_t len;
+    size_t cap;
+    struct parser_block *blocks;  // Memory holding the tree, reused for every command
+} parser_t;
+
+/*
+ * Initialize a parser with no command in progress
+ */
+void parser_init(parser_t *p);
+
+/*
+ * Release the memory used by a parser and its last tree
+ */
+void parser_free(parser_t *p);
+
+/*
+ * Add a line of input to the command being parsed and parse it
+ * The text is copied, so 'line' may be reused. A command spans lines while a
+ * loop is not closed by "done" or a line ends with "&&" or "||".
+ * tree: With PARSE_DONE, set to the command's list of nodes (NULL if it has
+ *       none, e.g. a comment), valid until the next call
+ * Returns PARSE_DONE, PARSE_MORE or PARSE_ERROR; after PARSE_DONE and
+ * PARSE_ERROR, the next line starts a new command
+ */
+int parser_add_line(parser_t *p, const char *line, node_t **tree);
+
+/*
+ * Nonzero if a command is in progress (the last result was PARSE_MORE)
+ */
+int parser_pending(const parser_t *p);
+
+/*
+ * Drop the command in progress, if any (e.g., at end of input)
+ */
+void parser_reset(parser_t *p);
+
+#endif // PARSER_H
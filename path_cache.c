@@ -0,0 +1,344 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "path_cache.h"
+
+#define INITIAL_SIZE 64  // Must be a power of 2
+#define WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                      IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct {
+    char *name;    // NULL for an empty slot
+    char *path;
+    unsigned hits;
+} entry_t;
+
+typedef struct {
+    char *path;    // Directory name as written in PATH
+    int wd;        // inotify watch descriptor, -1 if the directory is not watched
+} dir_t;
+
+static entry_t *table = NULL;
+static unsigned table_size = 0;  // Number of slots in 'table'
+static unsigned table_used = 0;  // Number of entries in 'table'
+
+static char *cached_path_var = NULL;  // Value of PATH the cache was built against
+static dir_t *dirs = NULL;
+static unsigned num_dirs = 0;
+static unsigned first_relative_dir = 0;  // Index of the first non-absolute PATH entry
+static int inotify_fd = -1;
+
+// FNV-1a
+static unsigned hash_name(const char *s) {
+    unsigned h = 2166136261u;
+    while (*s != '\0') {
+        h ^= (unsigned char) *s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Returns the slot holding 'name', or the empty slot where it would be inserted
+static unsigned find_slot(const char *name) {
+    unsigned mask = table_size - 1;
+    unsigned i = hash_name(name) & mask;
+    while (table[i].name != NULL && strcmp(table[i].name, name) != 0) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void free_entry(entry_t *entry) {
+    free(entry->name);
+    free(entry->path);
+    entry->name = NULL;
+    entry->path = NULL;
+}
+
+// Linear probing removal by shifting later entries of the cluster back
+static void remove_slot(unsigned i) {
+    unsigned mask = table_size - 1;
+    free_entry(&table[i]);
+    table_used--;
+    unsigned j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (table[j].name == NULL) {
+            return;
+        }
+        unsigned home = hash_name(table[j].name) & mask;
+        // Move the entry back if its home slot is not within (i, j]
+        if ((i <= j) ? (home <= i || home > j) : (home <= i && home > j)) {
+            table[i] = table[j];
+            table[j].name = NULL;
+            table[j].path = NULL;
+            i = j;
+        }
+    }
+}
+
+static int grow_table(void) {
+    unsigned new_size = table_size == 0 ? INITIAL_SIZE : table_size * 2;
+    entry_t *new_table = calloc(new_size, sizeof(entry_t));
+    if (new_table == NULL) {
+        return -1;
+    }
+    entry_t *old_table = table;
+    unsigned old_size = table_size;
+    table = new_table;
+    table_size = new_size;
+    for (unsigned i = 0; i < old_size; i++) {
+        if (old_table[i].name != NULL) {
+            table[find_slot(old_table[i].name)] = old_table[i];
+        }
+    }
+    free(old_table);
+    return 0;
+}
+
+static void unwatch_dirs(void) {
+    for (unsigned i = 0; i < num_dirs; i++) {
+        if (dirs[i].wd != -1 && inotify_fd != -1) {
+            inotify_rm_watch(inotify_fd, dirs[i].wd);
+        }
+        free(dirs[i].path);
+    }
+    free(dirs);
+    dirs = NULL;
+    num_dirs = 0;
+    free(cached_path_var);
+    cached_path_var = NULL;
+}
+
+// Split PATH into directories and watch each of them
+static int watch_dirs(const char *path_var) {
+    if ((cached_path_var = strdup(path_var)) == NULL) {
+        return -1;
+    }
+    unsigned count = 1;
+    for (const char *c = path_var; *c != '\0'; c++) {
+        if (*c == ':') {
+            count++;
+        }
+    }
+    if ((dirs = calloc(count, sizeof(dir_t))) == NULL) {
+        return -1;
+    }
+    first_relative_dir = count;
+
+    const char *start = path_var;
+    int ret = 0;
+    while (1) {
+        const char *end = strchr(start, ':');
+        size_t len = end == NULL ? strlen(start) : (size_t) (end - start);
+        // An empty element means the current directory, as in execvp()
+        dir_t *dir = &dirs[num_dirs++];
+        dir->path = len == 0 ? strdup(".") : strndup(start, len);
+        dir->wd = -1;
+        if (dir->path == NULL) {
+            num_dirs--;
+            return -1;
+        }
+        // Relative directories depend on the cwd and are never cached
+        if (dir->path[0] != '/' && first_relative_dir == count) {
+            first_relative_dir = num_dirs - 1;
+        }
+        if (dir->path[0] == '/' && inotify_fd != -1) {
+            if ((dir->wd = inotify_add_watch(inotify_fd, dir->path, WATCH_EVENTS | IN_ONLYDIR)) == -1 &&
+                errno != ENOENT && errno != ENOTDIR && errno != EACCES) {
+                ret = -1;
+            }
+        }
+        if (end == NULL) {
+            break;
+        }
+        start = end + 1;
+    }
+    return ret;
+}
+
+// Apply pending inotify events and rebuild everything if PATH changed
+static void revalidate(void) {
+    const char *path_var = getenv("PATH");
+    if (path_var == NULL) {
+        path_var = "";
+    }
+    if (cached_path_var == NULL || strcmp(cached_path_var, path_var) != 0) {
+        path_cache_clear();
+        unwatch_dirs();
+        watch_dirs(path_var);
+        return;
+    }
+    if (inotify_fd == -1) {
+        return;
+    }
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n; ) {
+            struct inotify_event *event = (struct inotify_event *) p;
+            if (event->mask & IN_Q_OVERFLOW) {  // events were lost
+                path_cache_clear();
+            } else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                // The directory itself went away: forget the watch and anything
+                // that could have been resolved through it
+                for (unsigned i = 0; i < num_dirs; i++) {
+                    if (dirs[i].wd == event->wd) {
+                        if (!(event->mask & IN_IGNORED)) {
+                            inotify_rm_watch(inotify_fd, dirs[i].wd);
+                        }
+                        dirs[i].wd = -1;
+                        path_cache_clear();
+                    }
+                }
+            }
+            // A change to 'name' in any PATH directory may shadow or remove the
+            // cached resolution of 'name', so drop just that entry
+            if (event->len > 0 && table_size > 0) {
+                unsigned i = find_slot(event->name);
+                if (table[i].name != NULL) {
+                    remove_slot(i);
+                }
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+int path_cache_init(void) {
+    if ((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+        perror("inotify_init1");
+        return -1;
+    }
+    const char *path_var = getenv("PATH");
+    if (watch_dirs(path_var == NULL ? "" : path_var) != 0) {
+        perror("inotify_add_watch");
+        return -1;
+    }
+    return 0;
+}
+
+void path_cache_free(void) {
+    path_cache_clear();
+    free(table);
+    table = NULL;
+    table_size = 0;
+    unwatch_dirs();
+    if (inotify_fd != -1) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+}
+
+void path_cache_clear(void) {
+    for (unsigned i = 0; i < table_size; i++) {
+        if (table[i].name != NULL) {
+            free_entry(&table[i]);
+        }
+    }
+    table_used = 0;
+}
+
+int path_cache_insert(const char *name, const char *path) {
+    if (table_size == 0 || (table_used + 1) * 10 > table_size * 7) {  // keep load factor <= 0.7
+        if (grow_table() != 0) {
+            return -1;
+        }
+    }
+    unsigned i = find_slot(name);
+    char *new_path = strdup(path);
+    if (new_path == NULL) {
+        return -1;
+    }
+    if (table[i].name != NULL) {
+        free(table[i].path);
+        table[i].path = new_path;
+        table[i].hits = 0;
+        return 0;
+    }
+    if ((table[i].name = strdup(name)) == NULL) {
+        free(new_path);
+        return -1;
+    }
+    table[i].path = new_path;
+    table[i].hits = 0;
+    table_used++;
+    return 0;
+}
+
+int path_cache_remove(const char *name) {
+    if (table_size == 0) {
+        return -1;
+    }
+    unsigned i = find_slot(name);
+    if (table[i].name == NULL) {
+        return -1;
+    }
+    remove_slot(i);
+    return 0;
+}
+
+const char *path_cache_peek(const char *name) {
+    revalidate();
+    if (table_size == 0) {
+        return NULL;
+    }
+    return table[find_slot(name)].path;
+}
+
+const char *path_cache_lookup(const char *name) {
+    if (strchr(name, '/') != NULL || *name == '\0') {
+        return NULL;
+    }
+    revalidate();
+    if (table_size > 0) {
+        unsigned i = find_slot(name);
+        if (table[i].name != NULL) {
+            table[i].hits++;
+            return table[i].path;
+        }
+    }
+
+    // Miss: search PATH the same way execvp() does, first match wins
+    char candidate[PATH_MAX];
+    for (unsigned d = 0; d < num_dirs; d++) {
+        int len = snprintf(candidate, sizeof(candidate), "%s/%s", dirs[d].path, name);
+        if (len < 0 || len >= sizeof(candidate)) {
+            continue;
+        }
+        struct stat st;
+        if (stat(candidate, &st) != 0 || !S_ISREG(st.st_mode) || access(candidate, X_OK) != 0) {
+            continue;
+        }
+        // Only remember resolutions we will hear about when they go stale. A
+        // relative directory earlier in PATH could shadow the result after a cd.
+        if (dirs[d].wd == -1 || d > first_relative_dir || path_cache_insert(name, candidate) != 0) {
+            return NULL;  // let execvp()/posix_spawnp() search PATH itself
+        }
+        unsigned i = find_slot(name);
+        table[i].hits = 1;
+        return table[i].path;
+    }
+    return NULL;
+}
+
+void path_cache_print(void) {
+    revalidate();
+    if (table_used == 0) {
+        printf("hash: hash table empty\n");
+        return;
+    }
+    printf("hits\tcommand\n");
+    for (unsigned i = 0; i < table_size; i++) {
+        if (table[i].name != NULL) {
+            printf("%4u\t%s\n", table[i].hits, table[i].path);
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+/*
+ * Cache of command name -> absolute executable path resolutions, similar to
+ * the hash table kept by bash. Every directory of PATH is watched with
+ * inotify so entries are dropped as soon as a file with the same name is
+ * created, removed, renamed or has its permissions changed in any of them.
+ * The whole cache is dropped when the value of PATH changes.
+ */
+
+/*
+ * Initialize an empty cache and set up an inotify watch for each PATH directory
+ * Returns 0 on success or -1 on error (the cache still works, but only entries
+ * from watched directories are remembered)
+ */
+int path_cache_init(void);
+
+/*
+ * Release all memory and the inotify descriptor used by the cache
+ */
+void path_cache_free(void);
+
+/*
+ * Resolve a command name to the path execve() should run
+ * Names containing a '/' are never cached
+ * name: The command name (e.g., "ls")
+ * Returns the cached absolute path (owned by the cache, valid until the next
+ * call into this module) or NULL if the name is not an executable on PATH
+ */
+const char *path_cache_lookup(const char *name);
+
+/*
+ * Add an entry for 'name' pointing at 'path' without searching PATH
+ * Returns 0 on success or -1 on error
+ */
+int path_cache_insert(const char *name, const char *path);
+
+/*
+ * Remove the entry for 'name'
+ * Returns 0 on success or -1 if there was no entry
+ */
+int path_cache_remove(const char *name);
+
+/*
+ * Remove all entries
+ */
+void path_cache_clear(void);
+
+/*
+ * Look up an entry without searching PATH or counting a hit
+ * Returns the cached path or NULL if there is no entry for 'name'
+ */
+const char *path_cache_peek(const char *name);
+
+/*
+ * Print every entry with the number of times it was used, in the format of bash's 'hash'
+ */
+void path_cache_print(void);
+
+#endif // PATH_CACHE_H
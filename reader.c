@@ -0,0 +1,125 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "reader.h"
+
+#define INITIAL_SIZE 65536
+
+int reader_init_fd(reader_t *reader, int fd) {
+    reader->fd = fd;
+    reader->cap = INITIAL_SIZE;
+    reader->start = 0;
+    reader->end = 0;
+    reader->eof = 0;
+    reader->wait = NULL;
+    reader->wait_arg = NULL;
+    if ((reader->buf = malloc(INITIAL_SIZE)) == NULL) {
+        return -1;
+    }
+    return 0;
+}
+
+int reader_init_string(reader_t *reader, const char *s) {
+    size_t len = strlen(s);
+    reader->fd = -1;
+    reader->cap = len + 1;
+    reader->start = 0;
+    reader->end = len;
+    reader->eof = 1;
+    reader->wait = NULL;
+    reader->wait_arg = NULL;
+    if ((reader->buf = malloc(len + 1)) == NULL) {
+        return -1;
+    }
+    memcpy(reader->buf, s, len + 1);
+    return 0;
+}
+
+void reader_set_wait(reader_t *reader, int (*wait)(int fd, void *arg), void *arg) {
+    reader->wait = wait;
+    reader->wait_arg = arg;
+}
+
+void reader_free(reader_t *reader) {
+    free(reader->buf);
+    reader->buf = NULL;
+}
+
+// Read another block, growing the buffer if it is full of a single partial line
+static int fill(reader_t *reader) {
+    if (reader->start > 0) {  // move the partial line to the front
+        memmove(reader->buf, reader->buf + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    if (reader->end + 1 >= reader->cap) {  // leave room for a terminating '\0'
+        char *new_buf = realloc(reader->buf, reader->cap * 2);
+        if (new_buf == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        reader->buf = new_buf;
+        reader->cap *= 2;
+    }
+
+    if (reader->wait != NULL && reader->wait(reader->fd, reader->wait_arg) != 0) {
+        return -1;
+    }
+    ssize_t n;
+    do {
+        n = read(reader->fd, reader->buf + reader->end, reader->cap - reader->end - 1);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1) {
+        perror("read");
+        return -1;
+    }
+    if (n == 0) {
+        reader->eof = 1;
+    }
+    reader->end += n;
+    return 0;
+}
+
+ssize_t reader_next(reader_t *reader, char **line) {
+    size_t scanned = reader->start;  // no '\n' before this offset
+    while (1) {
+        char *newline = memchr(reader->buf + scanned, '\n', reader->end - scanned);
+        if (newline != NULL) {
+            *newline = '\0';
+            *line = reader->buf + reader->start;
+            ssize_t len = newline - *line;
+            reader->start = newline - reader->buf + 1;
+            return len;
+        }
+        if (reader->eof) {
+            if (reader->start == reader->end) {
+                return -1;
+            }
+            // Last line without a trailing '\n'
+            reader->buf[reader->end] = '\0';
+            *line = reader->buf + reader->start;
+            ssize_t len = reader->end - reader->start;
+            reader->start = reader->end;
+            return len;
+        }
+        size_t offset = reader->end - reader->start;
+        if (fill(reader) != 0) {
+            return -1;
+        }
+        scanned = reader->start + offset;
+    }
+}
+
+void reader_sync(reader_t *reader) {
+    if (reader->fd == -1 || reader->start == reader->end) {
+        return;
+    }
+    if (lseek(reader->fd, -(off_t) (reader->end - reader->start), SEEK_CUR) != -1) {
+        reader->start = 0;
+        reader->end = 0;
+        reader->eof = 0;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef READER_H
+#define READER_H
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Buffered line reader for the shell's input: the terminal, a script file,
+ * standard input redirected from a pipe or file, or the string given to -c
+ * Input is read in large blocks and lines may be of any length
+ */
+typedef struct {
+    int fd;         // Descriptor read from, or -1 when reading from a string
+    char *buf;
+    size_t cap;     // Bytes allocated for 'buf'
+    size_t start;   // Offset of the first byte not yet returned as a line
+    size_t end;     // Offset one past the last byte read into 'buf'
+    int eof;
+    int (*wait)(int fd, void *arg);  // Called before each read() to block until 'fd' is readable
+    void *wait_arg;                  // Passed to 'wait'
+} reader_t;
+
+/*
+ * Initialize a reader that reads lines from a file descriptor
+ * Returns 0 on success or -1 on error
+ */
+int reader_init_fd(reader_t *reader, int fd);
+
+/*
+ * Initialize a reader that returns the lines of a string (e.g., the argument of -c)
+ * Returns 0 on success or -1 on error
+ */
+int reader_init_string(reader_t *reader, const char *s);
+
+/*
+ * Install a function the reader calls to block until its descriptor is
+ * readable, instead of blocking in read(). This lets the shell handle other
+ * events (e.g., children exiting) while it waits for input.
+ * wait: Returns 0 once 'fd' is readable or -1 on error
+ * arg: Passed to 'wait' along with the descriptor
+ */
+void reader_set_wait(reader_t *reader, int (*wait)(int fd, void *arg), void *arg);
+
+/*
+ * Release the memory used by a reader. The descriptor is not closed.
+ */
+void reader_free(reader_t *reader);
+
+/*
+ * Read the next line of input
+ * line: Set to the line with its trailing '\n' removed. The string lives in the
+ *       reader's buffer and is valid (and may be modified) until the next call
+ * Returns the length of the line, or -1 at end of input or on error
+ */
+ssize_t reader_next(reader_t *reader, char **line);
+
+/*
+ * Give back input that was read ahead but not returned as a line yet, so a
+ * child process sharing the descriptor starts reading where the shell stopped
+ * Only has an effect on seekable descriptors (regular files)
+ */
+void reader_sync(reader_t *reader);
+
+#endif // READER_H
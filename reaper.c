@@ -0,0 +1,264 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "deadline.h"
+#include "job_list.h"
+#include "reaper.h"
+#include "string_vector.h"
+#include "swish_funcs.h"
+#include "trace.h"
+
+int notify_jobs = 0;
+sigset_t child_sigmask;
+
+static int signal_fd = -1;
+static int sigchld_pending = 0;  // SIGCHLD taken off the signalfd by reaper_block()
+static void (*untracked_fn)(pid_t pid, int wstatus, void *arg) = NULL;
+static void *untracked_arg = NULL;
+
+int reaper_init(void) {
+    const char *notify = getenv("SWISH_NOTIFY");
+    notify_jobs = notify != NULL && strcmp(notify, "") != 0 && strcmp(notify, "0") != 0;
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, &child_sigmask) == -1) {
+        perror("sigprocmask");
+        return -1;
+    }
+    if ((signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) {
+        perror("signalfd");
+        sigprocmask(SIG_SETMASK, &child_sigmask, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+void reaper_free(void) {
+    if (signal_fd != -1) {
+        close(signal_fd);
+        signal_fd = -1;
+        sigprocmask(SIG_SETMASK, &child_sigmask, NULL);
+    }
+}
+
+void reaper_set_untracked(void (*fn)(pid_t pid, int wstatus, void *arg), void *arg) {
+    untracked_fn = fn;
+    untracked_arg = arg;
+}
+
+int reap_children(job_list_t *jobs) {
+    if (signal_fd == -1) {
+        return 0;
+    }
+    // Several SIGCHLDs may be merged into one, so the signalfd only says that
+    // wait4() is worth calling; it is then drained until nothing is left
+    struct signalfd_siginfo info[16];
+    ssize_t n = read(signal_fd, info, sizeof(info));
+    if (n == -1 && !sigchld_pending) {
+        return errno == EAGAIN ? 0 : -1;
+    }
+    sigchld_pending = 0;
+    while (read(signal_fd, info, sizeof(info)) > 0) {
+    }
+
+    int changes = 0;
+    int wstatus;
+    struct rusage usage;
+    pid_t pid;
+    while ((pid = wait4(-1, &wstatus, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {
+        job_t *job = job_list_find_pid(jobs, pid);
+        if (job == NULL) {  // not a job the shell tracks
+            if (untracked_fn != NULL) {
+                untracked_fn(pid, wstatus, untracked_arg);
+            }
+            continue;
+        }
+        changes++;
+        if (WIFSTOPPED(wstatus)) {
+            TRACE_INSTANT("stop", pid, job->name, WSTOPSIG(wstatus));
+            if (job->status != JOB_STOPPED) {
+                job->status = JOB_STOPPED;
+                job->notify = 1;
+            }
+        } else if (WIFCONTINUED(wstatus)) {
+            TRACE_INSTANT("continue", pid, job->name, 0);
+            job->status = JOB_BACKGROUND;
+        } else {
+            job_add_usage(job, &usage);
+            int status = WIFSIGNALED(wstatus) ? 128 + WTERMSIG(wstatus) : WEXITSTATUS(wstatus);
+            if (pid == job->last_pid) {
+                job->exit_status = status;
+            }
+            TRACE_EXIT(pid, &job->started, job->name, status);
+            if (job_remove_pid(job, pid) == 0) {
+                job->notify = 1;
+                if (job->timed_out) {
+                    job->exit_status = WAIT_TIMED_OUT;
+                }
+            }
+        }
+    }
+    return changes;
+}
+
+void report_status(unsigned id, const char *name, int exit_status, double elapsed) {
+    if (exit_status == 0) {
+        printf("[%u] Done\t%s", id, name);
+    } else if (exit_status > 128) {
+        printf("[%u] %s\t%s", id, strsignal(exit_status - 128), name);
+    } else {
+        printf("[%u] Exit %d\t%s", id, exit_status, name);
+    }
+    if (elapsed >= 0) {
+        printf("\t%.3fs", elapsed);
+    }
+    printf("\n");
+}
+
+void report_job(const job_t *job, int elapsed) {
+    if (job->num_pids > 0) {
+        printf("[%u] Stopped\t%s\n", job->id, job->name);
+        return;
+    }
+    report_status(job->id, job->name, job->exit_status, elapsed ? job_elapsed(job) : -1);
+}
+
+// Print seconds the way bash's time keyword does ("0m1.250s")
+static void print_time(const char *label, double seconds) {
+    int minutes = seconds / 60;
+    fprintf(stderr, "%s\t%dm%.3fs\n", label, minutes, seconds - minutes * 60);
+}
+
+void report_usage(const job_t *job) {
+    const struct rusage *usage = &job->usage;
+    fprintf(stderr, "\n");
+    print_time("real", job_elapsed(job));
+    print_time("user", usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6);
+    print_time("sys", usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6);
+    fprintf(stderr, "maxrss\t%ldKB\n", usage->ru_maxrss);
+    fprintf(stderr, "ctxsw\t%ld voluntary, %ld involuntary\n", usage->ru_nvcsw, usage->ru_nivcsw);
+    fprintf(stderr, "faults\t%ld minor, %ld major\n", usage->ru_minflt, usage->ru_majflt);
+}
+
+void report_jobs(job_list_t *jobs) {
+    if (!notify_jobs) {
+        return;
+    }
+    job_t *current = job_list_next(jobs, NULL);
+    while (current != NULL) {  // IDs are stable, so removing a job does not renumber the rest
+        if (current->notify) {
+            current->notify = 0;
+            report_job(current, 0);
+            if (current->num_pids == 0) {
+                job_list_remove(jobs, current->id);
+            }
+        }
+        current = job_list_next(jobs, current);
+    }
+}
+
+int reaper_wait(job_list_t *jobs, int timeout_ms) {
+    if (signal_fd == -1) {
+        fprintf(stderr, "reaper_wait: reaper not initialized\n");
+        return -1;
+    }
+    // Output of background jobs is drained while waiting (see capture.h), and
+    // deadlines fire (see deadline.h)
+    struct pollfd fds[3] = {
+        { .fd = signal_fd, .events = POLLIN },
+        { .fd = capture_fd(), .events = POLLIN },
+        { .fd = deadline_fd(), .events = POLLIN },
+    };
+    int ready = poll(fds, 3, timeout_ms);
+    if (ready == -1) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        perror("poll");
+        return -1;
+    }
+    if (fds[1].revents & POLLIN) {
+        capture_drain();
+    }
+    if (fds[2].revents & POLLIN) {
+        deadline_expire(NULL);
+    }
+    if (!(fds[0].revents & POLLIN)) {
+        return 0;
+    }
+    return reap_children(jobs) == -1 ? -1 : 1;
+}
+
+int reaper_wait_input(int fd, void *arg) {
+    job_list_t *jobs = arg;
+    struct pollfd fds[4] = {
+        { .fd = fd, .events = POLLIN },
+        { .fd = signal_fd, .events = POLLIN },
+        { .fd = -1, .events = POLLIN },
+        { .fd = -1, .events = POLLIN },
+    };
+    while (1) {
+        fds[2].fd = capture_fd();  // jobs may have been started or closed their output
+        fds[3].fd = deadline_fd();
+        if (poll(fds, 4, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            return -1;
+        }
+        if (fds[1].revents & POLLIN) {
+            reap_children(jobs);
+        }
+        if (fds[2].revents & POLLIN) {
+            capture_drain();
+        }
+        if (fds[3].revents & POLLIN) {
+            deadline_expire(NULL);
+        }
+        if (fds[0].revents != 0) {
+            return 0;
+        }
+    }
+}
+
+int reaper_block(job_t *foreground) {
+    struct pollfd fds[3] = {
+        { .fd = signal_fd, .events = POLLIN },
+        { .fd = capture_fd(), .events = POLLIN },
+        { .fd = deadline_fd(), .events = POLLIN },
+    };
+    if (poll(fds, 3, -1) == -1) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        perror("poll");
+        return -1;
+    }
+    if (fds[0].revents & POLLIN) {
+        // The caller reaps its own processes; others are left for reap_children()
+        struct signalfd_siginfo info[16];
+        while (read(signal_fd, info, sizeof(info)) > 0) {
+        }
+        sigchld_pending = 1;
+    }
+    if (fds[1].revents & POLLIN) {
+        capture_drain();
+    }
+    if (fds[2].revents & POLLIN) {
+        deadline_expire(foreground);
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+#ifndef REAPER_H
+#define REAPER_H
+#include <signal.h>
+
+#include "job_list.h"
+
+/*
+ * Asynchronous reaping of background jobs
+ * SIGCHLD is blocked in the shell and delivered through a signalfd, which is
+ * polled together with the shell's input. Children are reaped as soon as they
+ * exit or stop, even while the shell sits at the prompt, so finished jobs
+ * never linger as zombies.
+ */
+
+/*
+ * Nonzero to print bash-style notices ("[0] Done  sleep") before each prompt and
+ * drop finished jobs from the jobs list once reported. Set from SWISH_NOTIFY.
+ * Without it, finished jobs stay in the list until collected with wait-for,
+ * wait-all or fg.
+ */
+extern int notify_jobs;
+
+/*
+ * Signal mask that child processes must start with: the shell's mask from
+ * before SIGCHLD was blocked
+ */
+extern sigset_t child_sigmask;
+
+/*
+ * Block SIGCHLD and create the signalfd used to learn about child state changes
+ * Reads SWISH_NOTIFY from the environment
+ * Returns 0 on success or -1 on error
+ */
+int reaper_init(void);
+
+/*
+ * Close the signalfd and restore the shell's original signal mask
+ */
+void reaper_free(void);
+
+/*
+ * Install a function that reap_children() calls for children that are not part
+ * of any job in the list (e.g., the workers of the parallel builtin), which
+ * are otherwise reaped and forgotten
+ * fn: Receives the child's pid and its waitpid() status, or NULL to remove the function
+ * arg: Passed to 'fn'
+ */
+void reaper_set_untracked(void (*fn)(pid_t pid, int wstatus, void *arg), void *arg);
+
+/*
+ * Reap every child that has exited, stopped or continued, without blocking
+ * The matching jobs are updated: exited processes are removed from their job,
+ * the exit status is recorded, and stopped/continued jobs change status
+ * Returns the number of state changes processed, or -1 on error
+ */
+int reap_children(job_list_t *jobs);
+
+/*
+ * Print one job's state the way report_jobs() does ("[0] Done  sleep")
+ * job: The job to describe
+ * elapsed: Nonzero to also print how long a finished job ran, in seconds
+ */
+void report_job(const job_t *job, int elapsed);
+
+/*
+ * Print a job's wall-clock time and resource usage to stderr, in the format
+ * of bash's time keyword followed by memory, context switch and page fault counts
+ * Only processes that have exited are counted
+ */
+void report_usage(const job_t *job);
+
+/*
+ * Print the notice for a finished job or task ("[3] Exit 1  name  0.250s")
+ * id: Number shown in brackets
+ * name: Printed after the status
+ * exit_status: Exit status in shell terms (128 + n if killed by signal n)
+ * elapsed: Run time in seconds, or a negative number to leave it out
+ */
+void report_status(unsigned id, const char *name, int exit_status, double elapsed);
+
+/*
+ * Print a notice for every job whose state changed in the background (if
+ * notify_jobs is set) and remove the finished ones from the list
+ */
+void report_jobs(job_list_t *jobs);
+
+/*
+ * Block until a child changes state or the timeout expires, then reap
+ * Callers loop on this until the jobs they wait for are done, checking their
+ * state (and their own deadline) after each call
+ * jobs: The shell's jobs list, updated as in reap_children()
+ * timeout_ms: Longest time to block in milliseconds, or -1 for no limit
+ * Returns 1 if SIGCHLD arrived, 0 on timeout (or when interrupted), or -1 on error
+ */
+int reaper_wait(job_list_t *jobs, int timeout_ms);
+
+/*
+ * Block until 'fd' is readable, reaping children whenever SIGCHLD arrives
+ * Suitable as the wait function of a reader_t
+ * fd: Descriptor to wait for
+ * arg: The shell's job_list_t
+ * Returns 0 once 'fd' is readable (or at end of file) or -1 on error
+ */
+int reaper_wait_input(int fd, void *arg);
+
+/*
+ * Block until a child changes state or a deadline passes, without reaping
+ * For wait_job(), which reaps the foreground job's processes itself; other
+ * children are left for the next reap_children()
+ * foreground: The job being waited for, signalled if its deadline passes
+ * Returns 0 once woken (or when interrupted) or -1 on error
+ */
+int reaper_block(job_t *foreground);
+
+#endif // REAPER_H
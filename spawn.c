@@ -0,0 +1,386 @@
+#define _GNU_SOURCE  // F_SETPIPE_SZ, pipe2()
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "forkserver.h"
+#include "job_list.h"
+#include "job_opts.h"
+#include "path_cache.h"
+#include "reaper.h"
+#include "spawn.h"
+#include "string_vector.h"
+#include "swish_funcs.h"
+#include "trace.h"
+#include "vars.h"
+
+extern char **environ;
+
+int spawn_mode = SPAWN_DEFAULT_MODE;
+int pipe_size = 0;
+
+// Tokens of one pipeline stage, reused so launching a pipeline allocates nothing
+// once the arena has grown to fit the longest stage
+static strvec_t stage;
+static int stage_ready = 0;
+
+int spawn_init(void) {
+    const char *mode = getenv("SWISH_SPAWN");
+    if (mode != NULL) {
+        if (strcmp(mode, "fork") == 0) {
+            spawn_mode = SPAWN_MODE_FORK;
+        } else if (strcmp(mode, "spawn") == 0) {
+            spawn_mode = SPAWN_MODE_POSIX;
+        } else if (strcmp(mode, "server") == 0) {
+            spawn_mode = SPAWN_MODE_SERVER;
+        } else {
+            fprintf(stderr, "Unknown SWISH_SPAWN mode '%s'\n", mode);
+            return -1;
+        }
+    }
+
+    const char *size = getenv("SWISH_PIPE_SIZE");
+    if (size != NULL) {
+        char *end;
+        long n = strtol(size, &end, 10);
+        if (*size == '\0' || *end != '\0' || n < 0 || n > 0x7fffffff) {
+            fprintf(stderr, "Invalid SWISH_PIPE_SIZE '%s'\n", size);
+            return -1;
+        }
+        pipe_size = n;
+    }
+    return 0;
+}
+
+// Resolve a program with the PATH cache, which follows the shell's own PATH.
+// For a command that overrides PATH ("PATH=/opt/bin cmd"), NULL is returned
+// so that exec searches the overriding PATH instead.
+static const char *find_program(const char *name) {
+    return vars_overridden("PATH") ? NULL : path_cache_lookup(name);
+}
+
+void spawn_start(void) {
+    if (spawn_mode == SPAWN_MODE_SERVER) {
+        fflush(stdout);  // the helper must not inherit (and later repeat) buffered output
+        if (forkserver_start() != 0) {
+            fprintf(stderr, "Fork server unavailable, using posix_spawn()\n");
+            spawn_mode = SPAWN_MODE_POSIX;
+        }
+    }
+}
+
+static pid_t fork_command(strvec_t *tokens, pid_t pgid, int in_fd, int out_fd, int err_fd) {
+    // Resolve in the shell so the cache (and its hit counts) persist across commands
+    const char *path = find_program(strvec_get(tokens, 0));
+    uint64_t trace_start = TRACE_CLOCK();
+    pid_t child_pid = fork();
+    if (child_pid == -1) {
+        perror("fork");
+        return -1;
+    } else if (child_pid == 0) {
+        if (TRACE_ON) {
+            trace_child();
+        }
+        sigprocmask(SIG_SETMASK, &child_sigmask, NULL);  // unblock SIGCHLD
+        if ((in_fd != -1 && dup2(in_fd, STDIN_FILENO) == -1) ||
+            (out_fd != -1 && dup2(out_fd, STDOUT_FILENO) == -1) ||
+            (err_fd != -1 && dup2(err_fd, STDERR_FILENO) == -1)) {
+            perror("dup2");
+            _exit(1);
+        }
+        const job_opts_t *opts = job_opts_active();
+        if (opts != NULL && job_opts_apply(opts) != 0) {
+            _exit(1);
+        }
+        run_command(tokens, job_control ? pgid : -1, path);
+        _exit(127);  // only reached if run_command() failed, never return into the shell's loop
+    }
+    TRACE_COMPLETE("fork", trace_start, 0, strvec_get(tokens, 0));
+    TRACE_NAME(child_pid, strvec_get(tokens, 0));
+    // Also set the process group from the parent so it is in place before tcsetpgrp()
+    if (job_control) {
+        trace_start = TRACE_CLOCK();
+        setpgid(child_pid, pgid == 0 ? child_pid : pgid);
+        TRACE_COMPLETE("setpgid", trace_start, 0, NULL);
+    }
+    return child_pid;
+}
+
+static pid_t posix_spawn_command(strvec_t *tokens, pid_t pgid, int in_fd, int out_fd, int err_fd) {
+    // Redirections are opened in the shell so errors are reported exactly as in
+    // run_command(). O_CLOEXEC keeps the originals out of the child; dup2() clears
+    // the flag on the copies installed as stdin/stdout.
+    int fdr, fdw;
+    uint64_t trace_start = TRACE_CLOCK();
+    if (open_redirects(tokens, &fdr, &fdw, O_CLOEXEC) != 0) {
+        return -1;
+    }
+    if (fdr != -1 || fdw != -1) {
+        TRACE_COMPLETE("redirects", trace_start, 0, NULL);
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t defaults;
+    int ret;
+    if ((ret = posix_spawn_file_actions_init(&actions)) != 0) {
+        fprintf(stderr, "posix_spawn_file_actions_init: %s\n", strerror(ret));
+        close_redirects(fdr, fdw);
+        return -1;
+    }
+    if ((ret = posix_spawnattr_init(&attr)) != 0) {
+        fprintf(stderr, "posix_spawnattr_init: %s\n", strerror(ret));
+        posix_spawn_file_actions_destroy(&actions);
+        close_redirects(fdr, fdw);
+        return -1;
+    }
+
+    // Same child setup as run_command(): default SIGTTIN/SIGTTOU, process group
+    // (only with job control), then pipe ends followed by explicit redirections
+    // (which take precedence)
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGTTIN);
+    sigaddset(&defaults, SIGTTOU);
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;  // the mask unblocks SIGCHLD
+    if (job_control) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+    if ((ret = posix_spawnattr_setsigdefault(&attr, &defaults)) != 0 ||
+        (ret = posix_spawnattr_setsigmask(&attr, &child_sigmask)) != 0 ||
+        (ret = posix_spawnattr_setpgroup(&attr, pgid)) != 0 ||
+        (ret = posix_spawnattr_setflags(&attr, flags)) != 0 ||
+        (in_fd != -1 && (ret = posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO)) != 0) ||
+        (out_fd != -1 && (ret = posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO)) != 0) ||
+        (err_fd != -1 && (ret = posix_spawn_file_actions_adddup2(&actions, err_fd, STDERR_FILENO)) != 0) ||
+        (fdr != -1 && (ret = posix_spawn_file_actions_adddup2(&actions, fdr, STDIN_FILENO)) != 0) ||
+        (fdw != -1 && (ret = posix_spawn_file_actions_adddup2(&actions, fdw, STDOUT_FILENO)) != 0)) {
+        fprintf(stderr, "posix_spawn setup: %s\n", strerror(ret));
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&actions);
+        close_redirects(fdr, fdw);
+        return -1;
+    }
+
+    char **strarr = strvec_argv(tokens);
+    if (strarr[0] == NULL) {
+        fprintf(stderr, "No command specified\n");
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&actions);
+        close_redirects(fdr, fdw);
+        return -1;
+    }
+
+    // A cached path skips the PATH walk (and its failed execve() calls) entirely
+    pid_t child_pid;
+    const char *path = find_program(strarr[0]);
+    trace_start = TRACE_CLOCK();
+    if (path != NULL) {
+        ret = posix_spawn(&child_pid, path, &actions, &attr, strarr, vars_envp());
+    } else {
+        // posix_spawnp() searches the PATH of 'environ', not of the envp it is given
+        char **saved_environ = environ;
+        environ = vars_envp();
+        ret = posix_spawnp(&child_pid, strarr[0], &actions, &attr, strarr, vars_envp());
+        environ = saved_environ;
+    }
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    close_redirects(fdr, fdw);
+    if (ret != 0) {  // exec failures are reported to the parent with vfork semantics
+        fprintf(stderr, "exec: %s\n", strerror(ret));
+        return -1;
+    }
+    // posix_spawn() returns once the child has exec()'d, so this covers clone() through execve()
+    TRACE_COMPLETE("posix_spawn", trace_start, 0, strarr[0]);
+    TRACE_NAME(child_pid, strarr[0]);
+    return child_pid;
+}
+
+static pid_t server_command(strvec_t *tokens, pid_t pgid, int in_fd, int out_fd, int err_fd, int foreground) {
+    // As for posix_spawn(), redirections are opened in the shell; the helper
+    // receives copies of the descriptors, so the shell closes its own right away
+    int fdr, fdw;
+    uint64_t trace_start = TRACE_CLOCK();
+    if (open_redirects(tokens, &fdr, &fdw, O_CLOEXEC) != 0) {
+        return -1;
+    }
+    if (fdr != -1 || fdw != -1) {
+        TRACE_COMPLETE("redirects", trace_start, 0, NULL);
+    }
+    char **strarr = strvec_argv(tokens);
+    if (strarr[0] == NULL) {
+        fprintf(stderr, "No command specified\n");
+        close_redirects(fdr, fdw);
+        return -1;
+    }
+    // Explicit redirections take precedence over pipe ends, which take
+    // precedence over the shell's own descriptors
+    int fds[3] = {
+        fdr != -1 ? fdr : in_fd != -1 ? in_fd : STDIN_FILENO,
+        fdw != -1 ? fdw : out_fd != -1 ? out_fd : STDOUT_FILENO,
+        err_fd != -1 ? err_fd : STDERR_FILENO,
+    };
+    const char *path = find_program(strarr[0]);
+    // Without job control, children stay in the shell's process group
+    pid_t child_pgid = job_control ? pgid : getpgrp();
+    trace_start = TRACE_CLOCK();
+    pid_t child_pid = forkserver_spawn(path, strarr, fds, child_pgid, job_control && foreground, job_opts_active());
+    close_redirects(fdr, fdw);
+    if (child_pid == -1) {
+        return -1;
+    }
+    // The helper replies once the child exists, before it has exec()'d
+    TRACE_COMPLETE("forkserver", trace_start, 0, strarr[0]);
+    TRACE_NAME(child_pid, strarr[0]);
+    // The child is the shell's own, so as after fork(), set its process group
+    // here too so it is in place before tcsetpgrp()
+    if (job_control) {
+        setpgid(child_pid, pgid == 0 ? child_pid : pgid);
+    }
+    return child_pid;
+}
+
+pid_t spawn_command(strvec_t *tokens, pid_t pgid, int in_fd, int out_fd, int err_fd, int foreground) {
+    if (spawn_mode == SPAWN_MODE_SERVER) {
+        return server_command(tokens, pgid, in_fd, out_fd, err_fd, foreground);
+    }
+    // posix_spawn() has no attributes for CPU affinity, priorities or resource
+    // limits, so children that need them are always fork()'d
+    if (spawn_mode == SPAWN_MODE_FORK || job_opts_active() != NULL) {
+        return fork_command(tokens, pgid, in_fd, out_fd, err_fd);
+    }
+    return posix_spawn_command(tokens, pgid, in_fd, out_fd, err_fd);
+}
+
+int spawn_job(strvec_t *tokens, job_t *job, int out_fd, int err_fd, int foreground) {
+    // Children must not inherit (and later repeat) output the shell has buffered
+    fflush(stdout);
+
+    // Reject an empty command or pipeline stage (e.g., "&" alone, "| cat" or
+    // "echo a |") before anything is started
+    unsigned num_stages = 1;
+    unsigned stage_length = 0;
+    for (unsigned i = 0; i < tokens->length; i++) {
+        if (strcmp(strvec_get(tokens, i), PIPE_OPERATOR) != 0) {
+            stage_length++;
+        } else if (stage_length == 0) {
+            break;
+        } else {
+            num_stages++;
+            stage_length = 0;
+        }
+    }
+    if (stage_length == 0) {
+        fprintf(stderr, "No command specified\n");
+        return -1;
+    }
+    if ((job->pids = malloc(num_stages * sizeof(pid_t))) == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    strncpy(job->name, strvec_get(tokens, 0), NAME_LEN);
+    job->name[NAME_LEN - 1] = '\0';
+    job->pid = 0;
+    job->num_pids = 0;
+    job->last_pid = 0;
+    job->exit_status = 0;
+    job->timed_out = 0;
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+    memset(&job->usage, 0, sizeof(job->usage));
+
+    if (num_stages == 1) {  // common case: no pipes, no copying of tokens
+        pid_t child_pid = spawn_command(tokens, 0, -1, out_fd, err_fd, foreground);
+        if (child_pid == -1) {
+            free(job->pids);
+            job->pids = NULL;
+            return -1;
+        }
+        job->pid = child_pid;
+        job->pids[job->num_pids++] = child_pid;
+        job->last_pid = child_pid;
+        job->exit_status = 0;
+        return 0;
+    }
+
+    if (!stage_ready) {
+        if (strvec_init_arena(&stage) != 0) {
+            perror("strvec_init_arena");
+            free(job->pids);
+            job->pids = NULL;
+            return -1;
+        }
+        stage_ready = 1;
+    }
+    int in_fd = -1;  // read end of the pipe feeding the current stage
+    unsigned next = 0;
+    for (unsigned s = 0; s < num_stages; s++) {
+        strvec_clear(&stage);
+        while (next < tokens->length && strcmp(strvec_get(tokens, next), PIPE_OPERATOR) != 0) {
+            if (strvec_add(&stage, strvec_get(tokens, next)) != 0) {
+                perror("strvec_add");
+                break;
+            }
+            next++;
+        }
+        next++;  // skip the "|"
+
+        int pipe_fds[2] = {-1, -1};
+        if (s < num_stages - 1) {
+            if (pipe2(pipe_fds, O_CLOEXEC) == -1) {
+                perror("pipe");
+                break;
+            }
+            if (pipe_size > 0 && fcntl(pipe_fds[1], F_SETPIPE_SZ, pipe_size) == -1) {
+                perror("fcntl F_SETPIPE_SZ");
+            }
+        }
+
+        pid_t child_pid = spawn_command(&stage, job->pid, in_fd, s < num_stages - 1 ? pipe_fds[1] : out_fd, err_fd,
+                                        foreground);
+        if (child_pid != -1) {
+            if (job->pid == 0) {
+                job->pid = child_pid;  // first process started leads the group
+            }
+            job->pids[job->num_pids++] = child_pid;
+        }
+        if (s == num_stages - 1) {
+            job->last_pid = child_pid;
+            job->exit_status = child_pid == -1 ? 127 : 0;
+        }
+
+        // The children hold their own copies; the shell keeps only the next read end
+        if (in_fd != -1) {
+            close(in_fd);
+        }
+        if (pipe_fds[1] != -1) {
+            close(pipe_fds[1]);
+        }
+        in_fd = pipe_fds[0];
+    }
+    if (in_fd != -1) {
+        close(in_fd);
+    }
+    strvec_clear(&stage);
+
+    if (job->num_pids == 0) {
+        free(job->pids);
+        job->pids = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void spawn_free(void) {
+    forkserver_stop();
+    if (stage_ready) {
+        strvec_free(&stage);
+        stage_ready = 0;
+    }
+}
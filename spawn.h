@@ -0,0 +1,87 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+#include <sys/types.h>
+
+#include "job_list.h"
+#include "string_vector.h"
+
+#define SPAWN_MODE_FORK 0
+#define SPAWN_MODE_POSIX 1
+#define SPAWN_MODE_SERVER 2
+
+// Launch mode used when SWISH_SPAWN is not set in the environment
+#ifndef SPAWN_DEFAULT_MODE
+#define SPAWN_DEFAULT_MODE SPAWN_MODE_POSIX
+#endif
+
+#define PIPE_OPERATOR "|"
+
+/*
+ * Launch mode used by spawn_command(): SPAWN_MODE_FORK runs fork() followed by
+ * run_command() in the child, SPAWN_MODE_POSIX uses posix_spawnp(), which glibc
+ * implements with clone(CLONE_VM | CLONE_VFORK) so the shell's memory is never copied,
+ * SPAWN_MODE_SERVER hands commands to a helper process (see forkserver.h)
+ */
+extern int spawn_mode;
+
+/*
+ * Capacity in bytes requested with F_SETPIPE_SZ for every pipe between
+ * pipeline stages, or 0 to keep the kernel default (64 KiB on Linux)
+ */
+extern int pipe_size;
+
+/*
+ * Read launch settings from the environment:
+ *   SWISH_SPAWN: "fork", "spawn" or "server", falling back to SPAWN_DEFAULT_MODE
+ *   SWISH_PIPE_SIZE: pipe capacity in bytes for pipelines
+ * Returns 0 on success or -1 if a variable holds an invalid value
+ */
+int spawn_init(void);
+
+/*
+ * Start the fork server if the launch mode asks for one, falling back to
+ * SPAWN_MODE_POSIX (with a message) if it cannot be started
+ * Call once signals are set up (after reaper_init()), since the helper's
+ * children start from its copy of the shell's state
+ */
+void spawn_start(void);
+
+/*
+ * Launch a user-specified command (including arguments and redirections)
+ * in a new child process
+ * Signal dispositions for SIGTTIN and SIGTTOU are reset to their defaults
+ * tokens: Vector containing tokens input by user into shell. Redirection
+ *         operators and file names are removed from the vector
+ * pgid: Process group for the child, or 0 to place it in a new group it leads
+ * in_fd, out_fd, err_fd: Descriptors installed as the child's stdin/stdout/stderr
+ *                        before redirections are applied, or -1 to inherit the shell's
+ * foreground: Nonzero if the shell hands the terminal to the child's process
+ *             group once it is started. With the fork server, the child takes
+ *             the terminal itself before exec(), as it may run before the shell
+ *             hears of it
+ * Returns the child's process ID on success or -1 on error
+ */
+pid_t spawn_command(strvec_t *tokens, pid_t pgid, int in_fd, int out_fd, int err_fd, int foreground);
+
+/*
+ * Launch a command line as a single job
+ * The line may be a pipeline ("cmd1 | cmd2 | ..."): every stage is connected
+ * to the next one with a pipe and all stages share one process group
+ * (without job control, they stay in the shell's process group instead)
+ * tokens: Vector containing tokens input by user into shell
+ * job: Filled in with the job's process group, name and pids (malloc()'d,
+ *      owned by the caller). The status field is left untouched
+ * out_fd: Descriptor installed as the last stage's stdout before its
+ *         redirections are applied, or -1 to inherit the shell's
+ * err_fd: Descriptor installed as every stage's stderr, or -1 to inherit the shell's
+ * foreground: Nonzero for a job the shell waits for in the foreground (see spawn_command())
+ * Returns 0 if at least one process was started or -1 on error
+ */
+int spawn_job(strvec_t *tokens, job_t *job, int out_fd, int err_fd, int foreground);
+
+/*
+ * Stop the fork server and release memory kept by the spawn engine between launches
+ */
+void spawn_free(void);
+
+#endif // SPAWN_H
@@ -3,29 +3,115 @@
 #include "string_vector.h"
 
 #define INITIAL_SIZE 4
+#define INITIAL_ARENA_SIZE 256
+
+unsigned long strvec_alloc_count = 0;
+unsigned long strvec_free_count = 0;
+
+static void *counted_malloc(size_t size) {
+    strvec_alloc_count++;
+    return malloc(size);
+}
+
+static void *counted_realloc(void *ptr, size_t size) {
+    strvec_alloc_count++;
+    return realloc(ptr, size);
+}
+
+static void counted_free(void *ptr) {
+    if (ptr != NULL) {
+        strvec_free_count++;
+        free(ptr);
+    }
+}
 
 int strvec_init(strvec_t *vec) {
     vec->length = 0;
     vec->capacity = INITIAL_SIZE;
-    vec->data = malloc(INITIAL_SIZE * sizeof(char *));
+    vec->is_arena = 0;
+    vec->arena = NULL;
+    vec->arena_len = 0;
+    vec->arena_cap = 0;
+    vec->data = counted_malloc(INITIAL_SIZE * sizeof(char *));
     if (vec->data == NULL) {
         return -1;
     }
+    vec->data[0] = NULL;
+
+    return 0;
+}
 
+int strvec_init_arena(strvec_t *vec) {
+    if (strvec_init(vec) != 0) {
+        return -1;
+    }
+    vec->is_arena = 1;
+    vec->arena_cap = INITIAL_ARENA_SIZE;
+    if ((vec->arena = counted_malloc(INITIAL_ARENA_SIZE)) == NULL) {
+        counted_free(vec->data);
+        vec->capacity = 0;
+        return -1;
+    }
     return 0;
 }
 
 void strvec_clear(strvec_t *vec) {
+    if (vec->is_arena) {  // keep the memory for the next round
+        vec->length = 0;
+        vec->arena_len = 0;
+        vec->data[0] = NULL;
+        return;
+    }
     if (vec->capacity == 0) {
         return;
     }
     for (int i = 0; i < vec->length; i++) {
-        free(vec->data[i]);
+        counted_free(vec->data[i]);
     }
-    free(vec->data);
+    counted_free(vec->data);
+
+    vec->length = 0;
+    vec->capacity = 0;
+}
 
+void strvec_free(strvec_t *vec) {
+    if (!vec->is_arena) {
+        strvec_clear(vec);
+        return;
+    }
+    counted_free(vec->data);
+    counted_free(vec->arena);
+    vec->data = NULL;
+    vec->arena = NULL;
     vec->length = 0;
     vec->capacity = 0;
+    vec->arena_len = 0;
+    vec->arena_cap = 0;
+    vec->is_arena = 0;
+}
+
+// Make room for 'len' more bytes in the arena, moving existing elements if needed
+static int reserve_arena(strvec_t *vec, size_t len) {
+    if (vec->arena_len + len <= vec->arena_cap) {
+        return 0;
+    }
+    size_t new_cap = vec->arena_cap;
+    while (vec->arena_len + len > new_cap) {
+        new_cap *= 2;
+    }
+    char *new_arena = counted_malloc(new_cap);
+    if (new_arena == NULL) {
+        return -1;
+    }
+    // Elements are located by their offset in the arena, so rebase them on the new buffer
+    memcpy(new_arena, vec->arena, vec->arena_len);
+    for (unsigned i = 0; i < vec->length; i++) {
+        vec->data[i] = new_arena + (vec->data[i] - vec->arena);
+    }
+    counted_free(vec->arena);
+    vec->arena = new_arena;
+    vec->arena_cap = new_cap;
+    return 0;
 }
 
 int strvec_add(strvec_t *vec, const char *s) {
@@ -36,9 +122,9 @@ int strvec_add(strvec_t *vec, const char *s) {
         }
     }
 
-    if (vec->length == vec->capacity) {
+    if (vec->length + 1 == vec->capacity) {  // keep room for the NULL sentinel
         // Expand underlying array
-        char **new_data = realloc(vec->data, 2 * vec->capacity * sizeof(char *));
+        char **new_data = counted_realloc(vec->data, 2 * vec->capacity * sizeof(char *));
         if (new_data == NULL) {
             return -1;
         } else {
@@ -47,11 +133,19 @@ int strvec_add(strvec_t *vec, const char *s) {
         vec->capacity = vec->capacity * 2;
     }
 
-    if ((vec->data[vec->length] = malloc((strlen(s) + 1) * sizeof(char))) == NULL) {
+    size_t len = strlen(s) + 1;
+    if (vec->is_arena) {
+        if (reserve_arena(vec, len) != 0) {
+            return -1;
+        }
+        vec->data[vec->length] = vec->arena + vec->arena_len;
+        vec->arena_len += len;
+    } else if ((vec->data[vec->length] = counted_malloc(len * sizeof(char))) == NULL) {
         return -1;
     }
-    strcpy(vec->data[vec->length], s);
+    memcpy(vec->data[vec->length], s, len);
     vec->length++;
+    vec->data[vec->length] = NULL;
     return 0;
 }
 
@@ -63,6 +157,10 @@ char *strvec_get(const strvec_t *vec, unsigned i) {
     return vec->data[i];
 }
 
+char **strvec_argv(strvec_t *vec) {
+    return vec->data;
+}
+
 int strvec_find(const strvec_t *vec, const char *s) {
     for (int i = 0; i < vec->length; i++) {
         if (strcmp(vec->data[i], s) == 0) {
@@ -73,12 +171,35 @@ int strvec_find(const strvec_t *vec, const char *s) {
 }
 
 void strvec_take(strvec_t *vec, unsigned n) {
-    if (n > vec->length) {
-        n = vec->length;
+    if (n >= vec->length) {
+        return;
     }
 
-    for (int i = n; i < vec->length; i++) {
-        free(vec->data[i]);
+    if (vec->is_arena) {
+        // Elements are laid out in order, so everything from element n on is unused
+        vec->arena_len = vec->data[n] - vec->arena;
+    } else {
+        for (int i = n; i < vec->length; i++) {
+            counted_free(vec->data[i]);
+        }
     }
     vec->length = n;
+    vec->data[n] = NULL;
+}
+
+void strvec_drop(strvec_t *vec, unsigned n) {
+    if (n > vec->length) {
+        n = vec->length;
+    }
+    if (n == 0) {
+        return;
+    }
+    if (!vec->is_arena) {
+        for (unsigned i = 0; i < n; i++) {
+            counted_free(vec->data[i]);
+        }
+    }
+    // In arena mode the text of dropped elements stays in the arena until the vector is cleared
+    memmove(vec->data, vec->data + n, (vec->length - n + 1) * sizeof(char *));  // includes the NULL sentinel
+    vec->length -= n;
 }
@@ -1,12 +1,26 @@
 #ifndef STRING_VECTOR_H
 #define STRING_VECTOR_H
+#include <stddef.h>
 
 typedef struct {
     unsigned int length;
     unsigned int capacity;
-    char **data;
+    char **data;        // Always has a NULL entry after the last element
+    // Arena mode only (see strvec_init_arena())
+    int is_arena;
+    char *arena;        // Holds the text of every element back to back
+    size_t arena_len;   // Bytes of 'arena' in use
+    size_t arena_cap;   // Bytes allocated for 'arena'
 } strvec_t;
 
+/*
+ * Number of malloc()/realloc() and free() calls made by string vectors since
+ * the program started. Lets tests check that a loop reusing an arena-backed
+ * vector has stopped allocating.
+ */
+extern unsigned long strvec_alloc_count;
+extern unsigned long strvec_free_count;
+
 /*
  * Initializes a new, empty string vector
  * vec: Pointer to the vector to initialize
@@ -14,14 +28,32 @@ typedef struct {
  */
 int strvec_init(strvec_t *vec);
 
+/*
+ * Initializes a new, empty string vector in arena mode
+ * The text of every element is stored back to back in one buffer owned by
+ * the vector. strvec_clear() and strvec_take() only reset lengths, so once the
+ * vector has grown to fit the longest input, reusing it allocates nothing.
+ * vec: Pointer to the vector to initialize
+ * Returns 0 on success, -1 on error
+ * Note: Release the memory with strvec_free() when the vector is no longer needed
+ */
+int strvec_init_arena(strvec_t *vec);
+
 /*
  * Removes all entries from a string vector
- * The underlying memory for the vector is also freed
+ * The underlying memory for the vector is also freed, unless the vector is in arena mode
  * vec: Pointer to the vector to clear
  * Note: You MUST re-initialize this vector with strvec_init() if you want to use it again
+ *       (arena-mode vectors can be reused directly)
  */
 void strvec_clear(strvec_t *vec);
 
+/*
+ * Removes all entries from a string vector and frees all of its memory, in either mode
+ * vec: Pointer to the vector to free
+ */
+void strvec_free(strvec_t *vec);
+
 /*
  * Add a new string to a string vector
  * vec: Pointer to the vector to add to
@@ -39,6 +71,14 @@ int strvec_add(strvec_t *vec, const char *s);
  */
 char *strvec_get(const strvec_t *vec, unsigned i);
 
+/*
+ * Get the elements of a string vector as a NULL-terminated array, e.g., for exec()
+ * No copy is made: the array is valid until the vector is next modified
+ * vec: Pointer to an initialized vector
+ * Returns the array of 'vec->length' strings followed by NULL
+ */
+char **strvec_argv(strvec_t *vec);
+
 /*
  * Search for a specific string within a string vector
  * vec: Pointer to the vector to search within
@@ -54,4 +94,11 @@ int strvec_find(const strvec_t *vec, const char *s);
  */
 void strvec_take(strvec_t *vec, unsigned n);
 
+/*
+ * Remove the first 'n' elements of a string vector, moving the rest to the front
+ * vec: Pointer to string vector to shorten
+ * n: Number of elements to remove
+ */
+void strvec_drop(strvec_t *vec, unsigned n);
+
 #endif // STRING_VECTOR_H
@@ -0,0 +1,300 @@
+#define _GNU_SOURCE  // F_SETPIPE_SZ, pipe2()
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "job_list.h"
+#include "spawn.h"
+#include "string_vector.h"
+#include "subst.h"
+#include "swish_funcs.h"
+#include "trace.h"
+#include "vars.h"
+#include "wildcard.h"
+
+#define CAPTURE_INITIAL_SIZE 4096
+
+static char *capture = NULL;
+static size_t capture_len = 0;
+static size_t capture_cap = 0;
+static char *line = NULL;  // Words joined again for subst_tokenize(), which modifies them
+static size_t line_cap = 0;
+
+// A token being assembled from text and substituted output
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} word_t;
+
+static int word_append(word_t *word, char c) {
+    if (word->len + 1 >= word->cap) {  // keep room for the '\0'
+        size_t new_cap = word->cap == 0 ? 64 : word->cap * 2;
+        char *new_data = realloc(word->data, new_cap);
+        if (new_data == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        word->data = new_data;
+        word->cap = new_cap;
+    }
+    word->data[word->len++] = c;
+    return 0;
+}
+
+// Nonzero if the word being built is the value of a leading "NAME=value"
+// assignment, which (as in sh) is neither split into words nor expanded as a
+// pattern
+static int in_assignment(word_t *word, strvec_t *tokens) {
+    if (word->len == 0) {
+        return 0;
+    }
+    word->data[word->len] = '\0';  // word_append() keeps room for it
+    if (!vars_is_assignment(word->data)) {
+        return 0;
+    }
+    for (unsigned i = 0; i < tokens->length; i++) {
+        if (!vars_is_assignment(strvec_get(tokens, i))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Add the word to 'tokens' (if it has any text), or the pathnames it matches
+// if it is a pattern, and start a new one
+static int word_end(word_t *word, strvec_t *tokens) {
+    if (word->len == 0) {
+        return 0;
+    }
+    word->data[word->len] = '\0';
+    if (wildcard_has_pattern(word->data) && !in_assignment(word, tokens)) {
+        int matches = wildcard_expand(word->data, tokens);
+        if (matches != 0) {  // a pattern matching nothing is kept as it is
+            word->len = 0;
+            return matches == -1 ? -1 : 0;
+        }
+    }
+    word->len = 0;
+    if (strvec_add(tokens, word->data) != 0) {
+        perror("strvec_add");
+        return -1;
+    }
+    return 0;
+}
+
+static int is_separator(char c) {
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+int subst_capture(strvec_t *tokens, char **out, size_t *len) {
+    capture_len = 0;
+    *out = capture;
+    *len = 0;
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return -1;
+    }
+    if (pipe_size > 0 && fcntl(pipe_fds[1], F_SETPIPE_SZ, pipe_size) == -1) {
+        perror("fcntl F_SETPIPE_SZ");
+    }
+    uint64_t trace_start = TRACE_CLOCK();
+    job_t job;
+    int ret = spawn_job(tokens, &job, pipe_fds[1], -1, 0);
+    close(pipe_fds[1]);  // the job holds the only write end, so EOF means it is done writing
+    if (ret == -1) {
+        close(pipe_fds[0]);
+        return -1;
+    }
+
+    while (1) {
+        if (capture_len == capture_cap) {
+            size_t new_cap = capture_cap == 0 ? CAPTURE_INITIAL_SIZE : capture_cap * 2;
+            char *new_capture = realloc(capture, new_cap);
+            if (new_capture == NULL) {
+                perror("realloc");
+                break;
+            }
+            capture = new_capture;
+            capture_cap = new_cap;
+        }
+        ssize_t n = read(pipe_fds[0], capture + capture_len, capture_cap - capture_len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1) {
+            perror("read");
+            break;
+        } else if (n == 0) {
+            break;
+        }
+        capture_len += n;
+    }
+    close(pipe_fds[0]);
+
+    int stopped = wait_job(&job);
+    if (stopped == 1) {  // e.g., it read from the terminal; it cannot be resumed later
+        fprintf(stderr, "swish: command substitution stopped, killing it\n");
+        for (unsigned i = 0; i < job.num_pids; i++) {
+            kill(job.pids[i], SIGKILL);
+        }
+        stopped = wait_job(&job);
+    }
+    free(job.pids);
+    TRACE_COMPLETE("subst", trace_start, 0, job.name);
+    *out = capture;
+    *len = capture_len;
+    return stopped == 0 ? job.exit_status : 1;
+}
+
+static void release_capture(void) {
+    free(capture);
+    capture = NULL;
+    capture_len = 0;
+    capture_cap = 0;
+}
+
+// Split substituted text into words: the first joins the word being built and
+// the last is left open for any text that follows
+static int add_words(const char *text, size_t len, word_t *word, strvec_t *tokens) {
+    int split = !in_assignment(word, tokens);
+    int ret = 0;
+    for (size_t i = 0; i < len && ret == 0; i++) {
+        if (split && is_separator(text[i])) {
+            ret = word_end(word, tokens);
+        } else {
+            ret = word_append(word, text[i]);
+        }
+    }
+    return ret;
+}
+
+// Run the command between "$(" and ')' and add its output to 'word' and 'tokens'
+static int substitute(char *command, word_t *word, strvec_t *tokens) {
+    strvec_t inner;
+    if (strvec_init_arena(&inner) != 0) {
+        perror("strvec_init_arena");
+        return -1;
+    }
+    int ret = subst_tokenize(command, &inner);
+    if (ret != 0 || inner.length == 0) {
+        strvec_free(&inner);
+        return ret;
+    }
+    char *out;
+    size_t len;
+    subst_capture(&inner, &out, &len);  // failures were reported, the output is empty
+    strvec_free(&inner);
+
+    while (len > 0 && out[len - 1] == '\n') {  // text after the substitution joins its last word
+        len--;
+    }
+    ret = add_words(out, len, word, tokens);
+    if (capture_cap > SUBST_KEEP_MAX) {
+        release_capture();
+    }
+    return ret;
+}
+
+int subst_tokenize(char *s, strvec_t *tokens) {
+    if (strpbrk(s, "$*?[") == NULL) {  // the common case: nothing to expand
+        return tokenize(s, tokens);
+    }
+
+    word_t word = {NULL, 0, 0};
+    int ret = 0;
+    char *c = s;
+    while (*c != '\0' && ret == 0) {
+        if (*c == ' ' || *c == '\t') {
+            ret = word_end(&word, tokens);
+            c++;
+        } else if (word.len == 0 && *c == '#') {  // a comment runs to the end of the line
+            break;
+        } else if (strncmp(c, SUBST_START, 2) == 0) {
+            // Find the matching ')', allowing for nested parentheses
+            char *end = c + 2;
+            for (int depth = 1; *end != '\0'; end++) {
+                depth += *end == '(' ? 1 : *end == ')' ? -1 : 0;
+                if (depth == 0) {
+                    break;
+                }
+            }
+            if (*end == '\0') {
+                fprintf(stderr, "swish: unterminated command substitution\n");
+                ret = 1;
+                break;
+            }
+            *end = '\0';
+            ret = substitute(c + 2, &word, tokens);
+            c = end + 1;
+        } else if (*c == '$' && (c[1] == '{' || vars_name_len(c + 1) > 0)) {  // $NAME or ${NAME}
+            int braced = c[1] == '{';
+            char *name = c + 1 + braced;
+            size_t len = vars_name_len(name);
+            if (braced && (len == 0 || name[len] != '}')) {
+                fprintf(stderr, "swish: bad substitution\n");
+                ret = 1;
+                break;
+            }
+            c = name + len + braced;
+            const char *value = vars_get_n(name, len);
+            if (value != NULL) {
+                ret = add_words(value, strlen(value), &word, tokens);
+            }
+        } else {
+            ret = word_append(&word, *c++);
+        }
+    }
+    if (ret == 0) {
+        ret = word_end(&word, tokens);
+    } else if (ret == 1) {  // syntax error: the line has no tokens
+        strvec_clear(tokens);
+    }
+    free(word.data);
+    return ret;
+}
+
+int subst_expand(char *const *words, unsigned n, int expand, strvec_t *tokens) {
+    if (!expand) {
+        for (unsigned i = 0; i < n; i++) {
+            if (strvec_add(tokens, words[i]) != 0) {
+                perror("strvec_add");
+                return -1;
+            }
+        }
+        return 0;
+    }
+    size_t len = 0;
+    for (unsigned i = 0; i < n; i++) {
+        len += strlen(words[i]) + 1;
+    }
+    if (len + 1 > line_cap) {
+        char *new_line = realloc(line, len + 1);
+        if (new_line == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        line = new_line;
+        line_cap = len + 1;
+    }
+    char *end = line;
+    for (unsigned i = 0; i < n; i++) {
+        size_t word_len = strlen(words[i]);
+        memcpy(end, words[i], word_len);
+        end += word_len;
+        *end++ = ' ';
+    }
+    *end = '\0';
+    return subst_tokenize(line, tokens);
+}
+
+void subst_free(void) {
+    free(line);
+    line = NULL;
+    line_cap = 0;
+    release_capture();
+}
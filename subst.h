@@ -0,0 +1,60 @@
+#ifndef SUBST_H
+#define SUBST_H
+#include <stddef.h>
+
+#include "string_vector.h"
+
+#define SUBST_START "$("
+
+// Capture buffers larger than this are freed after use instead of kept
+#define SUBST_KEEP_MAX (1 << 20)
+
+/*
+ * Split a command line into tokens like tokenize(), replacing each command
+ * substitution "$(command)" with the words of the command's output, and each
+ * "$NAME" or "${NAME}" with the words of the variable's value, and each word holding a pattern
+ * ('*', '?' or '[...]') with the pathnames it matches (see wildcard.h)
+ * The command may be a pipeline and may hold substitutions itself. Its output
+ * is split on spaces, tabs and newlines; text around the substitution joins
+ * the first and last words ("v$(echo 1 2)x" gives "v1" and "2x"). A
+ * substitution whose output is empty (or an unset variable) adds no token,
+ * and a pattern that matches nothing stays as it is. The value of a leading
+ * "NAME=value" assignment is neither split nor expanded as a pattern.
+ * s: String to tokenize (modified)
+ * tokens: Pointer to vector in which to store tokens
+ * Returns 0 on success, 1 on a syntax error such as a substitution that is not
+ * closed (the line then has no tokens), or -1 on error
+ */
+int subst_tokenize(char *s, strvec_t *tokens);
+
+/*
+ * Expand the words of a command parsed earlier (see parser.h) into tokens, as
+ * subst_tokenize() does for the words separated by spaces; the words
+ * themselves are left untouched, so they can be expanded again
+ * words, n: The words
+ * expand: Nonzero if a word may need expansion ('$', '*', '?' or '['), or 0
+ *         to add the words as they are
+ * tokens: Pointer to vector in which to store tokens
+ * Returns 0 on success, 1 on a syntax error or -1 on error, as subst_tokenize()
+ */
+int subst_expand(char *const *words, unsigned n, int expand, strvec_t *tokens);
+
+/*
+ * Run a command line as a job and capture what it writes to standard output
+ * The job runs through spawn_job() with its stdout connected to a pipe, which
+ * is read into a buffer that doubles in size as it fills, so capturing N bytes
+ * takes O(N) time.
+ * tokens: The command line to run (not a builtin)
+ * out: Set to the output, valid until the next call (not NUL-terminated)
+ * len: Set to the length of the output in bytes
+ * Returns the job's exit status, or -1 if it could not be started (the output
+ * is then empty)
+ */
+int subst_capture(strvec_t *tokens, char **out, size_t *len);
+
+/*
+ * Release the memory used for captured output
+ */
+void subst_free(void);
+
+#endif // SUBST_H
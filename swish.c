@@ -1,262 +1,528 @@
+#include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <fcntl.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "builtins.h"
+#include "capture.h"
+#include "complete.h"
+#include "deadline.h"
+#include "editor.h"
+#include "heredoc.h"
+#include "history.h"
 #include "job_list.h"
+#include "job_opts.h"
+#include "parser.h"
+#include "path_cache.h"
+#include "reaper.h"
+#include "reader.h"
+#include "spawn.h"
 #include "string_vector.h"
+#include "subst.h"
 #include "swish_funcs.h"
+#include "trace.h"
+#include "vars.h"
+#include "wildcard.h"
 
-#define CMD_LEN 512
 #define PROMPT "@> "
+#define PROMPT_MORE "> "
+#define USAGE "Usage: swish [-c command | script]\n"
 
-int main(int argc, char **argv) {
-    // Set up shell to ignore SIGTTIN, SIGTTOU when put in background
-    // Adapt this code for use in run_command().
-    struct sigaction sac;
-    sac.sa_handler = SIG_IGN;
-    if (sigfillset(&sac.sa_mask) == -1) {
-        perror("sigfillset");
-        return 1;
+// Run a command line that is not a builtin as a job: in the background if it
+// ends with "&", otherwise in the foreground until it exits or stops
+// timed: Nonzero to report the resource usage of a foreground job once it exits
+// deadline: Time limit for the job (see deadline.h), or NULL for none
+// Returns the exit status of the command line
+static int run_job_line(strvec_t *tokens, job_list_t *jobs, reader_t *input, int interactive, int timed,
+                        const deadline_t *deadline) {
+    // If the last token input by the user is "&", start the current
+    // command in the background.
+    // 1. Determine if the last token is "&". If present, use strvec_take() to remove
+    //    the "&" from the token list.
+    // 2. Modify the code for the parent (shell) process: Don't use tcsetpgrp() or
+    //    use waitpid() to interact with the newly spawned child process.
+    // 3. Add a new entry to the jobs list with the child's pid, program name,
+    //    and status JOB_BACKGROUND.
+    const char *last_token = strvec_get(tokens, tokens->length - 1);
+    int is_background = 0;
+    if (last_token != NULL && strcmp(last_token, "&") == 0) {  // last token of command input is "&"
+        strvec_take(tokens, tokens->length - 1); // remove "&" from tokens
+        is_background = 1;
     }
-    sac.sa_flags = 0;
-    if (sigaction(SIGTTIN, &sac, NULL) == -1 || sigaction(SIGTTOU, &sac, NULL) == -1) {
-        perror("sigaction");
+    // Children may share the shell's input (e.g., "swish < script"), so
+    // give back anything read past the current line first
+    if (!interactive) {
+        reader_sync(input);
+    }
+    // If the user input does not match any built-in shell command,
+    // treat the input as a program name and command-line arguments
+    // (or a pipeline of several programs separated by "|")
+    // spawn_job() launches every process in one new process group, either
+    // through fork() + run_command(), posix_spawn() or the fork server (see spawn.h)
+    job_opts_prepare(is_background);
+    // With SWISH_CAPTURE set, a background job's stdout and stderr go to a
+    // pipe the shell drains into a ring buffer (see capture.h)
+    size_t capture = is_background ? capture_size() : 0;
+    int capture_fds[2] = {-1, -1};
+    if (capture > 0 && capture_pipe(capture, capture_fds) != 0) {
         return 1;
     }
+    job_t job;
+    int spawned = spawn_job(tokens, &job, capture_fds[1], capture_fds[1], !is_background);
+    if (capture_fds[1] != -1) {
+        close(capture_fds[1]);  // the job's processes hold the only write ends
+    }
+    if (spawned == -1) {  // no process created, error already reported
+        if (capture_fds[0] != -1) {
+            close(capture_fds[0]);
+        }
+        return 127;
+    }
+    if (is_background) {  // don't wait for or hand the terminal to a background job
+        job.status = JOB_BACKGROUND;
+        int id = job_list_add_job(jobs, &job);
+        if (id == -1) {
+            perror("job_list_add");
+            free(job.pids);
+            if (capture_fds[0] != -1) {
+                close(capture_fds[0]);
+            }
+        } else {
+            if (capture_fds[0] != -1) {
+                capture_add(id, job.name, capture_fds[0], capture);
+            }
+            if (deadline != NULL) {
+                deadline_add(job.pid, id, deadline);
+            }
+        }
+        return 0;
+    }
 
-    strvec_t tokens;
-    strvec_init(&tokens);
-    job_list_t jobs;
-    job_list_init(&jobs);
-    char cmd[CMD_LEN];
-
-    printf("%s", PROMPT);
-    while (fgets(cmd, CMD_LEN, stdin) != NULL) {
-        // Need to remove trailing '\n' from cmd. There are fancier ways.
-        int i = 0;
-        while (cmd[i] != '\n') {
-            i++;
+    // Set the job's process group as the target of signals sent to the terminal
+    // via the keyboard.
+    // To do this, call 'tcsetpgrp(STDIN_FILENO, <pgid>)', where pgid is the
+    // process group set up by spawn_job(). Do this in the parent process.
+    uint64_t trace_start = TRACE_CLOCK();
+    if (job_control && tcsetpgrp(STDIN_FILENO, job.pid) != 0) {  // move child process to foreground, check for errors
+        perror("tcsetpgrp");
+    }
+    if (job_control) {
+        TRACE_COMPLETE("tcsetpgrp", trace_start, 0, job.name);
+    }
+    if (deadline != NULL) {
+        deadline_add(job.pid, DEADLINE_FOREGROUND, deadline);
+    }
+    // Handle the issue of foreground/background terminal process groups.
+    // Do this by taking the following steps in the shell (parent) process:
+    // 1. Wait for the job's processes with WUNTRACED to detect if it has
+    //    stopped from a signal (wait_job() does this for the whole process group)
+    // 2. After it has returned, call tcsetpgrp(STDIN_FILENO, <pid>) where pid is
+    //    the process ID of the shell process (use getpid() to obtain it)
+    // 3. If the job was stopped by a signal, add it to 'jobs', the
+    //    the terminal's jobs list.
+    int stopped = wait_job(&job);
+    int status;
+    if (stopped == 1) {  // if job stopped, add it to job list, check for errors
+        job.status = JOB_STOPPED;
+        int id = job_list_add_job(jobs, &job);
+        if (id == -1) {
+            perror("job_list_add");
+            free(job.pids);
+            deadline_cancel(job.pid);
+        } else {
+            deadline_move(job.pid, id);  // the deadline keeps running while the job is stopped
         }
-        cmd[i] = '\0';
+        status = 128 + SIGTSTP;
+    } else {
+        deadline_cancel(job.pid);
+        status = stopped == 0 ? job.exit_status : 1;
+        if (timed && stopped == 0) {
+            report_usage(&job);
+        }
+        free(job.pids);
+    }
+    trace_start = TRACE_CLOCK();
+    if (job_control && tcsetpgrp(STDIN_FILENO, getpid()) != 0) {  // move terminal to foreground once child process terminates, check for errors
+        perror("tcsetpgrp");
+    }
+    if (job_control) {
+        TRACE_COMPLETE("tcsetpgrp", trace_start, 0, "swish");
+    }
+    return status;
+}
 
-        if (tokenize(cmd, &tokens) != 0) {
-            printf("Failed to parse command\n");
-            strvec_clear(&tokens);
-            job_list_free(&jobs);
+// Run the tokens of a simple command: variable assignments, then a builtin
+// or a job
+// builtin: The builtin named by the first token, if 'resolved'
+// Returns the command's exit status
+static int run_tokens(strvec_t *tokens, const builtin_t *builtin, int resolved, shell_t *sh) {
+    // Here-documents take the lines that follow from the same input
+    if (heredoc_collect(tokens, sh->input, sh->interactive) != 0) {
+        return 1;
+    }
+    // Leading "NAME=value" words set shell variables when nothing follows
+    // them, or else only the environment of the command that follows
+    unsigned assignments = 0;
+    while (assignments < tokens->length && vars_is_assignment(strvec_get(tokens, assignments))) {
+        assignments++;
+    }
+    if (assignments == tokens->length) {
+        int status = 0;
+        for (unsigned i = 0; i < assignments; i++) {
+            if (vars_assign(strvec_get(tokens, i), 0) != 0) {
+                status = 1;
+            }
+        }
+        return status;
+    } else if (assignments > 0) {
+        if (vars_push_overrides(tokens, assignments) != 0) {
             return 1;
         }
-        if (tokens.length == 0) {
-            printf("%s", PROMPT);
-            continue;
+        strvec_drop(tokens, assignments);
+        resolved = 0;
+    }
+    const char *first_token = strvec_get(tokens, 0);
+    // "time cmd" runs cmd as a job (never as a builtin) and then reports
+    // the job's wall-clock time and resource usage
+    int timed = 0;
+    if (strcmp(first_token, "time") == 0) {
+        strvec_drop(tokens, 1);
+        if (tokens->length == 0) {
+            return 0;
         }
-        const char *first_token = strvec_get(&tokens, 0);
+        timed = 1;
+    }
+    // "timeout [-k GRACE] DURATION cmd" runs cmd as a job that is sent
+    // SIGTERM, then SIGKILL, if it runs past the deadline
+    deadline_t deadline;
+    int limited = 0;
+    if (strcmp(strvec_get(tokens, 0), "timeout") == 0) {
+        int next = deadline_parse(tokens, &deadline);
+        if (next == -1) {
+            return 125;  // as timeout(1)
+        }
+        strvec_drop(tokens, next);
+        limited = 1;
+    }
+    // "job-opts OPTIONS -- cmd" also runs cmd as a job, with the options on
+    // top of the defaults set by job-opts without a command
+    int as_job = 0;
+    int dashes = strvec_find(tokens, "--");
+    if (strcmp(strvec_get(tokens, 0), "job-opts") == 0 && dashes > 0 && dashes + 1 < tokens->length) {
+        job_opts_t opts;
+        int next = job_opts_parse(tokens, 1, &opts);
+        if (next != dashes + 1) {
+            if (next != -1) {
+                fprintf(stderr, "job-opts: %s: unknown option\n", strvec_get(tokens, next));
+            }
+            return 2;
+        }
+        job_opts_push_overrides(&opts);
+        strvec_drop(tokens, dashes + 1);
+        as_job = 1;
+    }
+
+    if (timed || limited || as_job) {
+        return run_job_line(tokens, sh->jobs, sh->input, sh->interactive, timed, limited ? &deadline : NULL);
+    }
+    // Builtins, including in-process versions of cheap programs like
+    // echo and test, run without a fork() (see builtins.h)
+    if (!resolved) {
+        builtin = builtin_find(strvec_get(tokens, 0));
+    }
+    int status = builtin_run(builtin, tokens, sh);
+    if (status == BUILTIN_EXTERNAL) {
+        status = run_job_line(tokens, sh->jobs, sh->input, sh->interactive, 0, NULL);
+    }
+    return status;
+}
 
-        if (strcmp(first_token, "pwd") == 0) {
-            // Print the shell's current working directory
-            // Use the getcwd() system call
-            char buf[CMD_LEN];
-            if (getcwd(buf, CMD_LEN) == NULL) {
-                perror("getcwd");
-                strvec_clear(&tokens);
-                job_list_free(&jobs);
-                printf("%s", PROMPT);
-                continue;
+// Expand the words of a simple command and run it
+// Returns the command's exit status
+static int run_simple(const node_t *node, strvec_t *tokens, shell_t *sh) {
+    // Command substitutions run children that may share the shell's input
+    if (node->expand && !sh->interactive) {
+        for (unsigned i = 0; i < node->num_words; i++) {
+            if (strstr(node->words[i], SUBST_START) != NULL) {
+                reader_sync(sh->input);
+                break;
             }
-            printf("%s\n", buf);
         }
+    }
+    strvec_clear(tokens);
+    uint64_t trace_start = TRACE_CLOCK();
+    int parsed = subst_expand(node->words, node->num_words, node->expand, tokens);
+    if (parsed == -1) {
+        printf("Failed to parse command\n");
+        sh->exiting = 1;
+        return 1;
+    } else if (parsed == 1) {  // syntax error, already reported
+        return 2;
+    }
+    if (node->expand) {
+        TRACE_COMPLETE("expand", trace_start, 0, strvec_get(tokens, 0));
+    }
+    if (tokens->length == 0) {
+        return sh->last_status;
+    }
+    int status = run_tokens(tokens, node->builtin, node->resolved, sh);
+    heredoc_close();
+    vars_pop_overrides();
+    job_opts_pop_overrides();
+    return status;
+}
+
+static int run_list(const node_t *list, strvec_t *tokens, shell_t *sh);
+
+// Nonzero if a list must stop after a command that exited with 'status':
+// the shell is exiting, or the user interrupted or stopped a job at the terminal
+static int list_stops(int status, shell_t *sh) {
+    return sh->exiting || (sh->interactive && (status == 128 + SIGINT || status == 128 + SIGTSTP));
+}
 
-        else if (strcmp(first_token, "cd") == 0) {
-            // Change the shell's current working directory
-            // Use the chdir() system call
-            // If the user supplied an argument (token at index 1), change to that directory
-            // Otherwise, change to the home directory by default
-            // This is available in the HOME environment variable (use getenv())
-            const char *second_token = strvec_get(&tokens, 1);
-            if (second_token == NULL) {  // if there is no second command line argument
-                // get home dir
-                char *temp;
-                if ((temp = getenv("HOME")) == NULL) {  // get HOME directory, check for error
-                    perror("getenv");
-                    strvec_clear(&tokens);
-                    job_list_free(&jobs);
-                    // reprompt user
-                    printf("%s", PROMPT);
-                    continue;
+// Run one node of a tree (a simple command, "&&", "||" or a loop)
+// Returns its exit status
+static int run_node(const node_t *node, strvec_t *tokens, shell_t *sh) {
+    int status = 0;
+    switch (node->type) {
+        case NODE_COMMAND:
+            status = run_simple(node, tokens, sh);
+            break;
+        case NODE_AND:
+        case NODE_OR:
+            status = run_node(node->left, tokens, sh);
+            sh->last_status = status;
+            if ((status == 0) == (node->type == NODE_AND) && !list_stops(status, sh)) {
+                status = run_node(node->right, tokens, sh);
+            }
+            break;
+        case NODE_WHILE:
+        case NODE_UNTIL:
+            while (1) {
+                int cond = run_list(node->cond, tokens, sh);
+                if ((cond == 0) != (node->type == NODE_WHILE) || list_stops(cond, sh)) {
+                    break;
                 }
-                if (chdir(temp) != 0) {  // change directory to HOME, check for error
-                    perror("chdir");
-                    strvec_clear(&tokens);
-                    job_list_free(&jobs);
-                    // reprompt user
-                    printf("%s", PROMPT);
-                    continue;
+                status = run_list(node->body, tokens, sh);
+                if (list_stops(status, sh)) {
+                    break;
                 }
             }
-            else if (chdir(second_token) != 0) {  // change directory to second argument, check for error
-                perror("chdir");
-                strvec_clear(&tokens);
-                job_list_free(&jobs);
-                printf("%s", PROMPT);
-                continue;
-            }
-        }
-
-        else if (strcmp(first_token, "exit") == 0) {
-            strvec_clear(&tokens);
             break;
-        }
-
-        // Print out current list of pending jobs
-        else if (strcmp(first_token, "jobs") == 0) {
-            int i = 0;
-            job_t *current = jobs.head;
-            while (current != NULL) {
-                char *status_desc;
-                if (current->status == JOB_BACKGROUND) {
-                    status_desc = "background";
-                } else {
-                    status_desc = "stopped";
+        case NODE_FOR: {
+            // The words are expanded once, when the loop starts
+            char *const *items = node->words;
+            unsigned num_items = node->num_words;
+            strvec_t expanded;
+            if (node->expand) {
+                if (strvec_init(&expanded) != 0) {
+                    perror("strvec_init");
+                    return 1;
+                }
+                int parsed = subst_expand(node->words, node->num_words, 1, &expanded);
+                if (parsed != 0) {
+                    strvec_free(&expanded);
+                    return parsed == 1 ? 2 : 1;
                 }
-                printf("%d: %s (%s)\n", i, current->name, status_desc);
-                i++;
-                current = current->next;
+                items = strvec_argv(&expanded);
+                num_items = expanded.length;
             }
-        }
-
-        // Move stopped job into foreground
-        else if (strcmp(first_token, "fg") == 0) {
-            if (resume_job(&tokens, &jobs, 1) == -1) {
-                printf("Failed to resume job in foreground\n");
+            for (unsigned i = 0; i < num_items; i++) {
+                if (vars_set(node->name, items[i]) != 0) {
+                    status = 1;
+                    break;
+                }
+                status = run_list(node->body, tokens, sh);
+                if (list_stops(status, sh)) {
+                    break;
+                }
             }
-        }
-
-        // Move stopped job into background
-        else if (strcmp(first_token, "bg") == 0) {
-            if (resume_job(&tokens, &jobs, 0) == -1) {
-                printf("Failed to resume job in background\n");
+            if (node->expand) {
+                strvec_free(&expanded);
             }
+            break;
         }
+    }
+    sh->last_status = status;
+    return status;
+}
 
-        // Wait for a specific job identified by its index in job list
-        else if (strcmp(first_token, "wait-for") == 0) {
-            if (await_background_job(&tokens, &jobs) == -1) {
-                printf("Failed to wait for background job\n");
-            }
+// Run the commands of a list in order
+// Returns the exit status of the last command run
+static int run_list(const node_t *list, strvec_t *tokens, shell_t *sh) {
+    int status = 0;
+    for (const node_t *node = list; node != NULL; node = node->next) {
+        status = run_node(node, tokens, sh);
+        if (list_stops(status, sh)) {
+            break;
         }
+    }
+    return status;
+}
 
-        // Wait for all background jobs
-        else if (strcmp(first_token, "wait-all") == 0) {
-            if (await_all_background_jobs(&jobs) == -1) {
-                printf("Failed to wait for all background jobs\n");
-            }
+int main(int argc, char **argv) {
+    // Input comes from the string after -c, a script file, or standard input.
+    // Only standard input attached to a terminal makes the shell interactive:
+    // then it prints prompts and hands the terminal to foreground jobs.
+    reader_t input;
+    int script_fd = -1;
+    if (argc >= 3 && strcmp(argv[1], "-c") == 0) {
+        if (reader_init_string(&input, argv[2]) != 0) {
+            perror("reader_init_string");
+            return 1;
+        }
+    } else if (argc >= 2 && argv[1][0] != '-') {
+        if ((script_fd = open(argv[1], O_RDONLY | O_CLOEXEC)) == -1) {
+            perror(argv[1]);
+            return 127;
+        }
+        if (reader_init_fd(&input, script_fd) != 0) {
+            perror("reader_init_fd");
+            close(script_fd);
+            return 1;
+        }
+    } else if (argc == 1) {
+        if (reader_init_fd(&input, STDIN_FILENO) != 0) {
+            perror("reader_init_fd");
+            return 1;
         }
+        job_control = isatty(STDIN_FILENO);
+    } else {
+        fprintf(stderr, USAGE);
+        return 2;
+    }
+    int interactive = job_control;
+    // Keep builtin output in order with children's output and error messages
+    // even when stdout is a pipe or file
+    setvbuf(stdout, NULL, _IOLBF, 0);
 
-        else {
-            // If the last token input by the user is "&", start the current
-            // command in the background.
-            // 1. Determine if the last token is "&". If present, use strvec_take() to remove
-            //    the "&" from the token list.
-            // 2. Modify the code for the parent (shell) process: Don't use tcsetpgrp() or
-            //    use waitpid() to interact with the newly spawned child process.
-            // 3. Add a new entry to the jobs list with the child's pid, program name,
-            //    and status JOB_BACKGROUND.
-            const char *last_token = strvec_get(&tokens, tokens.length - 1);
-            if (strcmp(last_token, "&") == 0) {  // last token of command input is "&"
-                strvec_take(&tokens, tokens.length - 1); // remove "&" from tokens
-                pid_t child_pid = fork();
-                if (child_pid == -1) {  // error - child process not created
-                    perror("fork");
-                    strvec_clear(&tokens);
-                    job_list_free(&jobs);
-                    // reprompt user
-                    printf("%s", PROMPT);
-                    continue;
-                } else if (child_pid == 0) {  // child process
-                    if (run_command(&tokens) != 0) {  // run command, check for error
-                        return 1;  // if error, return from child process
-                    }
-                }  // else - parent
-                if (job_list_add(&jobs, child_pid, first_token, JOB_BACKGROUND) != 0) {
-                    perror("job_list_add");
-                    // reprompt user
-                    printf("%s", PROMPT);
-                    continue;
-                }
-            }
-            // If the user input does not match any built-in shell command,
-            // treat the input as a program name and command-line arguments
-            // Take the following steps:
-            //   1. Use fork() to spawn a child process
-            //   2. Call run_command() in the child process
-            //   2. In the parent, use waitpid() to wait for the program to exit
-            pid_t child_pid = fork();
-            if (child_pid == -1) {  // child process not created
-                perror("fork");
-                strvec_clear(&tokens);
-                job_list_free(&jobs);
-                // reprompt user
-                printf("%s", PROMPT);
-                continue;
-            } else if (child_pid == 0) {  // child process
-                if (run_command(&tokens) != 0) {  // run command, check for error
-                    return 1;  // if error, return from child process
-                }
-            }  // else - parent process
-            int wstatus;
-            // pid_t terminated_pid = waitpid(child_pid, &wstatus, 0);
+    // Set up shell to ignore SIGTTIN, SIGTTOU when put in background
+    // Adapt this code for use in run_command().
+    struct sigaction sac;
+    sac.sa_handler = SIG_IGN;
+    if (sigfillset(&sac.sa_mask) == -1) {
+        perror("sigfillset");
+        return 1;
+    }
+    sac.sa_flags = 0;
+    if (sigaction(SIGTTIN, &sac, NULL) == -1 || sigaction(SIGTTOU, &sac, NULL) == -1) {
+        perror("sigaction");
+        return 1;
+    }
+    if (vars_init() != 0 || spawn_init() != 0 || reaper_init() != 0 || trace_init() != 0) {
+        return 1;
+    }
+    spawn_start();
+    path_cache_init();  // on failure commands are still found, just not cached
+    history_init(interactive);  // on failure the shell runs without history
 
+    // Tokens live in one arena reused for every command, so the loop below does
+    // not allocate once the arena has grown to fit the longest command
+    strvec_t tokens;
+    if (strvec_init_arena(&tokens) != 0) {
+        perror("strvec_init_arena");
+        return 1;
+    }
+    // Each command is parsed into a tree once, however often its parts run
+    parser_t parser;
+    parser_init(&parser);
+    job_list_t jobs;
+    job_list_init(&jobs);
+    deadline_init(&jobs);
+    // Background jobs are reaped while the shell waits for input
+    reader_set_wait(&input, reaper_wait_input, &jobs);
+    char *cmd;
+    int last_status = 0;  // exit status of the last command, returned by the shell
+    shell_t shell = {&jobs, &input, interactive, 0, 0};
+    // Interactive shells edit lines on the terminal themselves, unless it cannot handle it
+    editor_t editor;
+    int editing = interactive && editor_init(&editor, STDIN_FILENO) == 0;
+    if (editing) {
+        editor_set_wait(&editor, reaper_wait_input, &jobs);
+    }
 
-            // Set the child process as the target of signals sent to the terminal
-            // via the keyboard.
-            // To do this, call 'tcsetpgrp(STDIN_FILENO, <child_pid>)', where child_pid is the
-            // child's process ID just returned by fork(). Do this in the parent process.
-            if (tcsetpgrp(STDIN_FILENO, child_pid) != 0) {  // move child process to foreground, check for errors
-                perror("tcsetpgrp");
-                // reprompt user
-                printf("%s", PROMPT);
-                continue;
-            }
-            // Handle the issue of foreground/background terminal process groups.
-            // Do this by taking the following steps in the shell (parent) process:
-            // 1. Modify the call to waitpid(): Wait specifically for the child just forked, and
-            //    use WUNTRACED as the third argument to detect if it has stopped from a signal
-            // 2. After waitpid() has returned, call tcsetpgrp(STDIN_FILENO, <pid>) where pid is
-            //    the process ID of the shell process (use getpid() to obtain it)
-            // 3. If the child status was stopped by a signal, add it to 'jobs', the
-            //    the terminal's jobs list.
-            // Can detect if this has occurred using WIFSTOPPED on the status
-            // variable set by waitpid()
-            if (waitpid(child_pid, &wstatus, WUNTRACED) == -1) {  // wait for child process to terminate or stop, check for errors
-                perror("waitpid");
-                // reprompt user
-                printf("%s", PROMPT);
-                continue;
+    while (1) {
+        // Lines that continue a command (e.g., the body of a loop) get their own prompt
+        const char *prompt = PROMPT_MORE;
+        if (!parser_pending(&parser)) {
+            history_finish(last_status);
+            reap_children(&jobs);
+            report_jobs(&jobs);
+            prompt = PROMPT;
+        }
+        uint64_t trace_start;
+        if (editing && input.start == input.end) {  // no typed-ahead lines left in the reader
+            trace_start = TRACE_CLOCK();
+            if (editor_read(&editor, prompt, &cmd) == -1) {  // end of input
+                break;
             }
-            if (WIFSTOPPED(wstatus)) {  // if child process stopped, add it to job list, check for errors
-                if (job_list_add(&jobs, child_pid, first_token, JOB_STOPPED) != 0) {
-                    perror("job_list_add");
-                    // reprompt user
-                    printf("%s", PROMPT);
-                    continue;
-                }
+        } else {
+            if (interactive) {
+                printf("%s", prompt);
+                fflush(stdout);
             }
-            if (tcsetpgrp(STDIN_FILENO, getpid()) != 0) {  // move terminal to foreground once child process terminates, check for errors
-                perror("tcsetpgrp");
-                // reprompt user
-                printf("%s", PROMPT);
-                continue;
+            trace_start = TRACE_CLOCK();
+            if (reader_next(&input, &cmd) == -1) {  // end of input
+                break;
             }
         }
+        TRACE_COMPLETE("read", trace_start, 0, NULL);
+        if (!parser_pending(&parser)) {
+            history_start(cmd);  // a command spanning lines is recorded by its first line
+        }
 
-        strvec_clear(&tokens);
-        printf("%s", PROMPT);
+        trace_start = TRACE_CLOCK();
+        node_t *tree;
+        int parsed = parser_add_line(&parser, cmd, &tree);
+        if (parsed == PARSE_MORE) {
+            continue;
+        } else if (parsed == PARSE_ERROR) {  // already reported
+            last_status = 2;
+            continue;
+        }
+        TRACE_COMPLETE("parse", trace_start, 0, NULL);
+        if (tree == NULL) {
+            continue;
+        }
+        shell.last_status = last_status;
+        last_status = run_list(tree, &tokens, &shell);
+        if (shell.exiting) {
+            break;
+        }
     }
 
+    if (parser_pending(&parser)) {
+        fprintf(stderr, "swish: syntax error: unexpected end of input\n");
+        parser_reset(&parser);
+        last_status = 2;
+    }
+    history_finish(last_status);
+    strvec_free(&tokens);
+    parser_free(&parser);
+    if (editing) {
+        editor_free(&editor);
+    }
+    complete_free();
+    capture_free();
+    deadline_free();
+    history_free();
+    heredoc_free();
+    subst_free();
+    wildcard_free();
+    vars_free();
     job_list_free(&jobs);
-    return 0;
+    path_cache_free();
+    spawn_free();
+    reaper_free();
+    trace_free();
+    reader_free(&input);
+    if (script_fd != -1) {
+        close(script_fd);
+    }
+    return last_status;
 }
@@ -1,49 +1,146 @@
+#define _GNU_SOURCE  // execvpe()
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "capture.h"
+#include "deadline.h"
 #include "job_list.h"
+#include "path_cache.h"
+#include "reaper.h"
 #include "string_vector.h"
 #include "swish_funcs.h"
+#include "trace.h"
+#include "vars.h"
 
-#define MAX_ARGS 10
+int job_control = 0;
 
 int tokenize(char *s, strvec_t *tokens) {
     // Tokenize string s
-    // Assume each token is separated by a single space (" ")
+    // Assume each token is separated by spaces or tabs
     // Use the strtok() function to accomplish this
     // Add each token to the 'tokens' parameter (a string vector)
     // Return 0 on success, -1 on error
-    char *delimeter = " ";
-    char *token;
-    if ((token = strtok(s, delimeter)) == NULL) {  // if s is empty or only contains delimiters, return error
-        perror("Invalid argument");
-        return -1;
-    }
+    char *delimeter = " \t";
+    char *token = strtok(s, delimeter);
 
-    while (token != NULL) {  // add the rest of the arguments in
-        strvec_add(tokens, token);
+    while (token != NULL && token[0] != '#') {  // add the arguments in, up to a comment
+        if (strvec_add(tokens, token) != 0) {
+            perror("strvec_add");
+            return -1;
+        }
         token = strtok(NULL, delimeter);
     }
 
     return 0;
 }
 
-int run_command(strvec_t *tokens) {
+int open_redirects(strvec_t *tokens, int *in_fd, int *out_fd, int flags) {
+    *in_fd = -1;
+    *out_fd = -1;
+
+    // Redirections are applied left to right, as in sh: every file is opened,
+    // and the last input and the last output redirection win (e.g., for
+    // "cat <<A <<<hi", which here-documents turn into two "<&" redirections)
+    int first = -1;  // index of the first operator: the program's arguments end there
+    for (unsigned i = 0; i < tokens->length; i++) {
+        const char *op = strvec_get(tokens, i);
+        int fd;
+        int is_input = 1;
+        if (strcmp(op, "<") == 0) {  // "<": input from the file named after "<", opened read only
+            const char *read_file;
+            if ((read_file = strvec_get(tokens, i + 1)) == NULL) {
+                perror("No file specified after \"<\"");
+                close_redirects(*in_fd, *out_fd);
+                return -1;
+            }
+            if ((fd = open(read_file, O_RDONLY | flags, S_IRUSR|S_IWUSR)) == -1) {
+                perror("Failed to open input file");
+                close_redirects(*in_fd, *out_fd);
+                return -1;
+            }
+        } else if (strcmp(op, "<&") == 0) {  // "<&": input from a copy of the descriptor named after "<&"
+                                             // (here-documents are rewritten to this form)
+            const char *fd_arg = strvec_get(tokens, i + 1);
+            char *end;
+            long dup_fd = fd_arg == NULL ? -1 : strtol(fd_arg, &end, 10);
+            if (fd_arg == NULL || *fd_arg == '\0' || *end != '\0' || dup_fd < 0 || dup_fd > INT_MAX) {
+                fprintf(stderr, "No descriptor specified after \"<&\"\n");
+                close_redirects(*in_fd, *out_fd);
+                return -1;
+            }
+            if ((fd = fcntl(dup_fd, (flags & O_CLOEXEC) ? F_DUPFD_CLOEXEC : F_DUPFD, 0)) == -1) {
+                perror("Failed to duplicate input descriptor");
+                close_redirects(*in_fd, *out_fd);
+                return -1;
+            }
+        } else if (strcmp(op, ">") == 0 || strcmp(op, ">>") == 0) {  // ">": output to the file named after ">",
+                                                                      // created or truncated; ">>" appends to it
+            const char *write_file;
+            if ((write_file = strvec_get(tokens, i + 1)) == NULL) {
+                if (op[1] == '>') {
+                    perror("No file specified after \">>\"");
+                } else {
+                    perror("No file specified after \">\"");
+                }
+                close_redirects(*in_fd, *out_fd);
+                return -1;
+            }
+            int mode = op[1] == '>' ? O_APPEND : O_TRUNC;
+            if ((fd = open(write_file, O_CREAT|O_WRONLY|mode | flags, S_IRUSR|S_IWUSR)) == -1) {
+                perror("Failed to open output file");
+                close_redirects(*in_fd, *out_fd);
+                return -1;
+            }
+            is_input = 0;
+        } else {
+            continue;
+        }
+        if (first == -1) {
+            first = i;
+        }
+        int *target = is_input ? in_fd : out_fd;
+        if (*target != -1) {  // replaced by a later redirection
+            close(*target);
+        }
+        *target = fd;
+        i++;  // skip the file name or descriptor
+    }
+    if (first > 0) {
+        strvec_take(tokens, first);
+    }
+    return 0;
+}
+
+void close_redirects(int in_fd, int out_fd) {
+    if (in_fd != -1 && close(in_fd) != 0) {
+        perror("Failed to close file");
+    }
+    if (out_fd != -1 && close(out_fd) != 0) {
+        perror("Failed to close file");
+    }
+}
+
+int run_command(strvec_t *tokens, pid_t pgid, const char *path) {
     // Need to do two items of setup before exec()'ing
     // 1. Restore the signal handlers for SIGTTOU and SIGTTIN to their defaults.
     // The code in main() within swish.c sets these handlers to the SIG_IGN value.
     // Adapt this code to use sigaction() to set the handlers to the SIG_DFL value.
     // 2. Change the process group of this process (a child of the main shell).
     // Call getpid() to get its process ID then call setpgid() and use this process
-    // ID as the value for the new process group ID
+    // ID as the value for the new process group ID (or join 'pgid' for later
+    // stages of a pipeline)
     struct sigaction sac;
     sac.sa_handler = SIG_DFL;
     if (sigfillset(&sac.sa_mask) == -1) {
@@ -55,10 +152,14 @@ int run_command(strvec_t *tokens) {
         perror("sigaction");
         return 1;
     }
-    if (setpgid(getpid(), 0) != 0) {
+    uint64_t trace_start = TRACE_CLOCK();
+    if (pgid != -1 && setpgid(getpid(), pgid) != 0) {
         perror("setpgid");
         return 1;
     }
+    if (pgid != -1) {
+        TRACE_COMPLETE("setpgid", trace_start, 0, NULL);
+    }
     // Extend this function to perform output redirection before exec()'ing
     // Check for '<' (redirect input), '>' (redirect output), '>>' (redirect and append output)
     // entries inside of 'tokens' (the strvec_find() function will do this for you)
@@ -66,137 +167,149 @@ int run_command(strvec_t *tokens) {
     // Use dup2() to redirect stdin (<), stdout (> or >>)
     // DO NOT pass redirection operators and file names to exec()'d program
     // E.g., "ls -l > out.txt" should be exec()'d with strings "ls", "-l", NULL
+    int fdr, fdw;
+    trace_start = TRACE_CLOCK();
+    if (open_redirects(tokens, &fdr, &fdw, 0) != 0) {
+        return -1;
+    }
+    if (fdr != -1 || fdw != -1) {
+        TRACE_COMPLETE("redirects", trace_start, 0, NULL);
+    }
+    if (fdr != -1 && dup2(fdr, STDIN_FILENO) == -1) {  // use dup2 to redirect input
+        perror("dup2");
+        return -1;
+    }
+    if (fdw != -1 && dup2(fdw, STDOUT_FILENO) == -1) {  // use dup2 to redirect output
+        perror("dup2");
+        return -1;
+    }
+    // Execute the specified program (token 0) with the
+    // specified command-line arguments
+    // THIS FUNCTION SHOULD BE CALLED FROM A CHILD OF THE MAIN SHELL PROCESS
+    // The 'tokens' vector already keeps a NULL-terminated array of its elements
+    // for exec(), so arguments of any number are passed without copying
+    char **strarr = strvec_argv(tokens);
+    TRACE_INSTANT("exec", 0, path != NULL ? path : strarr[0], 0);
+    // With a path already resolved by the PATH cache, go straight to execve()
+    if (path != NULL) {
+        execve(path, strarr, vars_envp());
+    } else {
+        environ = vars_envp();  // execvpe() searches the PATH of 'environ'
+        execvpe(strarr[0], strarr, vars_envp());
+    }
+    perror("exec");
+    return -1;
+}
 
-    int index;
-    int endProgram = 0;
-
-    if ((index = strvec_find(tokens, "<")) != -1) {  // "<" present: redirects input to tokens[0] program from standard input to the file specified after "<"
-                                                        // opens for read only
-        endProgram = index;
-        const char *read_file;
-        if ((read_file = strvec_get(tokens, index + 1)) == NULL) {  // gets next token which should be file name, checks for error
-            perror("No file specified after \"<\"");
-            return -1;
-        }
-        int fdr;
-        if ((fdr = open(read_file, O_RDONLY, S_IRUSR|S_IWUSR)) == -1) {  // open read_file - open for reading, checks for error
-            perror("Failed to open input file");
-            close(fdr);
-            return -1;
-        }
-        // No errors, use dup2 to redirect input
-        if (dup2(fdr, STDIN_FILENO) == -1) {
-            perror("dup2");
-            if (close(fdr) != 0) {
-                perror("Failed to close file");
+int wait_job(job_t *job) {
+    int wstatus;
+    struct rusage usage;
+    uint64_t trace_start = TRACE_CLOCK();
+    while (job->num_pids > 0) {
+        // With job control all processes of the job share its process group;
+        // without it they share the shell's, so wait for them one at a time.
+        // wait4() is waitpid() that also returns the process's resource usage.
+        // While deadlines are set, it must not block so they can fire.
+        int options = deadline_fd() != -1 ? WUNTRACED | WNOHANG : WUNTRACED;
+        pid_t pid = wait4(job_control ? -job->pid : job->pids[0], &wstatus, options, &usage);
+        if (pid == 0) {
+            if (reaper_block(job) == -1) {
+                return -1;
             }
-            return -1;
-        }
-    }
-    if ((index = strvec_find(tokens, ">")) != -1) {  // ">" present: redirects the output of tokens[0] from standard output
-                                                        // to the file listed after ">" - create or trunc the output file
-        if (endProgram == 0) {
-            endProgram = index;
-        }
-        const char *write_file;
-        if ((write_file = strvec_get(tokens, index + 1)) == NULL) {  // gets next token which should be file name, checks for error
-            perror("No file specified after \">\"");
-            return -1;
-        }
-        int fdw;
-        if ((fdw = open(write_file, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR|S_IWUSR)) == -1) {  // open write_file - create or truncate existing file
-            perror("Failed to open output file");
-            close(fdw);
-            return -1;
+            continue;
         }
-        // No errors, use dup2 to redirect output
-        if (dup2(fdw, STDOUT_FILENO) == -1) {
-            perror("dup2");
-            if (close(fdw) != 0) {
-                perror("Failed to close file");
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
             }
+            if (errno == ECHILD) {  // nothing left to wait for
+                job->num_pids = 0;
+                clock_gettime(CLOCK_MONOTONIC, &job->finished);
+                break;
+            }
+            perror("wait4");
             return -1;
         }
-    } else if ((index = strvec_find(tokens, ">>")) != -1) {  // ">>" present: same as ">" but no TRUNC, only append or create the output file
-        if (endProgram == 0) {
-            endProgram = index;
-        }
-        const char *write_file;
-        if ((write_file = strvec_get(tokens, index + 1)) == NULL) {  // gets next token which should be file name, checks for error
-            perror("No file specified after \">>\"");
-            return -1;
-        }
-        int fdw;
-        if ((fdw = open(write_file, O_CREAT|O_WRONLY|O_APPEND, S_IRUSR|S_IWUSR)) == -1) {  // open write_file - create or append if it already exists
-            perror("Failed to open output file");
-            close(fdw);
-            return -1;
+        if (WIFSTOPPED(wstatus)) {
+            TRACE_COMPLETE("wait", trace_start, 0, job->name);
+            TRACE_INSTANT("stop", pid, job->name, WSTOPSIG(wstatus));
+            return 1;
         }
-        // No errors, use dup2 to redirect output
-        if (dup2(fdw, STDOUT_FILENO) == -1) {
-            perror("dup2");
-            if (close(fdw) != 0) {
-                perror("Failed to close file");
-            }
-            return -1;
+        job_add_usage(job, &usage);
+        int status = WIFSIGNALED(wstatus) ? 128 + WTERMSIG(wstatus) : WEXITSTATUS(wstatus);
+        if (pid == job->last_pid) {
+            job->exit_status = status;
         }
+        TRACE_EXIT(pid, &job->started, job->name, status);
+        job_remove_pid(job, pid);
     }
-    if (endProgram != 0) {
-        strvec_take(tokens, endProgram);
+    if (job->timed_out) {
+        job->exit_status = WAIT_TIMED_OUT;
     }
-    // Execute the specified program (token 0) with the
-    // specified command-line arguments
-    // THIS FUNCTION SHOULD BE CALLED FROM A CHILD OF THE MAIN SHELL PROCESS
-    // Build a string array from the 'tokens' vector and pass this into execvp()
-    char *strarr[MAX_ARGS + 1];  // + 1 is to make space for the NULL sentinel value
-    int i = 0;
-    char *temp;
-    while ((temp = strvec_get(tokens, i)) != NULL && i < (MAX_ARGS + 1)) {
-        strarr[i] = temp;
-        i++;
+    TRACE_COMPLETE("wait", trace_start, 0, job->name);
+    return 0;
+}
+
+// Job ID given as the builtin's argument at index 'idx' of 'tokens', or -1
+// (never a valid ID) if it is missing or not a number
+static int job_id_arg(strvec_t *tokens, unsigned idx) {
+    const char *arg = strvec_get(tokens, idx);
+    if (arg == NULL || *arg == '\0') {
+        return -1;
     }
-    strarr[i] = NULL;
-    if (execvp(strarr[0], strarr) == -1) {
-        perror("exec");
+    char *end;
+    long id = strtol(arg, &end, 10);
+    if (*end != '\0' || id < 0 || id > INT_MAX) {
         return -1;
     }
-
-    // Not reachable after a successful exec(), but retain here to keep compiler happy
-    return 0;
+    return id;
 }
 
 int resume_job(strvec_t *tokens, job_list_t *jobs, int is_foreground) {
     // Implement the ability to resume stopped jobs in the foreground
     // 1. Look up the relevant job information (in a job_t) from the jobs list
-    //    using the index supplied by the user (in tokens index 1)
+    //    using the job ID supplied by the user (in tokens index 1)
     // 2. Call tcsetpgrp(STDIN_FILENO, <job_pid>) where job_pid is the job's process ID
     // 3. Send the process the SIGCONT signal with the kill() system call
     // 4. Use the same waitpid() logic as in main -- dont' forget WUNTRACED
     // 5. If the job has terminated (not stopped), remove it from the 'jobs' list
     // 6. Call tcsetpgrp(STDIN_FILENO, <shell_pid>). shell_pid is the *current*
     //    process's pid, since we call this function from the main shell process
+    if (!job_control) {
+        fprintf(stderr, "%s: no job control\n", is_foreground ? "fg" : "bg");
+        return -1;
+    }
     if (is_foreground == 1) {  // "fg"
-        const char *c = strvec_get(tokens, 1);  // get index of job_t in jobs_list_t supplied by user as second command line argument (tokens[1])
-        int job_index = atoi(c);  // convert index from string to integer
+        int job_index = job_id_arg(tokens, 1);  // get job ID supplied by user as second command line argument (tokens[1])
         job_t *job_to_resume;
-        if ((job_to_resume = job_list_get(jobs, job_index)) == NULL) {  // get job_t from specified index, check for errors
+        if ((job_to_resume = job_list_get(jobs, job_index)) == NULL) {  // get job_t with specified ID, check for errors
             fprintf(stderr, "Job index out of bounds\n");
             return -1;
         }
+        if (job_to_resume->num_pids == 0) {  // already reaped in the background
+            fprintf(stderr, "fg: job has terminated\n");
+            job_list_remove(jobs, job_index);
+            return -1;
+        }
+        TRACE_INSTANT("resume", 0, "fg", job_to_resume->id);
         if (tcsetpgrp(STDIN_FILENO, job_to_resume->pid) != 0) {  // move job_to_resume to the foreground, check for errors
             perror("tcsetpgrp");
             return -1;
         }
-        if (kill(job_to_resume->pid, SIGCONT) != 0) {  // send continue signal to job_to_resume, check for errors
+        if (kill(-job_to_resume->pid, SIGCONT) != 0) {  // send continue signal to job_to_resume's process group, check for errors
             perror("kill");
             return -1;
         }
-        int wstatus;
-        if (waitpid(job_to_resume->pid, &wstatus, WUNTRACED) == -1) {  // wait for job to terminate or stop, check for errors
-            perror("waitpid");
+        int stopped;
+        if ((stopped = wait_job(job_to_resume)) == -1) {  // wait for job to terminate or stop, check for errors
             return -1;
         }
-        if (WIFSTOPPED(wstatus)) {  // if job stopped, keep it in job list
+        if (stopped) {  // if job stopped, keep it in job list and take the terminal back
+            job_to_resume->status = JOB_STOPPED;
+            if (tcsetpgrp(STDIN_FILENO, getpid()) != 0) {
+                perror("tcsetpgrp");
+                return -1;
+            }
             return 0;
         }
         // ELSE (job terminated) - job has been waited for AND didn't get stopped
@@ -216,14 +329,19 @@ int resume_job(strvec_t *tokens, job_list_t *jobs, int is_foreground) {
     // 3. Make sure to modify the 'status' field of the relevant job list entry to JOB_BACKGROUND
     //    (as it was JOB_STOPPED before this)
     else {
-        const char *c = strvec_get(tokens, 1);  // get index of job_t in jobs_list_t supplied by user as second command line argument (tokens[1])
-        int job_index = atoi(c);  // convert index from string to integer
+        int job_index = job_id_arg(tokens, 1);  // get job ID supplied by user as second command line argument (tokens[1])
         job_t *job_to_resume;
-        if ((job_to_resume = job_list_get(jobs, job_index)) == NULL) {  // get job_t from specified index, check for errors
+        if ((job_to_resume = job_list_get(jobs, job_index)) == NULL) {  // get job_t with specified ID, check for errors
             fprintf(stderr, "Job index out of bounds\n");
             return -1;
         }
-        if (kill(job_to_resume->pid, SIGCONT) != 0) {  // send continue signal to job_to_resume, check for errors
+        if (job_to_resume->num_pids == 0) {  // already reaped in the background
+            fprintf(stderr, "bg: job has terminated\n");
+            job_list_remove(jobs, job_index);
+            return -1;
+        }
+        TRACE_INSTANT("resume", 0, "bg", job_to_resume->id);
+        if (kill(-job_to_resume->pid, SIGCONT) != 0) {  // send continue signal to job_to_resume's process group, check for errors
             perror("kill");
             return -1;
         }
@@ -236,17 +354,98 @@ int resume_job(strvec_t *tokens, job_list_t *jobs, int is_foreground) {
     return 0;
 }
 
+// Parse the "-t <ms>" and "-v" options of the wait builtins
+// Returns the index of the first argument after the options, or -1 on error
+static int wait_options(strvec_t *tokens, int *timeout_ms, int *verbose) {
+    const char *cmd = strvec_get(tokens, 0);
+    *timeout_ms = -1;
+    *verbose = 0;
+    unsigned i = 1;
+    const char *arg;
+    while ((arg = strvec_get(tokens, i)) != NULL && arg[0] == '-') {
+        if (strcmp(arg, "-v") == 0) {
+            *verbose = 1;
+        } else if (strcmp(arg, "-t") == 0) {
+            const char *ms = strvec_get(tokens, ++i);
+            char *end;
+            long value = ms == NULL ? -1 : strtol(ms, &end, 10);
+            if (ms == NULL || *ms == '\0' || *end != '\0' || value < 0 || value > INT_MAX) {
+                fprintf(stderr, "%s: -t: expected a timeout in milliseconds\n", cmd);
+                return -1;
+            }
+            *timeout_ms = value;
+        } else {
+            fprintf(stderr, "%s: %s: invalid option\n", cmd, arg);
+            return -1;
+        }
+        i++;
+    }
+    return i;
+}
+
+// Milliseconds left until 'deadline' (0 once it has passed), or -1 if there is no deadline
+static int time_left(const struct timespec *deadline, int timeout_ms) {
+    if (timeout_ms < 0) {
+        return -1;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long ms = (deadline->tv_sec - now.tv_sec) * 1000LL + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+    return ms < 0 ? 0 : (int) ms;
+}
+
+static void set_deadline(struct timespec *deadline, int timeout_ms) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    if (timeout_ms >= 0) {
+        deadline->tv_sec += timeout_ms / 1000;
+        deadline->tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline->tv_nsec >= 1000000000L) {
+            deadline->tv_sec++;
+            deadline->tv_nsec -= 1000000000L;
+        }
+    }
+}
+
+// The background job that finished first and was not collected yet, or NULL
+static job_t *first_finished(job_list_t *jobs) {
+    job_t *first = NULL;
+    for (job_t *job = job_list_next(jobs, NULL); job != NULL; job = job_list_next(jobs, job)) {
+        if (job->status == JOB_BACKGROUND && job->num_pids == 0 &&
+            (first == NULL || job->finished.tv_sec < first->finished.tv_sec ||
+             (job->finished.tv_sec == first->finished.tv_sec && job->finished.tv_nsec < first->finished.tv_nsec))) {
+            first = job;
+        }
+    }
+    return first;
+}
+
+// Remove a finished job from the list, reporting it first if asked to
+// Returns the job's exit status
+static int collect_job(job_list_t *jobs, job_t *job, int verbose) {
+    int status = job->exit_status;
+    if (verbose) {
+        report_job(job, 1);
+    }
+    job_list_remove(jobs, job->id);
+    return status;
+}
+
 int await_background_job(strvec_t *tokens, job_list_t *jobs) {
     // Wait for a specific job to stop or terminate
     // 1. Look up the relevant job information (in a job_t) from the jobs list
-    //    using the index supplied by the user (in tokens index 1)
+    //    using the job ID supplied by the user (after any options)
     // 2. Make sure the job's status is JOB_BACKGROUND (no sense waiting for a stopped job)
-    // 3. Use waitpid() to wait for the job to terminate, as you have in resume_job() and main().
-    // 4. If the process terminates (is not stopped by a signal) remove it from the jobs list
-    const char *c = strvec_get(tokens, 1);  // get index of job_t in jobs_list_t supplied by user as second command line argument (tokens[1])
-    int job_index = atoi(c);  // convert index from string to integer
+    // 3. Let the reaper collect the job's processes as they exit, until the job
+    //    is done, stops, or the timeout expires
+    // 4. If the job terminates (is not stopped by a signal) remove it from the jobs list
+    int timeout_ms, verbose;
+    int arg = wait_options(tokens, &timeout_ms, &verbose);
+    if (arg == -1) {
+        return -1;
+    }
+    int job_index = job_id_arg(tokens, arg);  // get job ID supplied by user after the options
     job_t *job_to_resume;
-    if ((job_to_resume = job_list_get(jobs, job_index)) == NULL) {  // get job_t from specified index, check for errors
+    if ((job_to_resume = job_list_get(jobs, job_index)) == NULL) {  // get job_t with specified ID, check for errors
         fprintf(stderr, "Job index out of bounds\n");
         return -1;
     }
@@ -254,51 +453,225 @@ int await_background_job(strvec_t *tokens, job_list_t *jobs) {
         fprintf(stderr, "Job index is for stopped process not background process\n");
         return -1;
     }
-    int wstatus;
-    if (waitpid(job_to_resume->pid, &wstatus, WUNTRACED) == -1) {  // wait for job to terminate or stop, check for errors
-        perror("waitpid");
-        return -1;
+    struct timespec deadline;
+    set_deadline(&deadline, timeout_ms);
+    while (job_to_resume->num_pids > 0 && job_to_resume->status == JOB_BACKGROUND) {
+        int left = time_left(&deadline, timeout_ms);
+        if (left == 0) {
+            return WAIT_TIMED_OUT;
+        }
+        if (reaper_wait(jobs, left) == -1) {  // wait for a child to change state, check for errors
+            return -1;
+        }
     }
-    if (WIFSTOPPED(wstatus)) {  // if job stopped, keep it in job list
-        return 0;
+    job_to_resume->notify = 0;  // reported here, if at all
+    if (job_to_resume->status == JOB_STOPPED) {  // if job stopped, keep it in job list
+        if (verbose) {
+            report_job(job_to_resume, 0);
+        }
+        return 128 + SIGTSTP;
     }
-    // ELSE (job terminated) - job has been waited for AND didn't get stopped
-    if (job_list_remove(jobs, job_index) != 0) {  // remove from job list, check for errors
-        perror("job_list_remove");
+    // ELSE (job terminated) - remove it from job list
+    return collect_job(jobs, job_to_resume, verbose);
+}
+
+int await_any_background_job(strvec_t *tokens, job_list_t *jobs) {
+    int timeout_ms, verbose;
+    int arg = wait_options(tokens, &timeout_ms, &verbose);
+    if (arg == -1) {
         return -1;
     }
-
-    return 0;
+    if (strvec_get(tokens, arg) != NULL) {
+        fprintf(stderr, "wait-any: too many arguments\n");
+        return -1;
+    }
+    struct timespec deadline;
+    set_deadline(&deadline, timeout_ms);
+    while (1) {
+        // Jobs reaped earlier (e.g., while the shell waited for input) count
+        // too; among those, the one that finished first is returned
+        job_t *job = first_finished(jobs);
+        if (job != NULL) {
+            job->notify = 0;
+            return collect_job(jobs, job, 1);
+        }
+        int running = 0;
+        for (job = job_list_next(jobs, NULL); job != NULL; job = job_list_next(jobs, job)) {
+            running |= job->status == JOB_BACKGROUND;
+        }
+        if (!running) {
+            fprintf(stderr, "wait-any: no background jobs\n");
+            return -1;
+        }
+        int left = time_left(&deadline, timeout_ms);
+        if (left == 0) {
+            return WAIT_TIMED_OUT;
+        }
+        if (reaper_wait(jobs, left) == -1) {
+            return -1;
+        }
+    }
 }
 
-int await_all_background_jobs(job_list_t *jobs) {
+int await_all_background_jobs(strvec_t *tokens, job_list_t *jobs) {
     // Wait for all background jobs to stop or terminate
-    // 1. Iterate through the jobs list, ignoring any stopped jobs
-    // 2. For a background job, call waitpid() with WUNTRACED.
-    // 3. If the job has stopped (check with WIFSTOPPED), change its
-    //    status to JOB_STOPPED. If the job has terminated, do nothing until the
-    //    next step (don't attempt to remove it while iterating through the list).
-    // 4. Remove all background jobs (which have all just terminated) from jobs list.
-    //    Use the job_list_remove_by_status() function.
-    job_t *temp = jobs->head;
-    int wstatus;
-    for (int i = 1; i < jobs->length; i++) {  // iterate through each job in the jobs list
-        if (temp->status == JOB_STOPPED) {
-            temp = temp->next;
-            continue;
+    // Jobs are collected in the order they finish, as the reaper sees them
+    // exit, so one slow job does not hold back the others; jobs that stop are
+    // marked JOB_STOPPED by the reaper and stay in the list
+    int timeout_ms, verbose;
+    int arg = wait_options(tokens, &timeout_ms, &verbose);
+    if (arg == -1) {
+        return -1;
+    }
+    if (strvec_get(tokens, arg) != NULL) {
+        fprintf(stderr, "wait-all: too many arguments\n");
+        return -1;
+    }
+    struct timespec deadline;
+    set_deadline(&deadline, timeout_ms);
+    while (1) {
+        job_t *job;
+        while ((job = first_finished(jobs)) != NULL) {
+            job->notify = 0;
+            collect_job(jobs, job, verbose);
+        }
+        int running = 0;
+        for (job = job_list_next(jobs, NULL); job != NULL; job = job_list_next(jobs, job)) {
+            running |= job->status == JOB_BACKGROUND;
+        }
+        if (!running) {
+            return 0;
+        }
+        int left = time_left(&deadline, timeout_ms);
+        if (left == 0) {
+            return WAIT_TIMED_OUT;
         }
-        if (waitpid(temp->pid, &wstatus, WUNTRACED) == -1) { // wait for job to terminate or stop, check for errors
-            perror("waitpid");
+        if (reaper_wait(jobs, left) == -1) {
             return -1;
         }
-        if (WIFSTOPPED(wstatus)) {  // if job stopped, change its status and move on
-            temp->status = JOB_STOPPED;
-            temp = temp->next;
-            continue;
+    }
+}
+
+int hash_command(strvec_t *tokens) {
+    const char *option = strvec_get(tokens, 1);
+    if (option == NULL) {  // "hash": list the table
+        path_cache_print();
+        return 0;
+    }
+    if (strcmp(option, "-r") == 0) {  // "hash -r": forget everything
+        path_cache_clear();
+        return 0;
+    }
+    if (strcmp(option, "-p") == 0) {  // "hash -p <path> <name>": remember without searching PATH
+        const char *path = strvec_get(tokens, 2);
+        const char *name = strvec_get(tokens, 3);
+        if (path == NULL || name == NULL) {
+            fprintf(stderr, "hash: usage: hash [-r] [-p pathname] [-dt] [name ...]\n");
+            return -1;
+        }
+        if (path_cache_insert(name, path) != 0) {
+            perror("hash");
+            return -1;
         }
-        temp = temp->next;
+        return 0;
     }
-    job_list_remove_by_status(jobs, JOB_BACKGROUND);  // remove all (now waited for) non-stopped jobs with the status JOB_BACKGROUND
 
+    int ret = 0;
+    int first_name = 1;
+    if (strcmp(option, "-d") == 0 || strcmp(option, "-t") == 0) {
+        first_name = 2;
+    }
+    for (unsigned i = first_name; i < tokens->length; i++) {
+        const char *name = strvec_get(tokens, i);
+        if (strcmp(option, "-d") == 0) {  // "hash -d <name>...": forget names
+            if (path_cache_remove(name) != 0) {
+                fprintf(stderr, "hash: %s: not found\n", name);
+                ret = -1;
+            }
+        } else if (strcmp(option, "-t") == 0) {  // "hash -t <name>...": print remembered paths
+            const char *path = path_cache_peek(name);
+            if (path == NULL) {
+                fprintf(stderr, "hash: %s: not found\n", name);
+                ret = -1;
+            } else if (tokens->length > 3) {
+                printf("%s\t%s\n", name, path);
+            } else {
+                printf("%s\n", path);
+            }
+        } else if (path_cache_lookup(name) == NULL) {  // "hash <name>...": search PATH now
+            fprintf(stderr, "hash: %s: not found\n", name);
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+int output_command(strvec_t *tokens, job_list_t *jobs) {
+    long lines = -1;
+    int follow = 0;
+    int timeout_ms = -1;
+    unsigned i = 1;
+    const char *arg;
+    while ((arg = strvec_get(tokens, i)) != NULL && arg[0] == '-') {
+        const char *value = strvec_get(tokens, i + 1);
+        char *end;
+        if (strcmp(arg, "-f") == 0) {
+            follow = 1;
+        } else if (strcmp(arg, "-n") == 0) {
+            lines = value == NULL ? -1 : strtol(value, &end, 10);
+            if (value == NULL || *value == '\0' || *end != '\0' || lines < 0) {
+                fprintf(stderr, "output: -n: expected a number of lines\n");
+                return -1;
+            }
+            i++;
+        } else if (strcmp(arg, "-t") == 0) {
+            long ms = value == NULL ? -1 : strtol(value, &end, 10);
+            if (value == NULL || *value == '\0' || *end != '\0' || ms < 0 || ms > INT_MAX) {
+                fprintf(stderr, "output: -t: expected a timeout in milliseconds\n");
+                return -1;
+            }
+            timeout_ms = ms;
+            i++;
+        } else {
+            fprintf(stderr, "output: %s: invalid option\n", arg);
+            return -1;
+        }
+        i++;
+    }
+    const char *id_arg = strvec_get(tokens, i);
+    if (follow) {
+        if (id_arg != NULL) {
+            fprintf(stderr, "output: -f follows every job\n");
+            return -1;
+        }
+        // Print the lines of all jobs as they complete, until every job has
+        // closed its output; jobs are reaped along the way
+        struct timespec deadline;
+        set_deadline(&deadline, timeout_ms);
+        capture_follow(1);
+        int ret = 0;
+        while (capture_num_open() > 0) {
+            int left = time_left(&deadline, timeout_ms);
+            if (left == 0) {
+                ret = WAIT_TIMED_OUT;
+                break;
+            }
+            if (reaper_wait(jobs, left) == -1) {
+                ret = -1;
+                break;
+            }
+        }
+        capture_follow(0);
+        return ret;
+    }
+    if (id_arg == NULL) {
+        capture_list();
+        return 0;
+    }
+    int id = job_id_arg(tokens, i);
+    if (id == -1 || capture_print(id, lines) != 0) {
+        fprintf(stderr, "output: %s: no output captured\n", id_arg);
+        return -1;
+    }
     return 0;
 }
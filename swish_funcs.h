@@ -2,24 +2,66 @@
 #define SWISH_FUNCS_H
 
 /*
- * Divide a string with substrings separated by a single space (" ")
+ * Nonzero when the shell runs with job control (interactive, on a terminal):
+ * every job then gets its own process group and takes the terminal while in
+ * the foreground. Without job control, children stay in the shell's process
+ * group and no terminal-control calls are made. Defaults to 0.
+ */
+extern int job_control;
+
+/*
+ * Divide a string with substrings separated by spaces or tabs
  * into tokens. These tokens should be stored in the 'tokens' vector using
- * "strvec_add".
+ * "strvec_add". A token starting with '#' begins a comment that runs to the end
+ * of the line (this also skips the "#!" line of scripts).
  * s: String to tokenize
  * vec: Pointer to vector in which to store tokens. Must be initialized
  *      before this function is called.
- * Returns 0 on success or -1 on error
+ * Returns 0 on success (an empty line yields no tokens) or -1 on error
  */
 int tokenize(char *s, strvec_t *tokens);
 
+/*
+ * Find the '<', '>' and '>>' operators in 'tokens' and open the files they name
+ * '<& fd' reads input from a copy of descriptor 'fd' instead of a file.
+ * Redirections are applied left to right, so with several of a kind the last
+ * one wins (every file is still opened, as in sh).
+ * The operators and file names are removed from 'tokens'
+ * tokens: Vector containing tokens input by user into shell
+ * in_fd: Set to the descriptor opened for '<' or '<&', or -1 if input is not redirected
+ * out_fd: Set to the descriptor opened for '>' or '>>', or -1 if output is not redirected
+ * flags: Extra flags passed to open() (e.g., O_CLOEXEC)
+ * Returns 0 on success or -1 on error (no descriptors are left open on error)
+ */
+int open_redirects(strvec_t *tokens, int *in_fd, int *out_fd, int flags);
+
+/*
+ * Close descriptors returned by open_redirects()
+ * Descriptors equal to -1 are ignored
+ */
+void close_redirects(int in_fd, int out_fd);
+
 /*
  * Run a user-specified command (including arguments)
  * This should be called within a CHILD process of the shell
  * tokens: Vector containing tokens input by user into shell
+ * pgid: Process group to join, 0 to start a new group led by this process,
+ *       or -1 to stay in the shell's process group
+ * path: Executable resolved by the PATH cache, or NULL to let execvp() search PATH
  * Doesn't return on success (similar to exec) or returns -1 on error
  * Perform input/output redirection
  */
-int run_command(strvec_t *tokens);
+int run_command(strvec_t *tokens, pid_t pgid, const char *path);
+
+/*
+ * Block the calling shell process until all processes of a job exit or one of them stops
+ * Processes that exit are removed from the job's pids
+ * While deadlines are set (see deadline.h), they fire during the wait, and a
+ * job that ran past its deadline gets the exit status WAIT_TIMED_OUT
+ * job: The job to wait for (it does not need to be in a jobs list)
+ * Returns 1 if the job stopped, 0 if all of its processes exited, or -1 on error
+ */
+int wait_job(job_t *job);
 
 /*
  * Resume a stopped (paused) process
@@ -32,24 +74,74 @@ int run_command(strvec_t *tokens);
  */
 int resume_job(strvec_t *tokens, job_list_t *jobs, int is_foreground);
 
+/*
+ * Status returned by the wait builtins when their "-t <ms>" timeout expires
+ * (the same as timeout(1))
+ */
+#define WAIT_TIMED_OUT 124
+
 /*
  * Block the calling shell process until a specific background job
  * stops running (either is stopped or exits).
  * If the job process exits, remove it from the jobs list.
+ *   wait-for [-v] [-t ms] id
+ * -t gives up after 'ms' milliseconds; -v prints the job's exit status and run time
  * tokens: Tokens from the command typed in by the user (e.g., "wait-for 2")
- * Returns 0 on success or -1 on error
+ * Returns the job's exit status, 128 + SIGTSTP if it stopped, WAIT_TIMED_OUT,
+ * or -1 on error
  */
 int await_background_job(strvec_t *tokens, job_list_t *jobs);
 
+/*
+ * Block the calling shell process until any background job exits, then
+ * remove it from the jobs list and print its exit status and run time
+ * A job that already finished is collected first without blocking.
+ *   wait-any [-t ms]
+ * tokens: Tokens from the command typed in by the user (e.g., "wait-any -t 500")
+ * jobs: Pointer to the list of current jobs for the shell
+ * Returns the job's exit status, WAIT_TIMED_OUT, or -1 on error (including
+ * when no background job is running)
+ */
+int await_any_background_job(strvec_t *tokens, job_list_t *jobs);
+
 /*
  * Block the calling shell process until all background jobs
  * stop running (either stopped or exited)
- * Remove all jobs that exit (are not stopped) from the jobs list
- * It's easiest to await all background jobs, then remove them from the
- * shell's job list at the end
+ * Jobs are removed from the jobs list in the order they exit, so a slow job
+ * early in the list does not delay collecting the others. Jobs that stop
+ * stay in the list.
+ *   wait-all [-v] [-t ms]
+ * -t gives up after 'ms' milliseconds (jobs that finished by then are still
+ * collected); -v prints each job's exit status and run time as it finishes
+ * tokens: Tokens from the command typed in by the user (e.g., "wait-all -v")
  * jobs: Pointer to the list of current jobs for the shell
- * Returns 0 on success or -1 on failure
+ * Returns 0 on success, WAIT_TIMED_OUT, or -1 on failure
+ */
+int await_all_background_jobs(strvec_t *tokens, job_list_t *jobs);
+
+/*
+ * Inspect or modify the shell's PATH cache, like bash's 'hash' builtin
+ *   hash                  List cached commands and how often each was used
+ *   hash -r               Forget all cached commands
+ *   hash name...          Search PATH for each name and cache the result
+ *   hash -d name...       Forget the given names
+ *   hash -t name...       Print the cached path of each name
+ *   hash -p path name     Cache 'path' for 'name' without searching PATH
+ * tokens: Tokens from the command typed in by the user (e.g., "hash -r")
+ * Returns 0 on success or -1 on error
+ */
+int hash_command(strvec_t *tokens);
+
+/*
+ * Show the output captured from background jobs (see capture.h)
+ *   output                List the jobs whose output was captured
+ *   output [-n N] id      Print job id's output, or its last N lines
+ *   output -f [-t ms]     Follow every job: print each line as it completes,
+ *                         prefixed with "[id] ", until all jobs close their output
+ * tokens: Tokens from the command typed in by the user (e.g., "output -n 5 2")
+ * jobs: Pointer to the list of current jobs, reaped while following
+ * Returns 0 on success, WAIT_TIMED_OUT, or -1 on error
  */
-int await_all_background_jobs(job_list_t *jobs);
+int output_command(strvec_t *tokens, job_list_t *jobs);
 
 #endif // SWISH_FUNCS_H
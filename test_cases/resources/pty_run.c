@@ -0,0 +1,257 @@
+/*
+ * Run a program on a pseudo-terminal, type keys into it and print the screen
+ * Usage: pty_run KEYS_FILE PROGRAM [ARGS...]
+ * Each line of KEYS_FILE is typed at once, after the program's output has
+ * been quiet for a moment (e.g., once a prompt is shown). Lines may hold
+ * escapes: \r (Enter), \n, \t (Tab), \e (Escape), \\ and ^X for Ctrl-X.
+ * The terminal is 80x24, so line editors that need a width work. Output is
+ * run through a small terminal model (cursor moves, erasing, wrapping) and
+ * the resulting lines are printed, so tests compare what a user would see
+ * rather than the escape sequences used to draw it.
+ */
+#define _GNU_SOURCE  // posix_openpt(), ptsname()
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ROWS 24
+#define COLS 80
+#define IDLE_MS 200      // Output quiet for this long means the program waits for keys
+#define MAX_WAIT_MS 5000
+
+static char (*screen)[COLS + 1] = NULL;
+static int num_rows = 0;
+static int row = 0, col = 0;
+static int esc_state = 0;  // 0: text, 1: after ESC, 2: in a CSI sequence
+static int csi_param = 0;
+
+static void ensure_row(int r) {
+    while (num_rows <= r) {
+        screen = realloc(screen, (num_rows + 1) * sizeof(*screen));
+        if (screen == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+        memset(screen[num_rows], ' ', COLS);
+        screen[num_rows][COLS] = '\0';
+        num_rows++;
+    }
+}
+
+static void clear_from(int r, int c) {
+    ensure_row(r);
+    memset(screen[r] + c, ' ', COLS - c);
+    num_rows = r + 1;
+}
+
+static void csi(char final, int n) {
+    int count = n == 0 ? 1 : n;
+    switch (final) {
+        case 'A':
+            row = row - count < 0 ? 0 : row - count;
+            break;
+        case 'B':
+            row += count;
+            ensure_row(row);
+            break;
+        case 'C':
+            col = col + count >= COLS ? COLS - 1 : col + count;
+            break;
+        case 'D':
+            col = col - count < 0 ? 0 : col - count;
+            break;
+        case 'H':
+            row = num_rows > ROWS ? num_rows - ROWS : 0;
+            col = 0;
+            break;
+        case 'J':
+            if (n == 2) {
+                clear_from(num_rows > ROWS ? num_rows - ROWS : 0, 0);
+            } else {
+                clear_from(row, col);
+            }
+            break;
+        case 'K':
+            ensure_row(row);
+            memset(screen[row] + col, ' ', COLS - col);
+            break;
+    }
+}
+
+static void feed(char c) {
+    if (esc_state == 1) {
+        esc_state = c == '[' ? 2 : 0;
+        csi_param = 0;
+        return;
+    } else if (esc_state == 2) {
+        if (c >= '0' && c <= '9') {
+            csi_param = csi_param * 10 + c - '0';
+        } else if (c >= '@' && c <= '~') {
+            csi(c, csi_param);
+            esc_state = 0;
+        }
+        return;
+    }
+    switch (c) {
+        case '\x1b':
+            esc_state = 1;
+            break;
+        case '\r':
+            col = 0;
+            break;
+        case '\n':
+            ensure_row(++row);
+            break;
+        case '\b':
+            col = col > 0 ? col - 1 : 0;
+            break;
+        case '\t':
+            col = (col / 8 + 1) * 8 >= COLS ? COLS - 1 : (col / 8 + 1) * 8;
+            break;
+        default:
+            if ((unsigned char) c < ' ') {  // e.g., the bell
+                break;
+            }
+            if (col >= COLS) {  // wrap when the character after the last column comes
+                row++;
+                col = 0;
+            }
+            ensure_row(row);
+            screen[row][col++] = c;
+            break;
+    }
+}
+
+// Read output until it has been quiet for IDLE_MS (or the program is gone)
+// Returns 0, or -1 once the terminal is closed
+static int drain(int fd, int idle_ms) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, idle_ms) <= 0) {
+            return 0;
+        }
+        char buf[4096];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            return -1;
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            feed(buf[i]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 < MAX_WAIT_MS);
+    return 0;
+}
+
+// Decode the escapes of a line of keys in place; returns its new length
+static size_t decode(char *keys) {
+    size_t len = 0;
+    for (char *p = keys; *p != '\0' && *p != '\n'; p++) {
+        if (*p == '\\' && p[1] != '\0' && p[1] != '\n') {
+            p++;
+            keys[len++] = *p == 'r' ? '\r' : *p == 't' ? '\t' : *p == 'e' ? '\x1b' : *p == 'n' ? '\n' : *p;
+        } else if (*p == '^' && p[1] >= '?' && p[1] <= '_') {
+            p++;
+            keys[len++] = *p == '?' ? 127 : *p - '@';
+        } else {
+            keys[len++] = *p;
+        }
+    }
+    return len;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("Usage: <keys_file> <program> [args...]\n");
+        return 1;
+    }
+    FILE *keys = fopen(argv[1], "r");
+    if (keys == NULL) {
+        perror("fopen");
+        return 1;
+    }
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd == -1 || grantpt(fd) == -1 || unlockpt(fd) == -1) {
+        perror("posix_openpt");
+        return 1;
+    }
+    struct winsize ws = {ROWS, COLS, 0, 0};
+    if (ioctl(fd, TIOCSWINSZ, &ws) == -1) {
+        perror("ioctl TIOCSWINSZ");
+        return 1;
+    }
+    const char *slave_name = ptsname(fd);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return 1;
+    } else if (pid == 0) {
+        // A new session whose controlling terminal is the slave side
+        int slave = setsid() == -1 ? -1 : open(slave_name, O_RDWR);
+        if (slave == -1) {
+            perror("pty_run: slave");
+            _exit(1);
+        }
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        close(slave);
+        close(fd);
+        execvp(argv[2], argv + 2);
+        perror("exec");
+        _exit(127);
+    }
+
+    ensure_row(0);
+    char *line = NULL;
+    size_t cap = 0;
+    int running = drain(fd, IDLE_MS) == 0;
+    while (running && getline(&line, &cap, keys) != -1) {
+        size_t len = decode(line);
+        if (write(fd, line, len) != (ssize_t) len) {
+            perror("write");
+            break;
+        }
+        running = drain(fd, IDLE_MS) == 0;
+    }
+    free(line);
+    fclose(keys);
+
+    // Collect what the program prints until it exits
+    int status = 0;
+    for (int waited = 0; waitpid(pid, &status, WNOHANG) == 0; waited += 10) {
+        if (waited >= MAX_WAIT_MS) {
+            fprintf(stderr, "pty_run: %s did not exit\n", argv[2]);
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            break;
+        }
+        if (drain(fd, 10) != 0) {
+            usleep(10000);
+        }
+    }
+    close(fd);
+
+    while (num_rows > 0 && strspn(screen[num_rows - 1], " ") == COLS) {
+        num_rows--;
+    }
+    for (int r = 0; r < num_rows; r++) {
+        int end = COLS;
+        while (end > 0 && screen[r][end - 1] == ' ') {
+            end--;
+        }
+        printf("%.*s\n", end, screen[r]);
+    }
+    free(screen);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
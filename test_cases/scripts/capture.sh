@@ -0,0 +1,20 @@
+# With SWISH_CAPTURE set, background jobs write into per-job ring buffers
+SWISH_CAPTURE=4096
+seq 1 5 &
+wait-all
+output 0
+output -n 2 0
+seq 1 100000 &
+wait-all
+output -n 3 0
+output
+ls /no_such_dir &
+wait-all
+output 0
+seq 3 &
+output -f
+output 7
+output -n
+SWISH_CAPTURE=
+echo not captured &
+wait-all
@@ -0,0 +1,37 @@
+# Command lists, && and || run commands in order or on their status
+echo one; echo two
+true && echo and-ran
+false && echo and-skipped
+false || echo or-ran
+true || echo or-skipped
+false && echo skipped || echo fallback
+test -e /nonexistent || echo missing &&
+  echo continued
+# A for loop over words, variables and patterns, parsed once
+WORDS=x
+for w in a $WORDS test_cases/scripts/gl*.sh; do echo item $w; done
+for i in 1 2
+do
+    for j in a b; do echo $i$j; done
+done
+for empty in; do echo never; done
+# while and until loops run until their condition changes
+N=x
+while test $N != xxxx; do N=${N}x; echo $N; done
+rm -f out.txt
+until [ -e out.txt ]; do echo until-once > out.txt; done
+cat out.txt
+while [ -e out.txt ]; do rm out.txt; echo while-once; done && echo loop-done
+# Builtins and programs mix in loop bodies, with redirections and pipes
+for n in 3 1 2; do echo $n | cat; done
+for n in 1 2; do printf %s- $n >> out.txt; cat out.txt | wc -c; done
+rm -f out.txt
+# Syntax errors stop nothing after them
+echo a; done
+for 1x in a; do echo; done
+echo b && ; echo c
+for x in a; do echo $x; done echo
+do echo d
+for i in 1; do cat <<EOF; done
+echo still running
+for x in a b
@@ -0,0 +1,8 @@
+# Empty commands and pipeline stages are rejected without running anything
+| cat || echo leading pipe failed
+echo a | || echo trailing pipe failed
+echo a | | cat || echo empty stage failed
+echo a | cat && echo full pipeline ok
+echo b &
+wait-all
+&
@@ -0,0 +1,18 @@
+# With SWISH_SPAWN=server, commands start from the fork server's small image
+/bin/echo started by the server
+export GREETING=hello
+env | grep GREETING
+GREETING=override env | grep GREETING
+unset GREETING
+env | grep -c GREETING
+cd test_cases
+ls scripts/forkserver.sh
+cd ..
+seq 1 5 | sort -r | head -n 2
+seq 3 > out.txt
+wc -l < out.txt
+sleep 0.1 &
+seq 4 6 &
+wait-all
+no_such_command
+job-opts -n 7 -- nice
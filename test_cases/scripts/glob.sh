@@ -0,0 +1,13 @@
+# Words holding *, ? or [...] are replaced by the sorted pathnames they match
+echo test_cases/resources/*.txt
+echo test_cases/resources/?uote.*
+echo test_cases/resources/[gq]*.txt
+echo test_cases/resources/[!g]*
+echo test_cases/script?/gl*.sh
+echo test_cases/*/
+wc -l test_cases/resources/q*
+echo no_such_file*.txt
+P=test_cases/resources/*.c
+echo $P
+[ -d test_cases ]
+echo done
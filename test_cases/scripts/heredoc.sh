@@ -0,0 +1,27 @@
+# Here-documents and here-strings feed programs and builtins alike
+cat <<EOF
+first line
+  indented line
+EOF
+wc -l << 'END'
+a
+b
+c
+END
+tr a-z A-Z <<< hello
+cat <<-EOF | tr a-z A-Z
+	tabs are stripped
+	EOF
+sort <<EOF > out.txt
+pear
+apple
+EOF
+cat out.txt
+# With several input redirections the last one wins
+cat <<A <<<last
+first
+A
+cat <<<one <<<two
+cat < test_cases/resources/quote.txt <<<string
+wc -l <<<string < test_cases/resources/quote.txt > out.txt
+cat out.txt
@@ -0,0 +1,11 @@
+# Each line run is appended to $SWISH_HISTFILE with its status and directory
+echo first
+ls no_such_file
+echo second line
+  echo lines starting with a space are not kept
+history
+history 2
+history -s line
+history -s ec
+history -s nothing-like-this
+echo done
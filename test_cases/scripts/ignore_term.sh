@@ -0,0 +1,4 @@
+#!/bin/sh
+# Ignores SIGTERM, so only SIGKILL ends it
+trap "" TERM
+exec sleep 5
@@ -0,0 +1,15 @@
+# job-opts sets the priority and limits of later jobs, or of one job after --
+job-opts -n 5 -f 64 -m 512M
+job-opts
+nice
+grep -e files -e address /proc/self/limits
+job-opts -n 10 -t 30 -- nice
+grep cpu /proc/self/limits
+echo builtins run in the shell
+job-opts -x
+job-opts
+nice
+job-opts -n 40
+job-opts -q
+job-opts -R
+job-opts
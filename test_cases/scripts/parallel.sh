@@ -0,0 +1,5 @@
+# One worker at a time, so reports come out in input order
+parallel -j 1 -a test_cases/scripts/items.txt echo item {}
+parallel -j 1 -a test_cases/scripts/items.txt test {} -lt 2
+# -e starts nothing after the first failure
+parallel -j 1 -e -a test_cases/scripts/items.txt false
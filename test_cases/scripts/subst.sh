@@ -0,0 +1,9 @@
+# $(...) is replaced by the words of the command's output
+echo today is $(echo mon tue)!
+echo v$(echo 1 2)x
+echo nested $(echo a $(echo b))
+echo lines: $(cat test_cases/resources/quote.txt | wc -l)
+echo empty[$(true)]
+wc -w $(echo test_cases/resources/quote.txt)
+echo unclosed $(echo x
+echo done
@@ -0,0 +1,8 @@
+# time reports the resource usage of a job on stderr once it exits, and
+# jobs -l adds the process group and usage so far of each job
+time true
+time false | cat
+sleep 0.5 &
+jobs -l
+wait-all
+jobs -l
@@ -0,0 +1,11 @@
+# timeout sends SIGTERM at the deadline, then SIGKILL after the grace period
+timeout 0.2 sleep 5 &
+timeout 5 sleep 0.1 &
+timeout -k 0.2 0.1 sh test_cases/scripts/ignore_term.sh &
+sleep 0.6
+timeout 0.1 sleep 1 | cat
+timeout 5 seq 3 | cat
+timeout x sleep 1
+timeout 1
+timeout 1m
+timeout 0.2 sleep 5
@@ -0,0 +1,12 @@
+# Record a short session with SWISH_TRACE in each way of starting commands,
+# check that the file is valid JSON and holds the expected events
+for mode in spawn fork; do
+    rm -f trace.json
+    SWISH_SPAWN=$mode SWISH_TRACE=trace.json ./swish -c 'echo hi | cat > /dev/null
+true'
+    python3 -m json.tool trace.json > /dev/null && echo "$mode: valid JSON"
+    for event in read parse posix_spawn fork redirects exec wait exit; do
+        grep -q "\"name\":\"$event\"" trace.json && echo "$mode: $event"
+    done
+done
+rm -f trace.json
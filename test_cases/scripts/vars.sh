@@ -0,0 +1,21 @@
+# NAME=value sets a shell variable, $NAME and ${NAME} expand to its value
+NAME=world
+echo hello $NAME and ${NAME}s
+env | grep ^NAME=
+export NAME
+env | grep ^NAME=
+GREETING=hi env | grep ^GREETING=
+echo greeting[$GREETING]
+ls -d test_cases
+PATH=/nonexistent ls -d test_cases
+PATH=/nonexistent:/bin:/usr/bin ls -d test_cases
+W=$(echo one two)
+echo $W
+X=pre$W
+echo [$X]
+unset NAME
+echo unset[$NAME]
+env | grep -c ^NAME=
+echo bad ${bad
+echo cost $5
+echo done
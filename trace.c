@@ -0,0 +1,198 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define DETAIL_LEN 48
+#define EVENT_LEN 512  // Longest JSON text of one event
+
+typedef struct {
+    const char *name;
+    char phase;        // 'X' (complete), 'i' (instant) or 'M' (thread name metadata)
+    pid_t tid;
+    uint64_t ts;       // Nanoseconds
+    uint64_t dur;      // Nanoseconds, 'X' events only
+    long value;
+    char detail[DETAIL_LEN];
+} event_t;
+
+int trace_enabled = 0;
+
+static event_t *ring = NULL;
+static unsigned ring_len = 0;
+static int trace_fd = -1;
+static pid_t shell_pid;
+static int direct = 0;  // Nonzero in a forked child: write events immediately
+
+uint64_t trace_timespec(const struct timespec *ts) {
+    return (uint64_t) ts->tv_sec * 1000000000u + ts->tv_nsec;
+}
+
+uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return trace_timespec(&ts);
+}
+
+static void write_all(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(trace_fd, buf, len);
+        if (n <= 0) {
+            return;  // tracing must never disturb the shell
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+// Append 's' to 'out' as the contents of a JSON string
+static size_t escape(char *out, size_t size, const char *s) {
+    size_t len = 0;
+    for (; *s != '\0' && len + 7 < size; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            out[len++] = '\\';
+            out[len++] = c;
+        } else if (c < 0x20) {
+            len += snprintf(out + len, size - len, "\\u%04x", c);
+        } else {
+            out[len++] = c;
+        }
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Format one event as ",\n{...}": the array was opened with a first element,
+// so every event can start with a comma wherever it ends up in the file
+static size_t format_event(char *buf, const event_t *event) {
+    char detail[DETAIL_LEN * 6 + 1];
+    escape(detail, sizeof(detail), event->detail);
+    // Timestamps are in microseconds
+    if (event->phase == 'M') {
+        return snprintf(buf, EVENT_LEN,
+                        ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                        "\"args\":{\"name\":\"%s\"}}",
+                        shell_pid, event->tid, detail);
+    }
+    size_t len = snprintf(buf, EVENT_LEN,
+                          ",\n{\"name\":\"%s\",\"cat\":\"swish\",\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,"
+                          "\"ts\":%llu.%03llu",
+                          event->name, event->phase, shell_pid, event->tid,
+                          (unsigned long long) event->ts / 1000, (unsigned long long) event->ts % 1000);
+    if (event->phase == 'X') {
+        len += snprintf(buf + len, EVENT_LEN - len, ",\"dur\":%llu.%03llu",
+                        (unsigned long long) event->dur / 1000, (unsigned long long) event->dur % 1000);
+    } else {
+        len += snprintf(buf + len, EVENT_LEN - len, ",\"s\":\"t\"");
+    }
+    len += snprintf(buf + len, EVENT_LEN - len, ",\"args\":{\"detail\":\"%s\",\"value\":%ld}}",
+                    detail, event->value);
+    return len < EVENT_LEN ? len : EVENT_LEN - 1;
+}
+
+static void flush_ring(void) {
+    char buf[EVENT_LEN * 8];
+    size_t len = 0;
+    for (unsigned i = 0; i < ring_len; i++) {
+        if (len + EVENT_LEN > sizeof(buf)) {
+            write_all(buf, len);
+            len = 0;
+        }
+        len += format_event(buf + len, &ring[i]);
+    }
+    write_all(buf, len);
+    ring_len = 0;
+}
+
+static void record(char phase, const char *name, pid_t tid, uint64_t ts, uint64_t dur,
+                   const char *detail, long value) {
+    event_t local;
+    event_t *event = direct ? &local : &ring[ring_len];
+    event->name = name;
+    event->phase = phase;
+    event->tid = tid == 0 ? getpid() : tid;
+    event->ts = ts;
+    event->dur = dur;
+    event->value = value;
+    event->detail[0] = '\0';
+    if (detail != NULL) {
+        strncpy(event->detail, detail, DETAIL_LEN - 1);
+        event->detail[DETAIL_LEN - 1] = '\0';
+    }
+    if (direct) {
+        char buf[EVENT_LEN];
+        write_all(buf, format_event(buf, event));
+    } else if (++ring_len == TRACE_RING_SIZE) {
+        flush_ring();
+    }
+}
+
+int trace_init(void) {
+    const char *file = getenv("SWISH_TRACE");
+    if (file == NULL || *file == '\0') {
+        return 0;
+    }
+    if ((ring = malloc(TRACE_RING_SIZE * sizeof(event_t))) == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    // O_APPEND keeps events written by forked children whole and in place
+    if ((trace_fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644)) == -1) {
+        perror(file);
+        free(ring);
+        ring = NULL;
+        return -1;
+    }
+    shell_pid = getpid();
+    char buf[128];
+    int len = snprintf(buf, sizeof(buf),
+                       "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"swish\"}}",
+                       shell_pid);
+    write_all(buf, len);
+    trace_enabled = 1;
+    return 0;
+}
+
+void trace_free(void) {
+    if (!trace_enabled) {
+        return;
+    }
+    flush_ring();
+    write_all("\n]\n", 3);
+    close(trace_fd);
+    trace_fd = -1;
+    free(ring);
+    ring = NULL;
+    trace_enabled = 0;
+}
+
+void trace_child(void) {
+    direct = 1;
+    ring_len = 0;
+}
+
+void trace_complete(const char *name, uint64_t start, pid_t tid, const char *detail) {
+    uint64_t now = trace_now();
+    record('X', name, tid, start, now - start, detail, 0);
+}
+
+void trace_instant(const char *name, pid_t tid, const char *detail, long value) {
+    record('i', name, tid, trace_now(), 0, detail, value);
+}
+
+void trace_exit(pid_t pid, const struct timespec *started, const char *name, int status) {
+    uint64_t now = trace_now();
+    record('X', "run", pid, trace_timespec(started), now - trace_timespec(started), name, 0);
+    record('i', "exit", pid, now, 0, name, status);
+}
+
+void trace_name_process(pid_t tid, const char *name) {
+    record('M', "thread_name", tid, 0, 0, name, 0);
+}
@@ -0,0 +1,108 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * Opt-in tracing of the shell's command lifecycle in Chrome trace-event JSON
+ * (the array format), which chrome://tracing and https://ui.perfetto.dev load
+ * Set SWISH_TRACE to a file name to enable it. Events go to an in-memory ring
+ * of TRACE_RING_SIZE entries that is written out whenever it fills up and when
+ * the shell exits. The shell's own phases (read, parse, expand, spawn, wait,
+ * tcsetpgrp, ...) appear on its thread; every child process gets a thread of
+ * its own showing its run time, with stop/continue/exit markers.
+ * When tracing is off, every hook costs one well-predicted branch on 'trace_enabled'.
+ */
+
+// Number of events buffered before they are written to the trace file
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 1024
+#endif
+
+/*
+ * Nonzero while a trace is being recorded. Only read it through the macros below.
+ */
+extern int trace_enabled;
+
+#define TRACE_ON __builtin_expect(trace_enabled, 0)
+
+// Timestamp for the start of a phase, or 0 when tracing is off
+#define TRACE_CLOCK() (TRACE_ON ? trace_now() : 0)
+
+// Record a phase of the shell (or of 'tid') that started at 'start' and ends now
+#define TRACE_COMPLETE(name, start, tid, detail) \
+    do { if (TRACE_ON) trace_complete((name), (start), (tid), (detail)); } while (0)
+
+// Record a point event on thread 'tid' (0 for the shell) with an optional number
+#define TRACE_INSTANT(name, tid, detail, value) \
+    do { if (TRACE_ON) trace_instant((name), (tid), (detail), (value)); } while (0)
+
+// Record that child process 'pid' of a job started at 'started' exited with 'status'
+#define TRACE_EXIT(pid, started, name, status) \
+    do { if (TRACE_ON) trace_exit((pid), (started), (name), (status)); } while (0)
+
+// Name the thread of child process 'tid' after its command
+#define TRACE_NAME(tid, name) \
+    do { if (TRACE_ON) trace_name_process((tid), (name)); } while (0)
+
+/*
+ * Start tracing if SWISH_TRACE names a file: create it and write the start of the JSON array
+ * Returns 0 on success (or if tracing is not requested) or -1 on error
+ */
+int trace_init(void);
+
+/*
+ * Write out buffered events, close the JSON array and stop tracing
+ */
+void trace_free(void);
+
+/*
+ * Call in a forked child before it records events: the child's copy of the
+ * ring belongs to the shell, so from then on the child writes each event
+ * straight to the trace file instead of buffering it
+ */
+void trace_child(void);
+
+/*
+ * Current CLOCK_MONOTONIC time in nanoseconds
+ */
+uint64_t trace_now(void);
+
+/*
+ * Convert a CLOCK_MONOTONIC time (e.g., a job's start time) to trace_now() units
+ */
+uint64_t trace_timespec(const struct timespec *ts);
+
+/*
+ * Record a complete ("X") event lasting from 'start' (a trace_now() value) until now
+ * name: Phase name. Must be a string literal or otherwise outlive the trace
+ * tid: Process whose thread the event appears on, or 0 for the calling process
+ * detail: Optional text shown with the event (copied, may be truncated), or NULL
+ */
+void trace_complete(const char *name, uint64_t start, pid_t tid, const char *detail);
+
+/*
+ * Record an instant ("i") event
+ * name: Event name. Must be a string literal or otherwise outlive the trace
+ * tid: Process whose thread the event appears on, or 0 for the calling process
+ * detail: Optional text shown with the event (copied, may be truncated), or NULL
+ * value: Number shown with the event (e.g., an exit status or job ID)
+ */
+void trace_instant(const char *name, pid_t tid, const char *detail, long value);
+
+/*
+ * Record a child's run time, from its job's start until now, on the child's
+ * thread, followed by an "exit" event carrying its exit status
+ * started: CLOCK_MONOTONIC start time of the process's job
+ * name: Name of the job
+ * status: Exit status in shell terms (128 + n if killed by signal n)
+ */
+void trace_exit(pid_t pid, const struct timespec *started, const char *name, int status);
+
+/*
+ * Name the thread of a child process after its command
+ */
+void trace_name_process(pid_t tid, const char *name);
+
+#endif // TRACE_H
@@ -0,0 +1,359 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "string_vector.h"
+#include "vars.h"
+
+#define INITIAL_SIZE 64  // Must be a power of 2
+#define INITIAL_ENVP_SIZE 32
+
+extern char **environ;
+
+typedef struct {
+    char *str;          // "NAME=value", NULL for an empty slot
+    size_t name_len;
+    int exported;
+} var_t;
+
+static var_t *table = NULL;
+static unsigned table_size = 0;  // Number of slots in 'table'
+static unsigned table_used = 0;  // Number of variables in 'table'
+
+static char **envp = NULL;       // Strings of the exported variables, then NULL
+static unsigned envp_cap = 0;
+static unsigned num_exported = 0;
+
+static char **override_envp = NULL;   // envp with per-command overrides applied
+static unsigned envp_generation = 0;  // Changes whenever vars_envp() may return different strings
+static char **override_strs = NULL;   // Copies of the overriding assignments
+static unsigned num_overrides = 0;
+
+static char **original_environ = NULL;
+
+// FNV-1a
+static unsigned hash_name(const char *s, size_t len) {
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Returns the slot holding 'name', or the empty slot where it would be inserted
+static unsigned find_slot(const char *name, size_t len) {
+    unsigned mask = table_size - 1;
+    unsigned i = hash_name(name, len) & mask;
+    while (table[i].str != NULL &&
+           (table[i].name_len != len || memcmp(table[i].str, name, len) != 0)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+// Linear probing removal by shifting later entries of the cluster back
+static void remove_slot(unsigned i) {
+    unsigned mask = table_size - 1;
+    free(table[i].str);
+    table[i].str = NULL;
+    table_used--;
+    unsigned j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (table[j].str == NULL) {
+            return;
+        }
+        unsigned home = hash_name(table[j].str, table[j].name_len) & mask;
+        // Move the entry back if its home slot is not within (i, j]
+        if ((i <= j) ? (home <= i || home > j) : (home <= i && home > j)) {
+            table[i] = table[j];
+            table[j].str = NULL;
+            i = j;
+        }
+    }
+}
+
+static int grow_table(void) {
+    unsigned new_size = table_size == 0 ? INITIAL_SIZE : table_size * 2;
+    var_t *new_table = calloc(new_size, sizeof(var_t));
+    if (new_table == NULL) {
+        return -1;
+    }
+    var_t *old_table = table;
+    unsigned old_size = table_size;
+    table = new_table;
+    table_size = new_size;
+    for (unsigned i = 0; i < old_size; i++) {
+        if (old_table[i].str != NULL) {
+            table[find_slot(old_table[i].str, old_table[i].name_len)] = old_table[i];
+        }
+    }
+    free(old_table);
+    return 0;
+}
+
+// Collect the strings of exported variables into 'envp' (no strings are copied)
+static int rebuild_envp(void) {
+    if (num_exported + 1 > envp_cap) {
+        unsigned new_cap = envp_cap == 0 ? INITIAL_ENVP_SIZE : envp_cap;
+        while (new_cap < num_exported + 1) {
+            new_cap *= 2;
+        }
+        char **new_envp = realloc(envp, new_cap * sizeof(char *));
+        if (new_envp == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        envp = new_envp;
+        envp_cap = new_cap;
+    }
+    unsigned n = 0;
+    for (unsigned i = 0; i < table_size; i++) {
+        if (table[i].str != NULL && table[i].exported) {
+            envp[n++] = table[i].str;
+        }
+    }
+    envp[n] = NULL;
+    environ = envp;
+    envp_generation++;
+    return 0;
+}
+
+// Set a variable without updating 'envp', returns its slot or -1 on error
+static int set_var(const char *assignment, int export) {
+    size_t len = vars_name_len(assignment);
+    if (len == 0 || assignment[len] != '=') {
+        return -1;
+    }
+    if (table_size == 0 || (table_used + 1) * 10 > table_size * 7) {  // keep load factor <= 0.7
+        if (grow_table() != 0) {
+            perror("calloc");
+            return -1;
+        }
+    }
+    char *str = strdup(assignment);
+    if (str == NULL) {
+        perror("strdup");
+        return -1;
+    }
+    unsigned i = find_slot(assignment, len);
+    if (table[i].str != NULL) {
+        free(table[i].str);
+    } else {
+        table[i].name_len = len;
+        table[i].exported = 0;
+        table_used++;
+    }
+    table[i].str = str;
+    if (export && !table[i].exported) {
+        table[i].exported = 1;
+        num_exported++;
+    }
+    return i;
+}
+
+int vars_init(void) {
+    original_environ = environ;
+    for (char **e = original_environ; e != NULL && *e != NULL; e++) {
+        if (vars_is_assignment(*e) && set_var(*e, 1) == -1) {
+            return -1;
+        }
+    }
+    return rebuild_envp();
+}
+
+void vars_free(void) {
+    vars_pop_overrides();
+    for (unsigned i = 0; i < table_size; i++) {
+        free(table[i].str);
+    }
+    free(table);
+    table = NULL;
+    table_size = 0;
+    table_used = 0;
+    environ = original_environ;
+    free(envp);
+    envp = NULL;
+    envp_cap = 0;
+    num_exported = 0;
+}
+
+size_t vars_name_len(const char *s) {
+    if (!isalpha((unsigned char) s[0]) && s[0] != '_') {
+        return 0;
+    }
+    size_t len = 1;
+    while (isalnum((unsigned char) s[len]) || s[len] == '_') {
+        len++;
+    }
+    return len;
+}
+
+int vars_is_assignment(const char *token) {
+    size_t len = vars_name_len(token);
+    return len > 0 && token[len] == '=';
+}
+
+const char *vars_get_n(const char *name, size_t len) {
+    if (table_size == 0) {
+        return NULL;
+    }
+    unsigned i = find_slot(name, len);
+    return table[i].str == NULL ? NULL : table[i].str + len + 1;
+}
+
+const char *vars_get(const char *name) {
+    return vars_get_n(name, strlen(name));
+}
+
+int vars_assign(const char *assignment, int export) {
+    int i = set_var(assignment, export);
+    if (i == -1) {
+        return -1;
+    }
+    return table[i].exported ? rebuild_envp() : 0;
+}
+
+int vars_set(const char *name, const char *value) {
+    size_t name_len = strlen(name);
+    size_t value_len = strlen(value);
+    char *assignment = malloc(name_len + value_len + 2);
+    if (assignment == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(assignment, name, name_len);
+    assignment[name_len] = '=';
+    memcpy(assignment + name_len + 1, value, value_len + 1);
+    int ret = vars_assign(assignment, 0);
+    free(assignment);
+    return ret;
+}
+
+int vars_export(const char *name) {
+    size_t len = strlen(name);
+    if (table_size == 0) {
+        return -1;
+    }
+    unsigned i = find_slot(name, len);
+    if (table[i].str == NULL) {
+        return -1;
+    }
+    if (table[i].exported) {
+        return 0;
+    }
+    table[i].exported = 1;
+    num_exported++;
+    return rebuild_envp();
+}
+
+int vars_unset(const char *name) {
+    size_t len = strlen(name);
+    if (table_size == 0) {
+        return -1;
+    }
+    unsigned i = find_slot(name, len);
+    if (table[i].str == NULL) {
+        return -1;
+    }
+    int exported = table[i].exported;
+    remove_slot(i);
+    if (exported) {
+        num_exported--;
+        return rebuild_envp();
+    }
+    return 0;
+}
+
+// Order "NAME=value" strings by name ('=' ends the name)
+static int compare_names(const void *a, const void *b) {
+    const char *x = *(char * const *) a;
+    const char *y = *(char * const *) b;
+    while (*x == *y && *x != '=') {
+        x++;
+        y++;
+    }
+    return (*x == '=' ? -1 : (unsigned char) *x) - (*y == '=' ? -1 : (unsigned char) *y);
+}
+
+void vars_print_exported(void) {
+    char **sorted = malloc((num_exported + 1) * sizeof(char *));
+    if (sorted == NULL) {
+        perror("malloc");
+        return;
+    }
+    memcpy(sorted, envp, (num_exported + 1) * sizeof(char *));
+    qsort(sorted, num_exported, sizeof(char *), compare_names);
+    for (unsigned i = 0; i < num_exported; i++) {
+        printf("export %s\n", sorted[i]);
+    }
+    free(sorted);
+}
+
+char **vars_envp(void) {
+    return override_envp != NULL ? override_envp : envp;
+}
+
+unsigned vars_envp_generation(void) {
+    return envp_generation;
+}
+
+int vars_push_overrides(strvec_t *tokens, unsigned n) {
+    vars_pop_overrides();
+    if ((override_envp = malloc((num_exported + n + 1) * sizeof(char *))) == NULL ||
+        (override_strs = malloc(n * sizeof(char *))) == NULL) {
+        perror("malloc");
+        vars_pop_overrides();
+        return -1;
+    }
+    memcpy(override_envp, envp, num_exported * sizeof(char *));
+    unsigned len = num_exported;
+    for (unsigned k = 0; k < n; k++) {
+        const char *assignment = strvec_get(tokens, k);
+        size_t name_len = vars_name_len(assignment);
+        char *copy = strdup(assignment);
+        if (copy == NULL) {
+            perror("strdup");
+            vars_pop_overrides();
+            return -1;
+        }
+        override_strs[num_overrides++] = copy;
+        unsigned i = 0;
+        while (i < len && strncmp(override_envp[i], assignment, name_len + 1) != 0) {
+            i++;
+        }
+        override_envp[i] = copy;
+        if (i == len) {
+            len++;
+        }
+    }
+    override_envp[len] = NULL;
+    envp_generation++;
+    return 0;
+}
+
+int vars_overridden(const char *name) {
+    size_t name_len = strlen(name);
+    for (unsigned k = 0; k < num_overrides; k++) {
+        if (strncmp(override_strs[k], name, name_len) == 0 && override_strs[k][name_len] == '=') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void vars_pop_overrides(void) {
+    if (override_envp != NULL) {
+        envp_generation++;
+    }
+    for (unsigned k = 0; k < num_overrides; k++) {
+        free(override_strs[k]);
+    }
+    free(override_strs);
+    override_strs = NULL;
+    num_overrides = 0;
+    free(override_envp);
+    override_envp = NULL;
+}
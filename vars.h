@@ -0,0 +1,114 @@
+#ifndef VARS_H
+#define VARS_H
+#include <stddef.h>
+
+#include "string_vector.h"
+
+/*
+ * Shell variables, kept in a hash table as "NAME=value" strings
+ * Exported variables make up the environment of every command the shell
+ * starts. Their strings are collected in one NULL-terminated envp array that
+ * is rebuilt only when an exported variable is set, exported or unset, so
+ * starting a command passes a ready-made array without copying anything. The
+ * process's 'environ' points at the same array, keeping getenv() and the PATH
+ * search of execvp()/posix_spawnp() in step with the shell's variables.
+ */
+
+/*
+ * Import the process's environment as exported variables
+ * Returns 0 on success or -1 on error
+ */
+int vars_init(void);
+
+/*
+ * Release all variables and restore the original 'environ'
+ */
+void vars_free(void);
+
+/*
+ * Length of the variable name at the start of 's' (letters, digits and '_',
+ * not starting with a digit), 0 if 's' does not start with a name
+ */
+size_t vars_name_len(const char *s);
+
+/*
+ * Returns nonzero if 'token' is an assignment such as "NAME=value"
+ */
+int vars_is_assignment(const char *token);
+
+/*
+ * Look up a variable
+ * name: The variable's name, of length 'len'
+ * Returns the variable's value, or NULL if it is not set
+ */
+const char *vars_get_n(const char *name, size_t len);
+
+/*
+ * Look up a variable by its NUL-terminated name
+ * Returns the variable's value, or NULL if it is not set
+ */
+const char *vars_get(const char *name);
+
+/*
+ * Set a variable from an assignment such as "NAME=value"
+ * export: Nonzero to export the variable; otherwise it keeps its export flag
+ *         (new variables are not exported)
+ * Returns 0 on success or -1 on error
+ */
+int vars_assign(const char *assignment, int export);
+
+/*
+ * Set a variable to a value, as vars_assign() does for "NAME=value"
+ * Returns 0 on success or -1 on error (e.g., 'name' is not a valid name)
+ */
+int vars_set(const char *name, const char *value);
+
+/*
+ * Export a variable that is already set
+ * Returns 0 on success or -1 if the variable is not set
+ */
+int vars_export(const char *name);
+
+/*
+ * Remove a variable
+ * Returns 0 on success or -1 if the variable is not set
+ */
+int vars_unset(const char *name);
+
+/*
+ * Print every exported variable as "export NAME=value", sorted by name
+ */
+void vars_print_exported(void);
+
+/*
+ * Get the environment for starting a command: the exported variables, with
+ * any per-command overrides from vars_push_overrides() applied
+ * Returns a NULL-terminated array of "NAME=value" strings owned by this module
+ */
+char **vars_envp(void);
+
+/*
+ * Returns a number that changes whenever the strings vars_envp() returns may
+ * have changed, so copies of the environment kept elsewhere can be refreshed
+ */
+unsigned vars_envp_generation(void);
+
+/*
+ * Use the first 'n' tokens, each an assignment ("NAME=value"), as overrides
+ * of the environment for the commands started until vars_pop_overrides()
+ * (e.g., "LANG=C sort file"). Shell variables are not changed.
+ * Returns 0 on success or -1 on error
+ */
+int vars_push_overrides(strvec_t *tokens, unsigned n);
+
+/*
+ * Nonzero if the overrides from vars_push_overrides() set 'name' (e.g., PATH)
+ */
+int vars_overridden(const char *name);
+
+/*
+ * Go back to the environment of exported variables
+ */
+void vars_pop_overrides(void);
+
+#endif // VARS_H
@@ -0,0 +1,418 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "string_vector.h"
+#include "wildcard.h"
+
+#define INITIAL_SIZE 16  // Must be a power of 2
+#define DIRENT_BUF_SIZE (128 * 1024)  // Enough for a few thousand entries per getdents64()
+#define INITIAL_NAMES_SIZE 4096
+#define MAX_CACHED_NAMES (1 << 20)  // The cache is emptied once it holds more names than this
+#define RACY_SECONDS 2  // Listings of directories changed this recently are not trusted
+
+// Record returned by getdents64()
+typedef struct {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} dirent64_t;
+
+typedef struct {
+    char *buf;          // Each entry as its d_type byte then its name; NULL for an empty slot
+    char **names;       // Sorted names in 'buf', the d_type of names[i] is names[i][-1]
+    unsigned num_names;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    int racy;           // Read again unless it was read during the current expansion
+    unsigned generation;  // Value of 'generation' when last used
+} listing_t;
+
+static listing_t *table = NULL;
+static unsigned table_size = 0;  // Number of slots in 'table'
+static unsigned table_used = 0;  // Number of listings in 'table'
+static unsigned long cached_names = 0;
+static unsigned generation = 0;  // Counts calls to wildcard_expand()
+
+static char *dirent_buf = NULL;
+static char path[PATH_MAX];  // Pathname being built by expand()
+
+// FNV-1a
+static unsigned hash_dir(dev_t dev, ino_t ino) {
+    uint64_t key[2] = {dev, ino};
+    const unsigned char *bytes = (const unsigned char *) key;
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < sizeof(key); i++) {
+        h ^= bytes[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Returns the slot holding the listing of a directory, or the empty slot where it would be inserted
+static unsigned find_slot(dev_t dev, ino_t ino) {
+    unsigned mask = table_size - 1;
+    unsigned i = hash_dir(dev, ino) & mask;
+    while (table[i].buf != NULL && (table[i].dev != dev || table[i].ino != ino)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void free_listing(listing_t *listing) {
+    free(listing->buf);
+    free(listing->names);
+    listing->buf = NULL;
+    listing->names = NULL;
+    cached_names -= listing->num_names;
+    listing->num_names = 0;
+}
+
+static int grow_table(void) {
+    unsigned new_size = table_size == 0 ? INITIAL_SIZE : table_size * 2;
+    listing_t *new_table = calloc(new_size, sizeof(listing_t));
+    if (new_table == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    listing_t *old_table = table;
+    unsigned old_size = table_size;
+    table = new_table;
+    table_size = new_size;
+    for (unsigned i = 0; i < old_size; i++) {
+        if (old_table[i].buf != NULL) {
+            table[find_slot(old_table[i].dev, old_table[i].ino)] = old_table[i];
+        }
+    }
+    free(old_table);
+    return 0;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+// Read the entries of the open directory 'fd' (except "." and "..") into 'listing'
+static int read_listing(int fd, listing_t *listing) {
+    if (dirent_buf == NULL && (dirent_buf = malloc(DIRENT_BUF_SIZE)) == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    size_t len = 0;
+    size_t cap = INITIAL_NAMES_SIZE;
+    unsigned num_names = 0;
+    char *buf = malloc(cap);
+    if (buf == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, dirent_buf, DIRENT_BUF_SIZE)) > 0) {
+        for (long pos = 0; pos < n;) {
+            dirent64_t *entry = (dirent64_t *) (dirent_buf + pos);
+            pos += entry->d_reclen;
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            size_t name_len = strlen(name);
+            if (len + name_len + 2 > cap) {
+                while (len + name_len + 2 > cap) {
+                    cap *= 2;
+                }
+                char *new_buf = realloc(buf, cap);
+                if (new_buf == NULL) {
+                    perror("realloc");
+                    free(buf);
+                    return -1;
+                }
+                buf = new_buf;
+            }
+            buf[len++] = entry->d_type;
+            memcpy(buf + len, name, name_len + 1);
+            len += name_len + 1;
+            num_names++;
+        }
+    }
+    if (n == -1) {
+        perror("getdents64");
+        free(buf);
+        return -1;
+    }
+
+    char **names = malloc((num_names + 1) * sizeof(char *));  // + 1: never malloc(0)
+    if (names == NULL) {
+        perror("malloc");
+        free(buf);
+        return -1;
+    }
+    char *name = buf + 1;
+    for (unsigned i = 0; i < num_names; i++) {
+        names[i] = name;
+        name += strlen(name) + 2;  // skip the '\0' and the next d_type
+    }
+    qsort(names, num_names, sizeof(char *), compare_names);
+    listing->buf = buf;
+    listing->names = names;
+    listing->num_names = num_names;
+    cached_names += num_names;
+    return 0;
+}
+
+// Get the sorted listing of directory 'dir', from the cache if it is still valid
+// Returns NULL if 'dir' is not a readable directory
+static listing_t *get_listing(const char *dir) {
+    struct stat st;
+    if (stat(dir, &st) == -1 || !S_ISDIR(st.st_mode)) {
+        return NULL;
+    }
+    if (table_size == 0 || (table_used + 1) * 10 > table_size * 7) {  // keep load factor <= 0.7
+        if (grow_table() != 0) {
+            return NULL;
+        }
+    }
+    listing_t *listing = &table[find_slot(st.st_dev, st.st_ino)];
+    if (listing->buf != NULL) {
+        if (listing->generation == generation ||
+            (!listing->racy && listing->mtime.tv_sec == st.st_mtim.tv_sec &&
+             listing->mtime.tv_nsec == st.st_mtim.tv_nsec)) {
+            // Kept for the rest of this expansion, which may still be using its names
+            listing->generation = generation;
+            return listing;
+        }
+    }
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+    // Take the time before reading, so a change made while reading counts as racy
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    listing_t fresh = {0};
+    if (fstat(fd, &st) == -1 || read_listing(fd, &fresh) != 0) {
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    // Replace an outdated listing in its slot, so no slot is emptied
+    if (listing->buf != NULL) {
+        free_listing(listing);
+    } else {
+        table_used++;
+    }
+    fresh.dev = st.st_dev;
+    fresh.ino = st.st_ino;
+    fresh.mtime = st.st_mtim;
+    fresh.racy = now.tv_sec - st.st_mtim.tv_sec < RACY_SECONDS;
+    fresh.generation = generation;
+    *listing = fresh;
+    return listing;
+}
+
+// Returns a pointer past the ']' closing the bracket expression at 'p', or NULL if it is not closed
+static const char *bracket_end(const char *p) {
+    p++;
+    if (*p == '!' || *p == '^') {
+        p++;
+    }
+    if (*p == ']') {  // a ']' first in the brackets is part of the set
+        p++;
+    }
+    while (*p != '\0' && *p != ']') {
+        p++;
+    }
+    return *p == ']' ? p + 1 : NULL;
+}
+
+// Nonzero if 'c' is in the bracket expression from 'p' to 'end'
+static int bracket_matches(const char *p, const char *end, char c) {
+    p++;
+    end--;  // the closing ']'
+    int negate = *p == '!' || *p == '^';
+    if (negate) {
+        p++;
+    }
+    int found = 0;
+    while (p < end) {
+        if (p[1] == '-' && p + 2 < end) {  // a range such as "a-z"
+            found |= (unsigned char) c >= (unsigned char) p[0] && (unsigned char) c <= (unsigned char) p[2];
+            p += 3;
+        } else {
+            found |= c == *p;
+            p++;
+        }
+    }
+    return found != negate;
+}
+
+// Match a name against one pattern component, backtracking to the last '*'
+static int match(const char *p, const char *s) {
+    const char *star = NULL;    // pattern after the last '*'
+    const char *resume = NULL;  // where the text matched by that '*' ends
+    while (*s != '\0') {
+        const char *next = NULL;
+        const char *end;
+        if (*p == '*') {
+            star = ++p;
+            resume = s;
+            continue;
+        } else if (*p == '?') {
+            next = p + 1;
+        } else if (*p == '[' && (end = bracket_end(p)) != NULL) {
+            next = bracket_matches(p, end, *s) ? end : NULL;
+        } else if (*p == *s) {
+            next = p + 1;
+        }
+        if (next != NULL) {
+            p = next;
+            s++;
+        } else if (star != NULL) {  // let the '*' take one more character
+            p = star;
+            s = ++resume;
+        } else {
+            return 0;
+        }
+    }
+    while (*p == '*') {
+        p++;
+    }
+    return *p == '\0';
+}
+
+int wildcard_has_pattern(const char *word) {
+    for (const char *c = word; *c != '\0'; c++) {
+        if (*c == '*' || *c == '?' || (*c == '[' && bracket_end(c) != NULL)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Expand the pattern components from 'comp' to 'end' (separated by '\0'
+// bytes) below the directory in the first 'len' bytes of 'path'
+// Returns the number of matches added to 'tokens' or -1 on error
+static int expand(char *comp, const char *end, size_t len, strvec_t *tokens) {
+    size_t comp_len = strlen(comp);
+    int last = comp + comp_len == end;
+    if (!wildcard_has_pattern(comp)) {  // no need to read the directory
+        if (len + comp_len + 2 > PATH_MAX) {
+            return 0;
+        }
+        memcpy(path + len, comp, comp_len);
+        len += comp_len;
+        if (!last) {
+            path[len++] = '/';
+            return expand(comp + comp_len + 1, end, len, tokens);
+        }
+        path[len] = '\0';
+        struct stat st;
+        if (lstat(path, &st) == -1) {
+            return 0;
+        }
+        return strvec_add(tokens, path) == 0 ? 1 : -1;
+    }
+
+    path[len] = '\0';
+    listing_t *listing = get_listing(len == 0 ? "." : path);
+    if (listing == NULL) {
+        return 0;
+    }
+    // Expanding the next component may move the table, but not the listing's arrays
+    char **names = listing->names;
+    unsigned num_names = listing->num_names;
+    int count = 0;
+    for (unsigned i = 0; i < num_names; i++) {
+        const char *name = names[i];
+        if ((name[0] == '.' && comp[0] != '.') || !match(comp, name)) {
+            continue;
+        }
+        size_t name_len = strlen(name);
+        if (len + name_len + 2 > PATH_MAX) {
+            continue;
+        }
+        memcpy(path + len, name, name_len + 1);
+        int ret;
+        if (last) {
+            ret = strvec_add(tokens, path) == 0 ? 1 : -1;
+        } else if (wildcard_maybe_dir(name)) {
+            path[len + name_len] = '/';
+            ret = expand(comp + comp_len + 1, end, len + name_len + 1, tokens);
+        } else {
+            continue;
+        }
+        if (ret == -1) {
+            return -1;
+        }
+        count += ret;
+    }
+    return count;
+}
+
+int wildcard_maybe_dir(const char *name) {
+    return name[-1] == DT_DIR || name[-1] == DT_LNK || name[-1] == DT_UNKNOWN;
+}
+
+int wildcard_list(const char *dir, char ***names) {
+    if (cached_names > MAX_CACHED_NAMES) {
+        wildcard_free();
+    }
+    generation++;
+    listing_t *listing = get_listing(dir[0] == '\0' ? "." : dir);
+    if (listing == NULL) {
+        return -1;
+    }
+    *names = listing->names;
+    return listing->num_names;
+}
+
+int wildcard_expand(const char *pattern, strvec_t *tokens) {
+    if (cached_names > MAX_CACHED_NAMES) {
+        wildcard_free();
+    }
+    generation++;
+    char *components = strdup(pattern);
+    if (components == NULL) {
+        perror("strdup");
+        return -1;
+    }
+    size_t pattern_len = strlen(components);
+    for (char *c = components; *c != '\0'; c++) {
+        if (*c == '/') {
+            *c = '\0';
+        }
+    }
+    int ret;
+    if (pattern[0] == '/') {
+        path[0] = '/';
+        ret = expand(components + 1, components + pattern_len, 1, tokens);
+    } else {
+        ret = expand(components, components + pattern_len, 0, tokens);
+    }
+    free(components);
+    return ret;
+}
+
+void wildcard_free(void) {
+    for (unsigned i = 0; i < table_size; i++) {
+        free_listing(&table[i]);
+    }
+    free(table);
+    table = NULL;
+    table_size = 0;
+    table_used = 0;
+    cached_names = 0;
+    free(dirent_buf);
+    dirent_buf = NULL;
+}
@@ -0,0 +1,55 @@
+#ifndef WILDCARD_H
+#define WILDCARD_H
+
+#include "string_vector.h"
+
+/*
+ * Pathname expansion of words holding '*', '?' or '[...]'
+ * Directories are read with getdents64() into a large buffer, and each
+ * listing is kept, sorted by name, in a cache keyed by the directory's device
+ * and inode number. A cached listing is used again as long as the directory's
+ * modification time is unchanged, so globbing the same directories over and
+ * over costs one stat() per directory instead of a full read. Listings of
+ * directories changed in the last couple of seconds are read again each time,
+ * since a change in the same clock tick would not move the modification time.
+ */
+
+/*
+ * Returns nonzero if 'word' holds a pattern: '*', '?' or a '[' closed by a
+ * later ']' (so the "[" of test(1) stays a plain word)
+ */
+int wildcard_has_pattern(const char *word);
+
+/*
+ * Add the pathnames matching 'pattern' to 'tokens', sorted directory by
+ * directory (matches in a directory are in strcmp() order)
+ * '*' and '?' do not match '/', and a name starting with '.' only matches a
+ * pattern component that starts with '.' ("." and ".." never match).
+ * pattern: The word to expand
+ * tokens: Vector the matches are added to (copied into its arena)
+ * Returns the number of matches added (0 if there are none, in which case
+ * the caller keeps the word as it is), or -1 on error
+ */
+int wildcard_expand(const char *pattern, strvec_t *tokens);
+
+/*
+ * Get the names in a directory, except "." and "..", from the listing cache
+ * dir: The directory ("" for the current one)
+ * names: Set to the names in strcmp() order, valid until the next call into
+ *        this module
+ * Returns the number of names, or -1 if 'dir' is not a readable directory
+ */
+int wildcard_list(const char *dir, char ***names);
+
+/*
+ * Returns nonzero if a name from wildcard_list() may be a directory (it is
+ * one, a symbolic link or of unknown type)
+ */
+int wildcard_maybe_dir(const char *name);
+
+/*
+ * Release the cached directory listings
+ */
+void wildcard_free(void);
+
+#endif // WILDCARD_H